@@ -0,0 +1,111 @@
+#include "alert_engine.h"
+#include <algorithm>
+
+const char* alert_severity_name(AlertSeverity severity) {
+    switch (severity) {
+        case AlertSeverity::INFO: return "info";
+        case AlertSeverity::WARNING: return "warning";
+        case AlertSeverity::CRITICAL: return "critical";
+    }
+    return "unknown";
+}
+
+const char* alert_kind_name(AlertKind kind) {
+    switch (kind) {
+        case AlertKind::UNAUTHORIZED_DEVICE: return "unauthorized_device";
+        case AlertKind::SECURITY_FLAG: return "security_flag";
+        case AlertKind::SUSPICIOUS_ACTIVITY: return "suspicious_activity";
+    }
+    return "unknown";
+}
+
+AlertEngine::AlertEngine() : history(HISTORY_SIZE), next_sequence(1), version(0) {
+    active.reserve(MAX_ACTIVE + 1);
+}
+
+bool AlertEngine::outranks(const SecurityAlert& a, const SecurityAlert& b) {
+    if (a.severity != b.severity) return a.severity > b.severity;
+    return a.sequence > b.sequence;
+}
+
+void AlertEngine::remove_active(DeviceKey device_key, bool any_kind, AlertKind kind) {
+    active.erase(std::remove_if(active.begin(), active.end(), [&](const SecurityAlert& alert) {
+        return alert.device_key == device_key && (any_kind || alert.kind == kind);
+    }), active.end());
+}
+
+uint64_t AlertEngine::raise(AlertKind kind, AlertSeverity severity, DeviceKey device_key, const std::string& text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    SecurityAlert alert;
+    alert.sequence = next_sequence++;
+    alert.kind = kind;
+    alert.severity = severity;
+    alert.device_key = device_key;
+    alert.raised = std::chrono::steady_clock::now();
+    alert.text = text;
+    history[alert.sequence % HISTORY_SIZE] = alert;
+    
+    remove_active(device_key, false, kind);
+    active.insert(std::upper_bound(active.begin(), active.end(), alert, outranks), alert);
+    if (active.size() > MAX_ACTIVE) active.pop_back();
+    
+    version.fetch_add(1, std::memory_order_release);
+    return alert.sequence;
+}
+
+void AlertEngine::resolve(DeviceKey device_key, AlertKind kind) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t before = active.size();
+    remove_active(device_key, false, kind);
+    if (active.size() != before) version.fetch_add(1, std::memory_order_release);
+}
+
+void AlertEngine::resolve_device(DeviceKey device_key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t before = active.size();
+    remove_active(device_key, true, AlertKind::UNAUTHORIZED_DEVICE);
+    if (active.size() != before) version.fetch_add(1, std::memory_order_release);
+}
+
+void AlertEngine::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    active.clear();
+    version.fetch_add(1, std::memory_order_release);
+}
+
+bool AlertEngine::get_top(SecurityAlert& alert) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active.empty()) return false;
+    alert = active.front();
+    return true;
+}
+
+void AlertEngine::get_active(std::vector<SecurityAlert>& alerts) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    alerts = active;
+}
+
+size_t AlertEngine::get_active_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return active.size();
+}
+
+uint64_t AlertEngine::read(uint64_t cursor, std::vector<SecurityAlert>& alerts, size_t max_alerts,
+                           uint64_t* missed) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t oldest = next_sequence > HISTORY_SIZE ? next_sequence - HISTORY_SIZE : 1;
+    if (cursor < oldest) {
+        // a fresh cursor starts at the oldest, a slow one lost what was overwritten
+        if (missed && cursor != 0) *missed += oldest - cursor;
+        cursor = oldest;
+    }
+    for (; cursor < next_sequence && max_alerts > 0; cursor++, max_alerts--) {
+        alerts.push_back(history[cursor % HISTORY_SIZE]);
+    }
+    return cursor;
+}
+
+uint64_t AlertEngine::get_next_sequence() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return next_sequence;
+}
@@ -0,0 +1,85 @@
+#ifndef ALERT_ENGINE_H
+#define ALERT_ENGINE_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "protocol_types.h"
+
+enum class AlertSeverity : uint8_t {
+    INFO = 0,
+    WARNING,
+    CRITICAL
+};
+
+enum class AlertKind : uint8_t {
+    UNAUTHORIZED_DEVICE,
+    SECURITY_FLAG,
+    SUSPICIOUS_ACTIVITY
+};
+
+const char* alert_severity_name(AlertSeverity severity);
+const char* alert_kind_name(AlertKind kind);
+
+struct SecurityAlert {
+    uint64_t sequence;         // 1 for the first alert raised, cursors count in these
+    AlertKind kind;
+    AlertSeverity severity;
+    DeviceKey device_key;
+    std::chrono::steady_clock::time_point raised;
+    std::string text;          // formatted once, when the alert was raised
+};
+
+// security alerts, raised by the device database when a device's state
+// changes instead of being rebuilt from every device whenever someone asks.
+// the active alerts are a bounded priority queue, most severe and then
+// newest first, one per device and kind. every raised alert also goes into
+// a fixed history ring that subscribers read with a cursor. version moves
+// on every change so a reader can tell with one atomic load whether to look.
+class AlertEngine {
+public:
+    static const size_t MAX_ACTIVE = 64;
+    static const size_t HISTORY_SIZE = 256;
+    
+private:
+    mutable std::mutex mutex;
+    std::vector<SecurityAlert> active;     // priority order
+    std::vector<SecurityAlert> history;    // sequence % HISTORY_SIZE
+    uint64_t next_sequence;
+    std::atomic<uint64_t> version;
+    
+    static bool outranks(const SecurityAlert& a, const SecurityAlert& b);
+    void remove_active(DeviceKey device_key, bool any_kind, AlertKind kind);
+    
+public:
+    AlertEngine();
+    
+    // replaces the device's active alert of the same kind, if any. the least
+    // important alert is dropped once MAX_ACTIVE are active.
+    uint64_t raise(AlertKind kind, AlertSeverity severity, DeviceKey device_key, const std::string& text);
+    // the device's alert of that kind is no longer active, or all of its alerts
+    void resolve(DeviceKey device_key, AlertKind kind);
+    void resolve_device(DeviceKey device_key);
+    void clear();
+    
+    // most important active alert, false if there is none
+    bool get_top(SecurityAlert& alert) const;
+    void get_active(std::vector<SecurityAlert>& alerts) const;
+    size_t get_active_count() const;
+    
+    // appends the alerts raised from cursor on, oldest first, at most max_alerts.
+    // returns the cursor for the next call. 0 starts at the oldest still in
+    // the history, get_next_sequence() at the next one raised. alerts that
+    // fell out of the history before they were read are added to missed.
+    uint64_t read(uint64_t cursor, std::vector<SecurityAlert>& alerts, size_t max_alerts,
+                  uint64_t* missed = nullptr) const;
+    uint64_t get_next_sequence() const;
+    uint64_t get_raised_count() const { return get_next_sequence() - 1; }
+    
+    uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+};
+
+#endif // ALERT_ENGINE_H
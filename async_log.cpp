@@ -0,0 +1,82 @@
+#include "async_log.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+AsyncLog::AsyncLog() : slots(SLOT_COUNT), head(0), count(0), writing(false), stopping(false), dropped_lines(0) {
+    writer = std::thread(&AsyncLog::write_loop, this);
+}
+
+AsyncLog::~AsyncLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    not_empty.notify_all();
+    if (writer.joinable()) writer.join();
+}
+
+AsyncLog& AsyncLog::instance() {
+    static AsyncLog log;
+    return log;
+}
+
+void AsyncLog::write(const char* line) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == SLOT_COUNT) {
+            dropped_lines.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Slot& slot = slots[(head + count) % SLOT_COUNT];
+        strncpy(slot.text, line, LINE_LENGTH - 1);
+        slot.text[LINE_LENGTH - 1] = '\0';
+        count++;
+    }
+    not_empty.notify_one();
+}
+
+void AsyncLog::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this] { return (count == 0 && !writing) || stopping; });
+}
+
+void AsyncLog::write_loop() {
+    char line[LINE_LENGTH];
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        not_empty.wait(lock, [this] { return count > 0 || stopping; });
+        if (count == 0) break;
+        
+        // copy out so the terminal write happens without the lock
+        memcpy(line, slots[head].text, LINE_LENGTH);
+        head = (head + 1) % SLOT_COUNT;
+        count--;
+        writing = true;
+        lock.unlock();
+        
+        fputs(line, stdout);
+        fputc('\n', stdout);
+        
+        // one flush per burst of lines rather than per line
+        lock.lock();
+        if (count == 0) {
+            lock.unlock();
+            fflush(stdout);
+            lock.lock();
+        }
+        writing = false;
+        if (count == 0) drained.notify_all();
+    }
+    fflush(stdout);
+    drained.notify_all();
+}
+
+void log_printf(const char* format, ...) {
+    char line[AsyncLog::LINE_LENGTH];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    AsyncLog::instance().write(line);
+}
@@ -0,0 +1,61 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// console output of the capture and analysis threads. a line is formatted
+// into a fixed slot and the caller moves on, a writer thread does the
+// possibly blocking write to stdout. a slow terminal or a full pipe never
+// stalls a pipeline stage: when all slots are taken the line is dropped and
+// counted instead. nothing here allocates after the first use.
+class AsyncLog {
+public:
+    static const size_t LINE_LENGTH = 512;   // longer lines are cut short
+    
+private:
+    static const size_t SLOT_COUNT = 256;
+    
+    struct Slot {
+        char text[LINE_LENGTH];
+    };
+    
+    std::vector<Slot> slots;
+    size_t head;
+    size_t count;
+    bool writing;              // a line has been taken but isn't written yet
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable drained;
+    std::thread writer;
+    std::atomic<uint64_t> dropped_lines;
+    
+    AsyncLog();
+    ~AsyncLog();
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+    
+    void write_loop();
+    
+public:
+    // started on first use, stopped and flushed at exit
+    static AsyncLog& instance();
+    
+    // one line, without the trailing newline
+    void write(const char* line);
+    // blocks until everything queued so far is on stdout
+    void flush();
+    
+    uint64_t get_dropped_lines() const { return dropped_lines.load(std::memory_order_relaxed); }
+};
+
+// printf style shorthand for AsyncLog::instance().write()
+void log_printf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // ASYNC_LOG_H
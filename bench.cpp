@@ -0,0 +1,511 @@
+#include "sample_convert.h"
+#include "spectrum_engine.h"
+#include "protocol_analyzer.h"
+#include "device_database.h"
+#include "device_store.h"
+#include "tuner_set.h"
+#include "detection_sink.h"
+#include "burst_detector.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <complex>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <cstring>
+#include <unistd.h>
+
+// micro-benchmarks for the dsp hot path, run with: make bench. a name as
+// the first argument runs only that one. `rf_bench replay [--min-msps x]
+// file.iq...` (make replay-bench) plays recordings through the whole
+// pipeline instead and exits non-zero if any of them is slower than x.
+// `rf_bench burst-check` (make burst-check) feeds the burst detector
+// synthetic channel samples and exits non-zero if it misbehaves.
+
+static const size_t CONVERT_SAMPLES = 1 << 18;   // 256k samples, one large capture block
+static const int CONVERT_ITERATIONS = 200;
+
+static void bench_convert() {
+    std::vector<uint8_t> input(CONVERT_SAMPLES * 2);
+    srand(1234);
+    for (auto& byte : input) byte = (uint8_t)(rand() & 0xff);
+    
+    std::vector<std::complex<float>> reference(CONVERT_SAMPLES);
+    get_convert_function(ConvertPath::SCALAR)(input.data(), CONVERT_SAMPLES, reference.data());
+    
+    std::vector<std::complex<float>> output(CONVERT_SAMPLES);
+    const ConvertPath paths[] = {ConvertPath::SCALAR, ConvertPath::LUT, ConvertPath::SSE2,
+                                 ConvertPath::AVX2, ConvertPath::NEON};
+                                 
+    std::cout << "convert_samples (" << CONVERT_SAMPLES << " samples x " << CONVERT_ITERATIONS
+              << ", active: " << get_convert_path_name(get_active_convert_path()) << ")" << std::endl;
+              
+    for (ConvertPath path : paths) {
+        ConvertFunction convert = get_convert_function(path);
+        if (!convert) {
+            std::cout << "  " << std::setw(8) << get_convert_path_name(path) << "  not supported" << std::endl;
+            continue;
+        }
+        
+        // warm up caches and check the result against the scalar path
+        convert(input.data(), CONVERT_SAMPLES, output.data());
+        float max_error = 0.0f;
+        for (size_t i = 0; i < CONVERT_SAMPLES; i++) {
+            max_error = std::max(max_error, std::abs(output[i] - reference[i]));
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        for (int iter = 0; iter < CONVERT_ITERATIONS; iter++) {
+            convert(input.data(), CONVERT_SAMPLES, output.data());
+        }
+        auto end = std::chrono::steady_clock::now();
+        
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double msps = (double)CONVERT_SAMPLES * CONVERT_ITERATIONS / seconds / 1e6;
+        double ns_per_sample = seconds * 1e9 / ((double)CONVERT_SAMPLES * CONVERT_ITERATIONS);
+        
+        std::cout << "  " << std::setw(8) << get_convert_path_name(path)
+                  << std::fixed << std::setprecision(1) << std::setw(10) << msps << " MS/s"
+                  << std::setprecision(3) << std::setw(9) << ns_per_sample << " ns/sample"
+                  << "  max error " << std::scientific << std::setprecision(1) << max_error
+                  << std::defaultfloat << std::endl;
+    }
+}
+
+// sizes the analysis stages see per block at the default 2.048 MS/s
+static const size_t BLOCK_SAMPLES = 32768;
+static const int FFT_SIZE = 2048;
+static const int SPECTRUM_PEAKS = 24;            // a busy ism band
+static const int DEVICE_COUNTS[] = {100, 1000, 10000};
+static const int STORE_DEVICE_COUNTS[] = {10000, 50000};
+
+// keeps results alive so the compiler can't drop the work
+static volatile double bench_sink;
+
+template <typename Fn>
+static double ns_per_call(int iterations, Fn fn) {
+    fn();
+    auto start = std::chrono::steady_clock::now();
+    for (int iter = 0; iter < iterations; iter++) {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static void print_result(const std::string& name, double ns, const std::string& extra = "") {
+    std::cout << "  " << std::left << std::setw(28) << name << std::right
+              << std::fixed << std::setprecision(3) << std::setw(12) << ns / 1e3 << " us"
+              << std::defaultfloat << (extra.empty() ? "" : "  ") << extra << std::endl;
+}
+
+static std::vector<std::complex<float>> make_noise_block(size_t samples) {
+    srand(4321);
+    std::vector<std::complex<float>> iq(samples);
+    for (auto& sample : iq) {
+        sample = std::complex<float>((rand() % 256 - 127.5f) / 128.0f * 0.05f,
+                                     (rand() % 256 - 127.5f) / 128.0f * 0.05f);
+    }
+    return iq;
+}
+
+// noise around -90 dB with carriers sticking out of it
+static std::vector<float> make_spectrum() {
+    srand(99);
+    std::vector<float> spectrum(FFT_SIZE);
+    for (auto& bin : spectrum) bin = -90.0f + (rand() % 600) / 100.0f;
+    for (int i = 0; i < SPECTRUM_PEAKS; i++) {
+        spectrum[FFT_SIZE / 8 + i * (FFT_SIZE * 3 / 4) / SPECTRUM_PEAKS] = -50.0f - i;
+    }
+    return spectrum;
+}
+
+static void bench_spectrum() {
+    std::vector<std::complex<float>> iq = make_noise_block(BLOCK_SAMPLES);
+    SpectrumEngine engine(FFT_SIZE);
+    if (!engine.initialize()) {
+        std::cout << "spectrum: fft setup failed" << std::endl;
+        return;
+    }
+    SpectrumFrame frame;
+    frame.center_freq = 433920000;
+    frame.sample_rate = 2048000;
+    
+    std::cout << "spectrum fft (" << FFT_SIZE << " point welch over " << BLOCK_SAMPLES << " samples, "
+              << (engine.is_specialized() ? "fixed size kernel" : "generic kernel") << ")" << std::endl;
+    double ns = ns_per_call(200, [&] { engine.compute(iq, frame); });
+    std::ostringstream rate;
+    rate << std::fixed << std::setprecision(1) << BLOCK_SAMPLES / ns * 1e3 << " MS/s";
+    print_result("compute", ns, rate.str());
+    
+    // the bin loop on its own, std::log10 against the fused fast log2 kernel
+    std::vector<float> power(FFT_SIZE);
+    for (int i = 0; i < FFT_SIZE; i++) power[i] = std::pow(10.0f, (rand() % 1200 - 1000) / 100.0f);
+    std::vector<float> exact(FFT_SIZE);
+    std::vector<float> fast(FFT_SIZE);
+    double exact_ns = ns_per_call(20000, [&] {
+        for (int i = 0; i < FFT_SIZE; i++) {
+            exact[i] = 10.0f * std::log10(power[(i + FFT_SIZE / 2) % FFT_SIZE] + POWER_FLOOR);
+        }
+        bench_sink = exact[0];
+    });
+    double fast_ns = ns_per_call(20000, [&] {
+        power_to_db_shifted<FFT_SIZE>(power.data(), 1.0f, fast.data());
+        bench_sink = fast[0];
+    });
+    float max_error = 0.0f;
+    for (int i = 0; i < FFT_SIZE; i++) {
+        max_error = std::max(max_error, std::abs(fast[i] - exact[i]));
+    }
+    std::ostringstream error;
+    error << "max error " << std::scientific << std::setprecision(1) << max_error << " dB";
+    print_result("power to db, log10", exact_ns);
+    print_result("power to db, fast log2", fast_ns, error.str());
+}
+
+static void bench_analyzer(ProtocolAnalyzer& analyzer, const std::string& filter) {
+    std::vector<float> spectrum = make_spectrum();
+    
+    if (filter.empty() || filter == "noise") {
+        std::cout << "estimate_noise_floor (" << FFT_SIZE << " bins)" << std::endl;
+        print_result("estimate_noise_floor", ns_per_call(20000, [&] {
+            bench_sink = analyzer.estimate_noise_floor(spectrum);
+        }));
+    }
+    
+    if (filter.empty() || filter == "peaks") {
+        std::cout << "find_signal_peaks (" << FFT_SIZE << " bins, " << SPECTRUM_PEAKS << " peaks)" << std::endl;
+        PeakList peaks;
+        double threshold = analyzer.detection_threshold(analyzer.estimate_noise_floor(spectrum));
+        double ns = ns_per_call(20000, [&] {
+            analyzer.find_signal_peaks(spectrum, threshold, 433920000, 2048000, peaks);
+            bench_sink = (double)peaks.size();
+        });
+        print_result("find_signal_peaks", ns, std::to_string(peaks.size()) + " found");
+    }
+    
+    if (filter.empty() || filter == "classify") {
+        // one signal per band the signatures cover, burst and demod results set
+        std::vector<SignalCharacteristics> signals;
+        const double frequencies[] = {315000000, 390000000, 433920000, 433420000, 868300000, 868100000, 915000000, 906000000};
+        const Modulation modulations[] = {Modulation::OOK, Modulation::FSK, Modulation::LORA_CSS, Modulation::UNKNOWN};
+        for (double frequency : frequencies) {
+            for (Modulation modulation : modulations) {
+                SignalCharacteristics signal = SignalCharacteristics();
+                signal.frequency = frequency;
+                signal.bandwidth = modulation == Modulation::LORA_CSS ? 125000 : 25000;
+                signal.power_db = -50.0;
+                signal.snr_db = 30.0;
+                signal.modulation = modulation;
+                signal.symbol_rate = 2400;
+                signal.is_burst = true;
+                signal.burst_duration = 0.05;
+                signals.push_back(signal);
+            }
+        }
+        std::cout << "classify_protocol (" << signals.size() << " signals)" << std::endl;
+        SignatureIndexPtr index = analyzer.get_signature_index();
+        size_t next = 0;
+        print_result("classify_protocol", ns_per_call(200000, [&] {
+            const ProtocolSignature* signature = analyzer.classify_protocol(*index, signals[next]);
+            bench_sink = signature ? signature->frequency_min : 0.0;
+            next = (next + 1) % signals.size();
+        }));
+    }
+}
+
+static void bench_device_database() {
+    std::cout << "device database lookups" << std::endl;
+    for (int count : DEVICE_COUNTS) {
+        // devices 60 khz apart over the ism bands, tolerance is 50 khz
+        DeviceDatabase db;
+        std::vector<double> frequencies;
+        std::vector<DeviceKey> keys;
+        for (int i = 0; i < count; i++) {
+            DetectedDevice device = DetectedDevice();
+            device.protocol = ProtocolType::ISM_433_OOK;
+            device.signal.frequency = 300000000.0 + i * 60000.0;
+            device.device_key = make_device_key(signature_id("433MHz OOK"), device.signal.frequency);
+            frequencies.push_back(device.signal.frequency + 10000.0);
+            keys.push_back(device.device_key);
+            db.insert(device);
+        }
+        
+        size_t next = 0;
+        double by_frequency = ns_per_call(200000, [&] {
+            bench_sink = (double)db.find_by_frequency(frequencies[next]).index;
+            next = (next * 7919 + 1) % frequencies.size();
+        });
+        next = 0;
+        double by_key = ns_per_call(200000, [&] {
+            bench_sink = (double)db.find_by_key(keys[next]).index;
+            next = (next * 7919 + 1) % keys.size();
+        });
+        print_result("find_by_frequency " + std::to_string(count), by_frequency);
+        print_result("find_by_key " + std::to_string(count), by_key);
+    }
+}
+
+// startup with a big fleet: the store's open (one mmap and copy per file)
+// and the analyzer's open on top of it, which also builds the indexes
+static void bench_device_store() {
+    std::cout << "device store load" << std::endl;
+    // the files go on every return, declared first so they outlive the stores
+    struct StoreFiles {
+        std::string path;
+        ~StoreFiles() {
+            unlink(path.c_str());
+            unlink((path + ".journal").c_str());
+        }
+    } files{"/tmp/rf_bench_devices." + std::to_string(getpid())};
+    const std::string& path = files.path;
+    for (int count : STORE_DEVICE_COUNTS) {
+        std::vector<StoredDevice> devices(count);
+        std::vector<DeviceKey> authorized;
+        int64_t now_ms = DeviceStore::wall_time_ms();
+        for (int i = 0; i < count; i++) {
+            StoredDevice& device = devices[i];
+            memset(&device, 0, sizeof(device));
+            device.protocol = (uint8_t)ProtocolType::ISM_433_OOK;
+            device.frequency = 300000000.0 + i * 60000.0;
+            device.device_key = make_device_key(signature_id("433MHz OOK"), device.frequency);
+            device.first_seen_ms = now_ms - 60000;
+            device.last_seen_ms = now_ms;
+            device.packet_count = 1;
+            if (i % 10 == 0) authorized.push_back(device.device_key);
+        }
+        {
+            DeviceStore store;
+            StoredState state;
+            if (!store.open(path, state) || !store.begin_compact() ||
+                !store.finish_compact(devices, authorized)) return;
+        }
+        
+        StoredState state;
+        DeviceStore store;
+        auto start = std::chrono::steady_clock::now();
+        bool opened = store.open(path, state);
+        double store_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        store.close();
+        
+        ProtocolAnalyzer analyzer;
+        start = std::chrono::steady_clock::now();
+        opened = opened && analyzer.open_device_store(path);
+        double analyzer_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (!opened) return;
+        print_result("DeviceStore::open " + std::to_string(count), store_ns);
+        print_result("open_device_store " + std::to_string(count), analyzer_ns,
+                     std::to_string(analyzer.get_device_count()) + " devices");
+    }
+}
+
+// counts instead of printing, the console would be the bottleneck
+class CountingSink : public DetectionSink {
+public:
+    std::atomic<uint64_t> detections;
+    CountingSink() : detections(0) {}
+    void emit(const Detection&, const std::string&) override { detections++; }
+};
+
+struct ReplayResult {
+    std::string path;
+    double msps;
+    uint64_t detections;
+    size_t devices;
+    double p99_block_ms;
+};
+
+// the whole pipeline as fast as it keeps up, one fresh analyzer per file
+static bool replay_file(const std::string& path, ReplayResult& result) {
+    ProtocolAnalyzer analyzer;
+    CountingSink sink;
+    TunerSet tuners;
+    analyzer.add_detection_sink(&sink);
+    if (!tuners.open_replay(path, false) || !analyzer.initialize()) return false;
+    tuners.connect(analyzer);
+    if (!tuners.start()) return false;
+    
+    auto started = std::chrono::steady_clock::now();
+    while (!tuners.primary().pipeline.is_drained()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    tuners.stop();
+    
+    const Pipeline& pipeline = tuners.primary().pipeline;
+    result.path = path;
+    result.msps = elapsed > 0.0 ? pipeline.get_samples_analyzed() / elapsed / 1e6 : 0.0;
+    result.detections = sink.detections;
+    result.devices = analyzer.get_device_count();
+    result.p99_block_ms = pipeline.get_block_latency().percentile_us(0.99) / 1e3;
+    return true;
+}
+
+static int run_replays(int argc, char* argv[]) {
+    double min_msps = 0.0;
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--min-msps" && i + 1 < argc) {
+            min_msps = std::atof(argv[++i]);
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: " << argv[0] << " replay [--min-msps <x>] <file.iq>..." << std::endl;
+        return 1;
+    }
+    
+    // the analyzers' own output goes first, the table comes once all are done
+    std::vector<ReplayResult> results;
+    for (const auto& path : paths) {
+        ReplayResult result;
+        if (!replay_file(path, result)) {
+            std::cerr << "Replay of " << path << " failed!" << std::endl;
+            return 1;
+        }
+        results.push_back(result);
+    }
+    
+    bool slow = false;
+    std::cout << std::endl << "replay (whole pipeline, unpaced)" << std::endl;
+    for (const auto& result : results) {
+        bool below = result.msps < min_msps;
+        slow = slow || below;
+        std::cout << "  " << std::left << std::setw(40) << result.path << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(9) << result.msps << " MS/s"
+                  << std::setw(8) << result.detections << " detections"
+                  << std::setw(6) << result.devices << " devices"
+                  << std::setprecision(1) << std::setw(9) << result.p99_block_ms << " ms p99 block"
+                  << std::defaultfloat << (below ? "  SLOW" : "") << std::endl;
+    }
+    if (slow) {
+        std::cout << "at least one replay ran below " << min_msps << " MS/s" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// the burst detector at the rate the pipeline feeds it, one channel of the
+// channelizer, in the pipeline's block size
+static const int CHECK_CHANNELS = 16;              // as the pipeline's channelizer
+static const double CHECK_CHANNEL_RATE = 2048000.0 / CHECK_CHANNELS;
+static const size_t CHECK_BLOCK = BLOCK_SAMPLES / CHECK_CHANNELS;
+static const double CHECK_NOISE_S = 5.0;
+static const double CHECK_SETTLE_S = 1.0;          // blocks before this aren't judged
+static const double CHECK_BURST_S = 20e-3;
+static const double CHECK_BURST_GAP_S = 200e-3;
+static const int CHECK_BURSTS = 10;
+static const double CHECK_SNR_DB = 15.0;
+static const double CHECK_OOK_BAUD = 10000.0;
+
+// complex gaussian noise of unit mean power
+static void add_noise(std::vector<std::complex<float>>& block, std::mt19937& rng) {
+    std::normal_distribution<float> gauss(0.0f, std::sqrt(0.5f));
+    for (auto& sample : block) sample = std::complex<float>(gauss(rng), gauss(rng));
+}
+
+// noise only: no channel may sit in a burst, the floor has to match the noise.
+// noise plus ook bursts: each one found once, with about the length it had.
+static int run_burst_check() {
+    bool failed = false;
+    std::vector<std::complex<float>> block(CHECK_BLOCK);
+    std::vector<BurstEvent> events;
+    BurstStream stream = {0, 1, CHECK_CHANNEL_RATE, 0.0};
+    
+    std::cout << "burst detector at " << CHECK_CHANNEL_RATE / 1e3 << " kHz" << std::endl;
+    const size_t noise_blocks = (size_t)(CHECK_NOISE_S * CHECK_CHANNEL_RATE / CHECK_BLOCK);
+    const size_t settle_blocks = (size_t)(CHECK_SETTLE_S * CHECK_CHANNEL_RATE / CHECK_BLOCK);
+    for (int channel = 0; channel < CHECK_CHANNELS; channel++) {
+        std::mt19937 rng(channel + 1);
+        BurstDetector detector(channel);
+        detector.reset(stream);
+        events.clear();
+        size_t open_blocks = 0;
+        for (size_t b = 0; b < noise_blocks; b++) {
+            add_noise(block, rng);
+            detector.process(block.data(), block.size(), events);
+            if (b >= settle_blocks && detector.is_in_burst()) open_blocks++;
+        }
+        double open_fraction = (double)open_blocks / (noise_blocks - settle_blocks);
+        double floor_db = detector.get_noise_floor_db();
+        bool bad = detector.is_in_burst() || open_fraction > 0.01 || std::fabs(floor_db) > 1.0;
+        failed = failed || bad;
+        std::cout << "  noise channel " << std::setw(2) << channel << std::fixed << std::setprecision(2)
+                  << std::setw(8) << floor_db << " dB floor" << std::setw(7) << open_fraction * 100.0
+                  << "% blocks in a burst" << std::setw(5) << events.size() << " bursts"
+                  << std::defaultfloat << (bad ? "  FAIL" : "") << std::endl;
+    }
+    
+    // on-off keyed 1010... carrier 10 kHz off the channel center, starting
+    // with a pulse and ending with one
+    std::mt19937 rng(77);
+    BurstDetector detector(0);
+    detector.reset(stream);
+    events.clear();
+    const double amplitude = std::sqrt(std::pow(10.0, CHECK_SNR_DB / 10.0));
+    const uint64_t burst_samples = (uint64_t)(CHECK_BURST_S * CHECK_CHANNEL_RATE);
+    const uint64_t period = (uint64_t)((CHECK_BURST_S + CHECK_BURST_GAP_S) * CHECK_CHANNEL_RATE);
+    const uint64_t first_burst = (uint64_t)(CHECK_SETTLE_S * CHECK_CHANNEL_RATE);
+    const uint64_t total = first_burst + CHECK_BURSTS * period;
+    const double samples_per_bit = CHECK_CHANNEL_RATE / CHECK_OOK_BAUD;
+    const uint64_t bits = (uint64_t)(burst_samples / samples_per_bit) | 1;
+    const uint64_t keyed_samples = (uint64_t)(bits * samples_per_bit);
+    for (uint64_t start = 0; start < total; start += CHECK_BLOCK) {
+        add_noise(block, rng);
+        for (size_t i = 0; i < block.size(); i++) {
+            uint64_t n = start + i;
+            if (n < first_burst) continue;
+            uint64_t offset = (n - first_burst) % period;
+            if (offset >= keyed_samples || (uint64_t)(offset / samples_per_bit) % 2 == 1) continue;
+            double phase = 2.0 * M_PI * 10e3 * n / CHECK_CHANNEL_RATE;
+            block[i] += std::complex<float>((float)(amplitude * std::cos(phase)), (float)(amplitude * std::sin(phase)));
+        }
+        detector.process(block.data(), block.size(), events);
+    }
+    
+    const double keyed_s = keyed_samples / CHECK_CHANNEL_RATE;
+    int good = 0;
+    for (const auto& event : events) {
+        // distance to the nearest burst start, either side of it
+        int64_t offset = (int64_t)event.start_sample - (int64_t)first_burst + (int64_t)period / 2;
+        int64_t from_start = offset - (int64_t)period / 2 - (offset / (int64_t)period) * (int64_t)period;
+        bool aligned = offset >= 0 && std::llabs(from_start) < 16;
+        if (aligned && std::fabs(event.duration - keyed_s) < 1e-3) good++;
+    }
+    bool bad = (int)events.size() != CHECK_BURSTS || good != CHECK_BURSTS || detector.is_in_burst();
+    failed = failed || bad;
+    std::cout << "  " << CHECK_BURSTS << " ook bursts of " << keyed_s * 1e3 << " ms at " << CHECK_SNR_DB
+              << " dB snr: " << events.size() << " found, " << good << " with the right start and length"
+              << (bad ? "  FAIL" : "") << std::endl;
+    if (failed) {
+        std::cout << "burst detector check failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter = argc > 1 ? argv[1] : "";
+    if (filter == "replay") return run_replays(argc, argv);
+    if (filter == "burst-check") return run_burst_check();
+    
+    if (filter.empty() || filter == "convert") bench_convert();
+    if (filter.empty() || filter == "spectrum") bench_spectrum();
+    if (filter.empty() || filter == "noise" || filter == "peaks" || filter == "classify") {
+        ProtocolAnalyzer analyzer;
+        if (!analyzer.initialize()) return 1;
+        bench_analyzer(analyzer, filter);
+    }
+    if (filter.empty() || filter == "devices") bench_device_database();
+    if (filter.empty() || filter == "store") bench_device_store();
+    
+    return 0;
+}
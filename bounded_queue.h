@@ -0,0 +1,91 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+// fixed capacity fifo between pipeline stages. storage is allocated once,
+// push blocks while full so a slow stage applies backpressure upstream.
+template <typename T>
+class BoundedQueue {
+private:
+    std::vector<T> slots;
+    size_t head;
+    size_t count;
+    bool closed;
+    
+    mutable std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    
+public:
+    explicit BoundedQueue(size_t capacity)
+        : slots(capacity), head(0), count(0), closed(false) {}
+        
+    // returns false if the queue was closed or the timeout expired
+    bool push(T&& item, std::chrono::milliseconds timeout = std::chrono::milliseconds(100)) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!not_full.wait_for(lock, timeout, [this] { return closed || count < slots.size(); })) {
+            return false;
+        }
+        if (closed) return false;
+        
+        slots[(head + count) % slots.size()] = std::move(item);
+        count++;
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+    
+    bool try_push(T&& item) {
+        return push(std::move(item), std::chrono::milliseconds(0));
+    }
+    
+    // returns false if nothing arrived before the timeout or the queue closed empty
+    bool pop(T& item, std::chrono::milliseconds timeout = std::chrono::milliseconds(100)) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!not_empty.wait_for(lock, timeout, [this] { return closed || count > 0; })) {
+            return false;
+        }
+        if (count == 0) return false;
+        
+        item = std::move(slots[head]);
+        head = (head + 1) % slots.size();
+        count--;
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+    
+    // wake everyone up, pending items can still be popped
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+    
+    // drop anything left over and accept pushes again
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) slot = T();
+        head = 0;
+        count = 0;
+        closed = false;
+    }
+    
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+    
+    size_t capacity() const { return slots.size(); }
+};
+
+#endif // BOUNDED_QUEUE_H
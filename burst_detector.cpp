@@ -0,0 +1,147 @@
+#include "burst_detector.h"
+#include <cmath>
+#include <algorithm>
+
+static double to_db(double power) {
+    return 10.0 * std::log10(power + 1e-20);
+}
+
+BurstDetector::BurstDetector(int channel) : channel(channel) {
+    BurstStream default_stream = {0, 1, 2048000, 0};
+    reset(default_stream);
+}
+
+void BurstDetector::reset(const BurstStream& new_stream) {
+    stream = new_stream;
+    const double rate = std::max(1.0, stream.sample_rate);
+    
+    envelope_alpha = (float)(1.0 - std::exp(-1.0 / (ENVELOPE_TAU_S * rate)));
+    floor_alpha = (float)(1.0 - std::exp(-1.0 / (FLOOR_TAU_S * rate)));
+    floor_rise = (float)std::pow(10.0, FLOOR_RISE_DB_PER_S / 10.0 / rate);
+    warmup_samples = (uint64_t)(WARMUP_S * rate);
+    warmup_alpha = 1.0f / std::max<uint64_t>(1, warmup_samples / 4);
+    hangover_samples = (uint64_t)(HANGOVER_S * rate);
+    min_burst_samples = (uint64_t)(MIN_BURST_S * rate);
+    start_ratio = (float)std::pow(10.0, START_THRESHOLD_DB / 10.0);
+    stop_ratio = (float)std::pow(10.0, STOP_THRESHOLD_DB / 10.0);
+    
+    sample_index = 0;
+    envelope = 0.0f;
+    floor_envelope = 0.0f;
+    noise_floor = 0.0f;
+    previous = std::complex<float>(0.0f, 0.0f);
+    in_burst = false;
+}
+
+void BurstDetector::begin_burst() {
+    in_burst = true;
+    burst_start = sample_index;
+    last_above = sample_index;
+    energy = 0.0;
+    pending_energy = 0.0;
+    peak_power = 0.0f;
+    burst_floor = noise_floor;
+    weight_sum = 0.0;
+    freq_sum = 0.0;
+    freq_sq_sum = 0.0;
+}
+
+void BurstDetector::process(const std::complex<float>* samples, size_t count, std::vector<BurstEvent>& events) {
+    for (size_t i = 0; i < count; i++) {
+        const std::complex<float> x = samples[i];
+        const float power = std::norm(x);
+        envelope += envelope_alpha * (power - envelope);
+        floor_envelope += floor_alpha * (power - floor_envelope);
+        
+        if (sample_index < warmup_samples) {
+            // no history to track a minimum from yet, average instead. the slow
+            // average starts from there too rather than crawling up from zero.
+            noise_floor = sample_index == 0 ? envelope : noise_floor + warmup_alpha * (envelope - noise_floor);
+            floor_envelope = noise_floor;
+        } else if (!in_burst) {
+            noise_floor = std::min(floor_envelope, noise_floor * floor_rise);
+            if (envelope > noise_floor * start_ratio) {
+                begin_burst();
+            }
+        }
+        
+        if (in_burst) {
+            pending_energy += power;
+            peak_power = std::max(peak_power, power);
+            
+            if (envelope > burst_floor * stop_ratio) {
+                // instantaneous frequency in radians per sample. weighting by the
+                // power of both samples keeps the noise around ook pulse edges
+                // from widening the spread.
+                std::complex<float> step = x * std::conj(previous);
+                double omega = std::atan2(step.imag(), step.real());
+                double weight = std::norm(step);
+                weight_sum += weight;
+                freq_sum += weight * omega;
+                freq_sq_sum += weight * omega * omega;
+                
+                last_above = sample_index;
+                energy += pending_energy;
+                pending_energy = 0.0;
+            } else if (sample_index - last_above > hangover_samples) {
+                if (last_above + 1 - burst_start >= min_burst_samples) {
+                    events.push_back(make_event(last_above + 1, true));
+                }
+                in_burst = false;
+            }
+        }
+        
+        previous = x;
+        sample_index++;
+    }
+}
+
+BurstEvent BurstDetector::make_event(uint64_t end, bool complete) const {
+    BurstEvent event;
+    event.channel = channel;
+    
+    // the envelope lags the signal by its time constant on both edges. undo
+    // that using the burst's mean power: on top of floor F a step of height A
+    // crosses level L after -tau * ln(1 - (L - F) / A) and decays below it
+    // again after tau * ln(A / (L - F)).
+    const double tau = ENVELOPE_TAU_S * stream.sample_rate;
+    const uint64_t samples = last_above + 1 - burst_start;
+    const double mean_power = energy / samples;
+    const double signal_power = mean_power - burst_floor;
+    const double start_rise = burst_floor * (start_ratio - 1.0f);
+    const double stop_rise = burst_floor * (stop_ratio - 1.0f);
+    
+    double start_lag = signal_power > start_rise ? -tau * std::log(1.0 - start_rise / signal_power) : 0.0;
+    double end_lag = complete && signal_power > stop_rise ? tau * std::log(signal_power / stop_rise) : 0.0;
+    
+    int64_t start = (int64_t)burst_start - (int64_t)std::lround(start_lag);
+    int64_t stop = (int64_t)end - (int64_t)std::lround(end_lag);
+    start = std::max<int64_t>(0, start);
+    stop = std::max(stop, start + 1);
+    
+    event.start_sample = stream.first_sample + (uint64_t)start * stream.decimation;
+    event.end_sample = stream.first_sample + (uint64_t)stop * stream.decimation;
+    event.duration = (stop - start) / stream.sample_rate;
+    
+    const double hz_per_radian = stream.sample_rate / (2.0 * M_PI);
+    double mean_omega = weight_sum > 0 ? freq_sum / weight_sum : 0.0;
+    double var_omega = weight_sum > 0 ? std::max(0.0, freq_sq_sum / weight_sum - mean_omega * mean_omega) : 0.0;
+    event.frequency = stream.center_frequency + mean_omega * hz_per_radian;
+    event.bandwidth = 2.0 * std::sqrt(var_omega) * hz_per_radian;
+    
+    event.peak_power_db = to_db(peak_power);
+    event.mean_power_db = to_db(mean_power);
+    event.noise_floor_db = to_db(burst_floor);
+    event.complete = complete;
+    return event;
+}
+
+bool BurstDetector::active_burst(BurstEvent& event) const {
+    if (!in_burst) return false;
+    event = make_event(last_above + 1, false);
+    return true;
+}
+
+double BurstDetector::get_noise_floor_db() const {
+    return to_db(noise_floor);
+}
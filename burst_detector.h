@@ -0,0 +1,103 @@
+#ifndef BURST_DETECTOR_H
+#define BURST_DETECTOR_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+
+// where a detector's input stream sits in the capture. stream sample i is
+// capture sample first_sample + i * decimation.
+struct BurstStream {
+    uint64_t first_sample;
+    uint32_t decimation;       // 1 for the full rate stream
+    double sample_rate;        // of the stream itself
+    double center_frequency;   // absolute frequency of the stream's dc
+};
+
+// one transmission found by a BurstDetector. sample positions are capture
+// sample indices, accurate to one stream sample.
+struct BurstEvent {
+    int channel;               // channelizer channel, -1 for a full rate stream
+    uint64_t start_sample;
+    uint64_t end_sample;       // one past the last sample above the stop threshold
+    double duration;           // seconds
+    double frequency;          // absolute, mean instantaneous frequency
+    double bandwidth;          // hz, twice the rms spread of the instantaneous frequency
+    double peak_power_db;
+    double mean_power_db;
+    double noise_floor_db;
+    bool complete;             // false while the burst is still on air
+};
+
+// streaming energy detector, O(1) per sample. the envelope is a one pole
+// average of |x|^2 fast enough for ook pulses. the noise floor is an
+// exponential minimum tracker over a second, much slower average: it follows
+// that down instantly and creeps up slowly, and is frozen while a burst is on.
+// tracking the fast envelope instead would follow every noise dip at channel
+// rates, where 50 us is only a few samples. start/stop use hysteresis plus a
+// hangover so the gaps between ook pulses don't split one packet into many
+// bursts.
+class BurstDetector {
+private:
+    static constexpr double ENVELOPE_TAU_S = 50e-6;    // resolves 10 kbps ook pulses
+    static constexpr double FLOOR_TAU_S = 5e-3;        // the average the floor tracks
+    static constexpr double FLOOR_RISE_DB_PER_S = 3.0;
+    static constexpr double WARMUP_S = 10e-3;          // floor starts as a plain average
+    static constexpr double START_THRESHOLD_DB = 10.0;
+    static constexpr double STOP_THRESHOLD_DB = 6.0;
+    static constexpr double HANGOVER_S = 2e-3;
+    static constexpr double MIN_BURST_S = 100e-6;
+    
+    int channel;
+    BurstStream stream;
+    
+    // derived from the sample rate
+    float envelope_alpha;
+    float floor_alpha;
+    float floor_rise;          // per sample growth factor of the floor
+    float warmup_alpha;
+    uint64_t warmup_samples;
+    uint64_t hangover_samples;
+    uint64_t min_burst_samples;
+    float start_ratio;
+    float stop_ratio;
+    
+    uint64_t sample_index;     // stream samples since reset
+    float envelope;
+    float floor_envelope;
+    float noise_floor;
+    std::complex<float> previous;
+    
+    // current burst
+    bool in_burst;
+    uint64_t burst_start;
+    uint64_t last_above;       // last stream sample above the stop threshold
+    double energy;             // up to last_above
+    double pending_energy;     // since last_above, dropped if the burst ends
+    float peak_power;
+    float burst_floor;
+    double weight_sum;         // weighted instantaneous frequency moments
+    double freq_sum;
+    double freq_sq_sum;
+    
+    void begin_burst();
+    BurstEvent make_event(uint64_t end, bool complete) const;
+    
+public:
+    explicit BurstDetector(int channel = -1);
+    
+    // start over on a new stream, clears any burst in progress
+    void reset(const BurstStream& new_stream);
+    
+    // feed samples, completed bursts are appended to events
+    void process(const std::complex<float>* samples, size_t count, std::vector<BurstEvent>& events);
+    
+    // the burst that is on air right now, false if there is none
+    bool active_burst(BurstEvent& event) const;
+    
+    double get_noise_floor_db() const;
+    bool is_in_burst() const { return in_burst; }
+};
+
+#endif // BURST_DETECTOR_H
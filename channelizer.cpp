@@ -0,0 +1,140 @@
+#include "channelizer.h"
+#include "fft_plan_cache.h"
+#include <cmath>
+#include <algorithm>
+
+PolyphaseChannelizer::PolyphaseChannelizer(int channel_count, int taps_per_branch)
+    : channel_count(channel_count), taps_per_branch(taps_per_branch), history_len(0),
+      fft_in(nullptr), fft_out(nullptr), fft_plan(nullptr) {
+}
+
+PolyphaseChannelizer::~PolyphaseChannelizer() {
+    cleanup();
+}
+
+bool PolyphaseChannelizer::initialize() {
+    if (fft_plan) return true;
+    
+    fft_in = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * channel_count);
+    fft_out = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * channel_count);
+    if (!fft_in || !fft_out) {
+        cleanup();
+        return false;
+    }
+    
+    // the branch outputs are combined with an inverse dft, channel k = +k * fs / M
+    fft_plan = FFTPlanCache::instance().get_plan(channel_count, FFTW_BACKWARD, fft_in, fft_out);
+    if (!fft_plan) {
+        cleanup();
+        return false;
+    }
+    
+    design_prototype();
+    reset();
+    return true;
+}
+
+void PolyphaseChannelizer::cleanup() {
+    // the plan belongs to the plan cache
+    fft_plan = nullptr;
+    if (fft_in) {
+        fftwf_free(fft_in);
+        fft_in = nullptr;
+    }
+    if (fft_out) {
+        fftwf_free(fft_out);
+        fft_out = nullptr;
+    }
+}
+
+void PolyphaseChannelizer::design_prototype() {
+    // windowed sinc lowpass with its cutoff at half the channel spacing, so
+    // neighbouring channels cross at -6 dB. blackman keeps leakage from strong
+    // neighbours well below the noise floor of a weak channel.
+    const int taps = channel_count * taps_per_branch;
+    const double cutoff = 0.5 / channel_count;
+    const double middle = (taps - 1) / 2.0;
+    
+    prototype.resize(taps);
+    double sum = 0.0;
+    for (int n = 0; n < taps; n++) {
+        double t = n - middle;
+        double sinc = t == 0.0 ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+        double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * n / (taps - 1))
+                             + 0.08 * std::cos(4.0 * M_PI * n / (taps - 1));
+        prototype[n] = (float)(sinc * window);
+        sum += prototype[n];
+    }
+    
+    // unity gain at the channel center, a tone keeps its amplitude
+    for (auto& tap : prototype) {
+        tap = (float)(tap / sum);
+    }
+    
+    history_len = taps - 1;
+}
+
+void PolyphaseChannelizer::reset() {
+    history.assign(history_len, std::complex<float>(0.0f, 0.0f));
+}
+
+bool PolyphaseChannelizer::process(const std::vector<std::complex<float>>& iq_data,
+                                   std::vector<std::vector<std::complex<float>>>& channels) {
+    if (!fft_plan) return false;
+    
+    // history holds history_len already filtered samples plus whatever didn't
+    // make up a full output last time
+    work.clear();
+    work.insert(work.end(), history.begin(), history.end());
+    work.insert(work.end(), iq_data.begin(), iq_data.end());
+    
+    const size_t first_pending = history_len;
+    const size_t outputs = (work.size() - first_pending) / channel_count;
+    
+    channels.resize(channel_count);
+    for (auto& channel : channels) {
+        channel.resize(outputs);
+    }
+    
+    for (size_t n = 0; n < outputs; n++) {
+        // newest sample of this output's group of channel_count inputs
+        const std::complex<float>* newest = &work[first_pending + (n + 1) * channel_count - 1];
+        
+        for (int r = 0; r < channel_count; r++) {
+            const float* taps = &prototype[r];
+            const std::complex<float>* x = newest - r;
+            float re = 0.0f;
+            float im = 0.0f;
+            for (int p = 0; p < taps_per_branch; p++) {
+                const std::complex<float> sample = x[-(ptrdiff_t)p * channel_count];
+                re += taps[p * channel_count] * sample.real();
+                im += taps[p * channel_count] * sample.imag();
+            }
+            fft_in[r][0] = re;
+            fft_in[r][1] = im;
+        }
+        
+        fftwf_execute_dft(fft_plan, fft_in, fft_out);
+        
+        for (int k = 0; k < channel_count; k++) {
+            channels[k][n] = std::complex<float>(fft_out[k][0], fft_out[k][1]);
+        }
+    }
+    
+    // keep the filter tail plus the unconsumed remainder for the next block
+    size_t consumed = first_pending + outputs * channel_count;
+    history.assign(work.begin() + (consumed - history_len), work.end());
+    return true;
+}
+
+double PolyphaseChannelizer::channel_offset(int channel, double sample_rate) const {
+    int signed_channel = channel < channel_count / 2 ? channel : channel - channel_count;
+    return signed_channel * sample_rate / channel_count;
+}
+
+int PolyphaseChannelizer::channel_for_offset(double offset_hz, double sample_rate) const {
+    long channel = std::lround(offset_hz * channel_count / sample_rate);
+    channel %= channel_count;
+    if (channel < 0) channel += channel_count;
+    return (int)channel;
+}
@@ -0,0 +1,56 @@
+#ifndef CHANNELIZER_H
+#define CHANNELIZER_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <fftw3.h>
+
+// critically sampled polyphase filterbank. splits a wideband stream into
+// channel_count channels spaced fs / channel_count apart, each decimated by
+// channel_count, in one pass: a branch fir per input phase followed by one
+// small inverse fft per output sample. channel k sits at k * fs / channel_count,
+// channels past the middle wrap around to negative offsets like fft bins.
+class PolyphaseChannelizer {
+private:
+    int channel_count;
+    int taps_per_branch;
+    
+    std::vector<float> prototype;                  // channel_count * taps_per_branch taps
+    std::vector<std::complex<float>> history;      // last input samples, newest at the end
+    size_t history_len;
+    
+    fftwf_complex* fft_in;
+    fftwf_complex* fft_out;
+    fftwf_plan fft_plan;
+    
+    std::vector<std::complex<float>> work;         // history followed by the new block
+    
+    void design_prototype();
+    void cleanup();
+    
+public:
+    explicit PolyphaseChannelizer(int channel_count = 16, int taps_per_branch = 12);
+    ~PolyphaseChannelizer();
+    
+    bool initialize();
+    int get_channel_count() const { return channel_count; }
+    // input samples between a signal entering and showing up in the channels
+    int get_group_delay() const { return (channel_count * taps_per_branch - 1) / 2; }
+    
+    // forget the filter state, call when the input stream is not contiguous
+    // anymore (dropped block, retune)
+    void reset();
+    
+    // filter iq_data into channels[k], one output per channel_count inputs.
+    // input that doesn't fill a whole output is kept for the next call.
+    bool process(const std::vector<std::complex<float>>& iq_data,
+                 std::vector<std::vector<std::complex<float>>>& channels);
+                 
+    // offset of channel k from the tuned frequency
+    double channel_offset(int channel, double sample_rate) const;
+    // channel closest to offset_hz from the tuned frequency
+    int channel_for_offset(double offset_hz, double sample_rate) const;
+};
+
+#endif // CHANNELIZER_H
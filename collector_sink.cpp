@@ -0,0 +1,428 @@
+#include "collector_sink.h"
+#include "protocol_analyzer.h"
+#include "pipeline.h"
+#include "async_log.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+
+static const size_t BATCH_HEADER_BYTES = 40;
+static const size_t RECORD_HEADER_BYTES = 4;
+static const size_t DETECTION_BODY_BYTES = 42;
+static const size_t DEVICE_BODY_BYTES = 41;
+static const size_t SPECTRUM_HEADER_BYTES = 27;
+
+static const uint8_t RECORD_DETECTION = 1;
+static const uint8_t RECORD_DEVICE = 2;
+static const uint8_t RECORD_SPECTRUM = 3;
+
+static const uint8_t DETECTION_BURST = 1;
+static const uint8_t DEVICE_AUTHORIZED = 1;
+static const uint8_t DEVICE_SUSPICIOUS = 2;
+
+// explicit little endian, the struct layout of whatever compiled the
+// sensor never reaches the wire
+static void put_u8(std::vector<uint8_t>& out, uint8_t value) {
+    out.push_back(value);
+}
+
+static void put_u16(std::vector<uint8_t>& out, uint16_t value) {
+    for (int i = 0; i < 2; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static void put_f32(std::vector<uint8_t>& out, double value) {
+    float narrow = (float)value;
+    uint32_t bits;
+    std::memcpy(&bits, &narrow, sizeof(bits));
+    put_u32(out, bits);
+}
+
+static void put_f64(std::vector<uint8_t>& out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u64(out, bits);
+}
+
+// patch a field of the batch header once the records are in
+static void set_u16(std::vector<uint8_t>& out, size_t offset, uint16_t value) {
+    for (int i = 0; i < 2; i++) out[offset + i] = (uint8_t)(value >> (8 * i));
+}
+
+static void set_u32(std::vector<uint8_t>& out, size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[offset + i] = (uint8_t)(value >> (8 * i));
+}
+
+static int64_t wall_ms_now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// wall time of a steady clock time point, through the current offset between the two
+static int64_t to_wall_ms(std::chrono::steady_clock::time_point time, int64_t now_ms,
+                          std::chrono::steady_clock::time_point now) {
+    return now_ms - std::chrono::duration_cast<std::chrono::milliseconds>(now - time).count();
+}
+
+CollectorSink::CollectorSink() : use_tcp(false), address_len(0), socket_fd(-1),
+                                 analyzer(nullptr), spectrum_interval_ms(0),
+                                 queue(QUEUE_CAPACITY), queue_head(0), queue_count(0), running(false),
+                                 batch_records(0), batch_sequence(0), device_epoch(0),
+                                 reconnect_delay_s(1), records_sent(0), records_dropped(0),
+                                 batches_sent(0), connects(0), connected(false) {
+    std::memset(&address, 0, sizeof(address));
+    std::memset(site, 0, sizeof(site));
+}
+
+CollectorSink::~CollectorSink() {
+    stop();
+    disconnect();
+}
+
+bool CollectorSink::open(const std::string& url, const std::string& site_name) {
+    std::string host_port;
+    if (url.compare(0, 6, "udp://") == 0) {
+        use_tcp = false;
+        host_port = url.substr(6);
+    } else if (url.compare(0, 6, "tcp://") == 0) {
+        use_tcp = true;
+        host_port = url.substr(6);
+    } else {
+        std::cerr << "Collector must be udp://host:port or tcp://host:port, got " << url << std::endl;
+        return false;
+    }
+    
+    size_t colon = host_port.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == host_port.size()) {
+        std::cerr << "Collector must be udp://host:port or tcp://host:port, got " << url << std::endl;
+        return false;
+    }
+    std::string host = host_port.substr(0, colon);
+    std::string port = host_port.substr(colon + 1);
+    
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = use_tcp ? SOCK_STREAM : SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+        std::cerr << "Failed to resolve " << host_port << "!" << std::endl;
+        return false;
+    }
+    std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+    address_len = result->ai_addrlen;
+    freeaddrinfo(result);
+    
+    // udp needs no connection, tcp connects from the sender thread so a
+    // collector that is down at startup doesn't hold the sensor up
+    if (!use_tcp) {
+        socket_fd = socket(address.ss_family, SOCK_DGRAM, 0);
+        if (socket_fd < 0) {
+            std::cerr << "Failed to create UDP socket!" << std::endl;
+            return false;
+        }
+        connected = true;
+    }
+    
+    destination = url;
+    // zero padded, not terminated at full length
+    std::memcpy(site, site_name.data(), std::min(site_name.size(), SITE_LENGTH));
+    batch.reserve(batch_capacity());
+    sending.reserve(QUEUE_CAPACITY);
+    
+    running = true;
+    sender = std::thread(&CollectorSink::send_loop, this);
+    return true;
+}
+
+void CollectorSink::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!running) return;
+        running = false;
+    }
+    wake.notify_one();
+    if (sender.joinable()) sender.join();
+}
+
+void CollectorSink::add_spectrum_source(const Pipeline* pipeline) {
+    SpectrumSource source;
+    source.pipeline = pipeline;
+    source.last_sequence = 0;
+    spectrum_sources.push_back(source);
+}
+
+void CollectorSink::emit(const Detection& detection, const std::string&) {
+    // wake the sender early once a full batch is waiting
+    static const size_t WAKE_COUNT = UDP_BATCH_BYTES / (RECORD_HEADER_BYTES + DETECTION_BODY_BYTES);
+    
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (queue_count == queue.size()) {
+        queue_head = (queue_head + 1) % queue.size();
+        queue_count--;
+        records_dropped++;
+    }
+    QueuedDetection& queued = queue[(queue_head + queue_count) % queue.size()];
+    queued.detection = detection;
+    queued.time_ms = wall_ms_now();
+    queue_count++;
+    if (queue_count == WAKE_COUNT) wake.notify_one();
+}
+
+void CollectorSink::send_loop() {
+    auto next_devices = std::chrono::steady_clock::now();
+    auto next_spectrum = next_devices;
+    bool stopping = false;
+    
+    while (!stopping) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            wake.wait_for(lock, std::chrono::milliseconds(BATCH_INTERVAL_MS), [this] {
+                return !running ||
+                       (connected && queue_count * (RECORD_HEADER_BYTES + DETECTION_BODY_BYTES) >= UDP_BATCH_BYTES);
+            });
+            stopping = !running;
+        }
+        // while there is no connection the detections wait in the queue,
+        // which drops the oldest once it is full
+        if (!ensure_connected()) continue;
+        
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            sending.clear();
+            for (size_t i = 0; i < queue_count; i++) {
+                sending.push_back(queue[(queue_head + i) % queue.size()]);
+            }
+            queue_head = 0;
+            queue_count = 0;
+        }
+        for (const QueuedDetection& queued : sending) add_detection(queued);
+        
+        auto now = std::chrono::steady_clock::now();
+        if (analyzer && (now >= next_devices || stopping)) {
+            add_devices();
+            next_devices = now + std::chrono::milliseconds(DEVICE_INTERVAL_MS);
+        }
+        if (spectrum_interval_ms > 0 && now >= next_spectrum) {
+            add_spectra();
+            next_spectrum = now + std::chrono::milliseconds(spectrum_interval_ms);
+        }
+        flush_batch();
+    }
+}
+
+bool CollectorSink::ensure_connected() {
+    if (socket_fd >= 0) return true;
+    auto now = std::chrono::steady_clock::now();
+    if (now < next_connect) return false;
+    
+    // non-blocking connect, a host that doesn't answer would otherwise hold
+    // the sender for the kernel's syn timeout
+    int fd = socket(address.ss_family, SOCK_STREAM, 0);
+    bool ok = fd >= 0;
+    if (ok) {
+        int fl = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+        int result = connect(fd, reinterpret_cast<const sockaddr*>(&address), address_len);
+        if (result != 0 && errno == EINPROGRESS) {
+            pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            result = -1;
+            if (poll(&pfd, 1, CONNECT_TIMEOUT_MS) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0) {
+                result = 0;
+            }
+        }
+        ok = result == 0;
+        if (ok) {
+            fcntl(fd, F_SETFL, fl);
+            timeval timeout;
+            timeout.tv_sec = SEND_TIMEOUT_MS / 1000;
+            timeout.tv_usec = (SEND_TIMEOUT_MS % 1000) * 1000;
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        }
+    }
+    
+    if (!ok) {
+        if (fd >= 0) close(fd);
+        log_printf("Collector %s unreachable, retrying in %d s", destination.c_str(), reconnect_delay_s);
+        next_connect = now + std::chrono::seconds(reconnect_delay_s);
+        reconnect_delay_s = std::min(reconnect_delay_s * 2, MAX_RECONNECT_S);
+        return false;
+    }
+    
+    socket_fd = fd;
+    reconnect_delay_s = 1;
+    connects++;
+    connected = true;
+    // a new connection starts with a full picture of the devices
+    sent_devices.clear();
+    device_epoch = 0;
+    log_printf("Collector connected to %s", destination.c_str());
+    return true;
+}
+
+void CollectorSink::disconnect() {
+    if (socket_fd >= 0) close(socket_fd);
+    socket_fd = -1;
+    connected = false;
+}
+
+void CollectorSink::begin_record(uint8_t type, uint8_t flags, size_t body_bytes) {
+    if (batch.size() + RECORD_HEADER_BYTES + body_bytes > batch_capacity() || batch_records == UINT16_MAX) {
+        flush_batch();
+    }
+    if (batch.empty()) {
+        put_u32(batch, WIRE_MAGIC);
+        put_u16(batch, WIRE_VERSION);
+        put_u16(batch, 0);                  // record count, set in flush_batch
+        put_u32(batch, batch_sequence);
+        put_u32(batch, 0);                  // record bytes, set in flush_batch
+        put_u64(batch, 0);                  // sent time, set in flush_batch
+        batch.insert(batch.end(), site, site + SITE_LENGTH);
+    }
+    put_u8(batch, type);
+    put_u8(batch, flags);
+    put_u16(batch, (uint16_t)body_bytes);
+    batch_records++;
+}
+
+void CollectorSink::add_detection(const QueuedDetection& queued) {
+    const SignalCharacteristics& signal = queued.detection.signal;
+    begin_record(RECORD_DETECTION, signal.is_burst ? DETECTION_BURST : 0, DETECTION_BODY_BYTES);
+    put_u64(batch, (uint64_t)queued.time_ms);
+    put_f64(batch, signal.frequency);
+    put_f32(batch, signal.power_db);
+    put_f32(batch, signal.snr_db);
+    put_f32(batch, signal.bandwidth);
+    put_f32(batch, signal.symbol_rate);
+    put_f32(batch, signal.burst_duration);
+    put_u8(batch, (uint8_t)queued.detection.protocol);
+    put_u8(batch, (uint8_t)signal.modulation);
+    put_u32(batch, queued.detection.signature);
+}
+
+void CollectorSink::add_devices() {
+    // the lock-free snapshot, the analyzer never waits for the exporter
+    DeviceSnapshotPtr snapshot = analyzer->get_device_snapshot();
+    if (!snapshot || snapshot->epoch == device_epoch) return;
+    device_epoch = snapshot->epoch;
+    
+    int64_t now_ms = wall_ms_now();
+    auto now = std::chrono::steady_clock::now();
+    // rebuilt from the snapshot every time, expired devices fall out. the
+    // unchanged ones go straight back, the others once their batch went out
+    std::unordered_map<DeviceKey, SentDevice> previous;
+    previous.swap(sent_devices);
+    sent_devices.reserve(snapshot->devices.size());
+    for (const DetectedDevice& device : snapshot->devices) {
+        SentDevice sent;
+        sent.packet_count = device.packet_count;
+        sent.flags = (device.is_authorized ? DEVICE_AUTHORIZED : 0) | (device.is_suspicious ? DEVICE_SUSPICIOUS : 0);
+        
+        auto last = previous.find(device.device_key);
+        if (last != previous.end() && last->second.packet_count == sent.packet_count &&
+            last->second.flags == sent.flags) {
+            sent_devices[device.device_key] = sent;
+            continue;
+        }
+        begin_record(RECORD_DEVICE, sent.flags, DEVICE_BODY_BYTES);
+        put_u64(batch, device.device_key);
+        put_u64(batch, (uint64_t)to_wall_ms(device.first_seen, now_ms, now));
+        put_u64(batch, (uint64_t)to_wall_ms(device.last_seen, now_ms, now));
+        put_f64(batch, device.signal.frequency);
+        put_f32(batch, device.signal.power_db);
+        put_u32(batch, (uint32_t)device.packet_count);
+        put_u8(batch, (uint8_t)device.protocol);
+        batch_devices.emplace_back(device.device_key, sent);
+    }
+}
+
+void CollectorSink::add_spectra() {
+    int64_t now_ms = wall_ms_now();
+    auto now = std::chrono::steady_clock::now();
+    for (size_t tuner = 0; tuner < spectrum_sources.size(); tuner++) {
+        SpectrumSource& source = spectrum_sources[tuner];
+        SpectrumFramePtr frame = source.pipeline->get_latest_spectrum();
+        if (!frame || frame->power_db.empty() || frame->sequence == source.last_sequence) continue;
+        source.last_sequence = frame->sequence;
+        
+        size_t fft_bins = frame->power_db.size();
+        size_t bins = std::min(SPECTRUM_BINS, fft_bins);
+        begin_record(RECORD_SPECTRUM, 0, SPECTRUM_HEADER_BYTES + 2 * bins);
+        put_u8(batch, (uint8_t)tuner);
+        put_u64(batch, frame->sequence);
+        put_u64(batch, (uint64_t)to_wall_ms(frame->capture_time, now_ms, now));
+        put_u32(batch, frame->center_freq);
+        put_u32(batch, frame->sample_rate);
+        put_u16(batch, (uint16_t)bins);
+        // max, not mean, so a narrow burst survives the decimation
+        for (size_t i = 0; i < bins; i++) {
+            size_t begin = i * fft_bins / bins;
+            size_t end = (i + 1) * fft_bins / bins;
+            float loudest = *std::max_element(frame->power_db.begin() + begin, frame->power_db.begin() + end);
+            float centi_db = std::max(-32768.0f, std::min(32767.0f, std::round(loudest * 100.0f)));
+            put_u16(batch, (uint16_t)(int16_t)centi_db);
+        }
+    }
+}
+
+bool CollectorSink::flush_batch() {
+    if (batch.empty()) return true;
+    set_u16(batch, 6, batch_records);
+    set_u32(batch, 12, (uint32_t)(batch.size() - BATCH_HEADER_BYTES));
+    int64_t sent_ms = wall_ms_now();
+    for (int i = 0; i < 8; i++) batch[16 + i] = (uint8_t)((uint64_t)sent_ms >> (8 * i));
+    
+    bool ok = socket_fd >= 0;
+    if (ok && use_tcp) {
+        // blocking with SO_SNDTIMEO, a collector that stops reading breaks
+        // the connection instead of stalling the sender forever
+        size_t offset = 0;
+        while (ok && offset < batch.size()) {
+            ssize_t written = send(socket_fd, batch.data() + offset, batch.size() - offset, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) continue;
+            ok = written > 0;
+            if (ok) offset += written;
+        }
+        if (!ok) {
+            log_printf("Collector %s connection lost", destination.c_str());
+            disconnect();
+        }
+    } else if (ok) {
+        // a full socket buffer drops the batch rather than waiting
+        ok = sendto(socket_fd, batch.data(), batch.size(), MSG_DONTWAIT,
+                    reinterpret_cast<const sockaddr*>(&address), address_len) == (ssize_t)batch.size();
+    }
+    
+    if (ok) {
+        records_sent += batch_records;
+        batches_sent++;
+        for (const auto& device : batch_devices) sent_devices[device.first] = device.second;
+    } else {
+        records_dropped += batch_records;
+        // the devices in it go out again with the next device update
+        if (!batch_devices.empty()) device_epoch = 0;
+    }
+    batch_sequence++;
+    batch.clear();
+    batch_records = 0;
+    batch_devices.clear();
+    return ok;
+}
@@ -0,0 +1,146 @@
+#ifndef COLLECTOR_SINK_H
+#define COLLECTOR_SINK_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sys/socket.h>
+#include "detection_sink.h"
+
+class ProtocolAnalyzer;
+class Pipeline;
+
+// streams detections, device updates and optionally decimated spectra to a
+// central collector. emit() only copies the detection into a bounded queue,
+// everything else happens on the sink's own sender thread: batching,
+// encoding, reading the device snapshot and the spectrum, and the network.
+// a slow or absent collector fills the queue and the oldest detections are
+// dropped and counted, a pipeline never waits for the network.
+//
+// wire format, little endian. every batch is one datagram over udp and
+// self delimiting over tcp:
+//   batch    magic u32 "RFSX", version u16, record count u16, sequence u32
+//            (gaps are lost batches), record bytes u32, sent time_ms i64,
+//            site char[16] zero padded
+//   record   type u8, flags u8, body bytes u16, body
+//   detection (1)  time_ms i64, frequency_hz f64, power_db f32, snr_db f32,
+//                  bandwidth_hz f32, symbol_rate f32, burst_duration_s f32,
+//                  protocol u8, modulation u8, signature u32 (the
+//                  matched signature's id). flags bit 0: burst
+//   device (2)     device_key u64 (signature id << 40 | frequency hz),
+//                  first_seen_ms i64, last_seen_ms i64,
+//                  frequency_hz f64, power_db f32, packet_count u32,
+//                  protocol u8. flags bit 0: authorized, bit 1: suspicious
+//   spectrum (3)   tuner u8, sequence u64, time_ms i64, center_hz u32,
+//                  sample_rate u32, bin count u16, bins i16 in 0.01 dB,
+//                  each the loudest of the fft bins it covers
+class CollectorSink : public DetectionSink {
+public:
+    static const uint32_t WIRE_MAGIC = 0x58534652;     // "RFSX"
+    static const uint16_t WIRE_VERSION = 2;
+    static const size_t SITE_LENGTH = 16;
+    static const size_t QUEUE_CAPACITY = 8192;         // detections held while the collector is slow or away
+    static const size_t UDP_BATCH_BYTES = 1400;        // below a typical path mtu
+    static const size_t TCP_BATCH_BYTES = 65536;
+    static const int BATCH_INTERVAL_MS = 100;
+    static const int DEVICE_INTERVAL_MS = 5000;
+    static const size_t SPECTRUM_BINS = 256;
+    static const int CONNECT_TIMEOUT_MS = 2000;
+    static const int SEND_TIMEOUT_MS = 2000;
+    static const int MAX_RECONNECT_S = 30;
+    
+private:
+    struct QueuedDetection {
+        Detection detection;
+        int64_t time_ms;
+    };
+    
+    // what a device looked like when it was last sent
+    struct SentDevice {
+        int packet_count;
+        uint8_t flags;
+    };
+    
+    struct SpectrumSource {
+        const Pipeline* pipeline;
+        uint64_t last_sequence;
+    };
+    
+    bool use_tcp;
+    std::string destination;
+    sockaddr_storage address;
+    socklen_t address_len;
+    int socket_fd;
+    char site[SITE_LENGTH];
+    
+    const ProtocolAnalyzer* analyzer;
+    std::vector<SpectrumSource> spectrum_sources;
+    int spectrum_interval_ms;
+    
+    // ring of detections, written by the database stages
+    std::mutex queue_mutex;
+    std::condition_variable wake;
+    std::vector<QueuedDetection> queue;
+    size_t queue_head;
+    size_t queue_count;
+    bool running;
+    std::thread sender;
+    
+    // sender thread only
+    std::vector<QueuedDetection> sending;
+    std::vector<uint8_t> batch;
+    uint16_t batch_records;
+    uint32_t batch_sequence;
+    uint64_t device_epoch;
+    std::unordered_map<DeviceKey, SentDevice> sent_devices;
+    std::vector<std::pair<DeviceKey, SentDevice>> batch_devices;   // in batch, sent once it went out
+    std::chrono::steady_clock::time_point next_connect;
+    int reconnect_delay_s;
+    
+    std::atomic<uint64_t> records_sent;
+    std::atomic<uint64_t> records_dropped;
+    std::atomic<uint64_t> batches_sent;
+    std::atomic<uint64_t> connects;
+    std::atomic<bool> connected;
+    
+    void send_loop();
+    bool ensure_connected();
+    void disconnect();
+    void begin_record(uint8_t type, uint8_t flags, size_t body_bytes);
+    void add_detection(const QueuedDetection& queued);
+    void add_devices();
+    void add_spectra();
+    bool flush_batch();
+    size_t batch_capacity() const { return use_tcp ? TCP_BATCH_BYTES : UDP_BATCH_BYTES; }
+    
+public:
+    CollectorSink();
+    ~CollectorSink();
+    
+    // udp://host:port or tcp://host:port. site names this sensor in every
+    // batch, cut to SITE_LENGTH. starts the sender thread.
+    bool open(const std::string& url, const std::string& site_name);
+    void stop();
+    
+    // optional, attach before open(). devices are sent every
+    // DEVICE_INTERVAL_MS when they changed, spectra every interval_ms.
+    void set_device_source(const ProtocolAnalyzer* device_analyzer) { analyzer = device_analyzer; }
+    void add_spectrum_source(const Pipeline* pipeline);
+    void set_spectrum_interval_ms(int interval_ms) { spectrum_interval_ms = interval_ms; }
+    
+    void emit(const Detection& detection, const std::string& protocol_name) override;
+    
+    uint64_t get_records_sent() const { return records_sent; }
+    uint64_t get_records_dropped() const { return records_dropped; }
+    uint64_t get_batches_sent() const { return batches_sent; }
+    uint64_t get_connects() const { return connects; }
+    bool is_connected() const { return connected; }
+};
+
+#endif // COLLECTOR_SINK_H
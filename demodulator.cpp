@@ -0,0 +1,317 @@
+#include "demodulator.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#define DEMOD_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DEMOD_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// atan2 from a 9th order minimax polynomial on [0, 1], max error ~1e-5 rad.
+// the simd kernels evaluate exactly the same thing lane by lane.
+static const float ATAN_C1 = 0.9998660f;
+static const float ATAN_C3 = -0.3302995f;
+static const float ATAN_C5 = 0.1801410f;
+static const float ATAN_C7 = -0.0851330f;
+static const float ATAN_C9 = 0.0208351f;
+static const float HALF_PI = 1.57079633f;
+static const float PI = 3.14159265f;
+
+static float fast_atan2(float y, float x) {
+    float ax = std::fabs(x);
+    float ay = std::fabs(y);
+    float big = std::max(ax, ay);
+    float a = big > 0.0f ? std::min(ax, ay) / big : 0.0f;
+    float s = a * a;
+    float r = (((ATAN_C9 * s + ATAN_C7) * s + ATAN_C5) * s + ATAN_C3) * s * a + ATAN_C1 * a;
+    if (ay > ax) r = HALF_PI - r;
+    if (x < 0.0f) r = PI - r;
+    return y < 0.0f ? -r : r;
+}
+
+#ifdef DEMOD_HAVE_SSE2
+// 4 complex samples into their real and imaginary parts
+static inline void deinterleave4(const float* p, __m128& re, __m128& im) {
+    __m128 lo = _mm_loadu_ps(p);
+    __m128 hi = _mm_loadu_ps(p + 4);
+    re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 atan2_ps(__m128 y, __m128 x) {
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 ax = _mm_andnot_ps(sign_mask, x);
+    __m128 ay = _mm_andnot_ps(sign_mask, y);
+    __m128 big = _mm_max_ps(ax, ay);
+    __m128 small = _mm_min_ps(ax, ay);
+    __m128 nonzero = _mm_cmpgt_ps(big, _mm_setzero_ps());
+    __m128 a = _mm_and_ps(nonzero, _mm_div_ps(small, select_ps(nonzero, big, _mm_set1_ps(1.0f))));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_C9), s), _mm_set1_ps(ATAN_C7));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C5));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C3));
+    r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), _mm_mul_ps(_mm_set1_ps(ATAN_C1), a));
+    r = select_ps(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(HALF_PI), r), r);
+    r = select_ps(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(PI), r), r);
+    return _mm_or_ps(r, _mm_and_ps(sign_mask, y));
+}
+#endif
+
+void envelope_power(const std::complex<float>* in, size_t count, float* out) {
+    const float* src = reinterpret_cast<const float*>(in);
+    size_t i = 0;
+#if defined(DEMOD_HAVE_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 re, im;
+        deinterleave4(src + 2 * i, re, im);
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)));
+    }
+#elif defined(DEMOD_HAVE_NEON)
+    for (; i + 4 <= count; i += 4) {
+        float32x4x2_t v = vld2q_f32(src + 2 * i);
+        vst1q_f32(out + i, vmlaq_f32(vmulq_f32(v.val[0], v.val[0]), v.val[1], v.val[1]));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = std::norm(in[i]);
+    }
+}
+
+void fm_discriminate(const std::complex<float>* in, size_t count, std::complex<float> previous, float* out) {
+    if (count == 0) return;
+    
+    // x[i] * conj(x[i - 1]), the first one against the sample before the segment
+    std::complex<float> first = in[0] * std::conj(previous);
+    out[0] = fast_atan2(first.imag(), first.real());
+    
+    const float* src = reinterpret_cast<const float*>(in);
+    size_t i = 1;
+#if defined(DEMOD_HAVE_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 ar, ai, br, bi;
+        deinterleave4(src + 2 * i, ar, ai);
+        deinterleave4(src + 2 * (i - 1), br, bi);
+        __m128 re = _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        __m128 im = _mm_sub_ps(_mm_mul_ps(ai, br), _mm_mul_ps(ar, bi));
+        _mm_storeu_ps(out + i, atan2_ps(im, re));
+    }
+#elif defined(DEMOD_HAVE_NEON)
+    // products vectorized, the atan2 stays scalar
+    for (; i + 4 <= count; i += 4) {
+        float32x4x2_t a = vld2q_f32(src + 2 * i);
+        float32x4x2_t b = vld2q_f32(src + 2 * (i - 1));
+        float re[4], im[4];
+        vst1q_f32(re, vmlaq_f32(vmulq_f32(a.val[0], b.val[0]), a.val[1], b.val[1]));
+        vst1q_f32(im, vmlsq_f32(vmulq_f32(a.val[1], b.val[0]), a.val[0], b.val[1]));
+        for (int k = 0; k < 4; k++) {
+            out[i + k] = fast_atan2(im[k], re[k]);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        std::complex<float> step = in[i] * std::conj(in[i - 1]);
+        out[i] = fast_atan2(step.imag(), step.real());
+    }
+}
+
+Demodulator::Demodulator() {
+}
+
+float Demodulator::percentile(const std::vector<float>& values, double fraction) {
+    scratch.assign(values.begin(), values.end());
+    size_t index = std::min(scratch.size() - 1, (size_t)(fraction * scratch.size()));
+    std::nth_element(scratch.begin(), scratch.begin() + index, scratch.end());
+    return scratch[index];
+}
+
+void Demodulator::collect_runs(const std::vector<uint8_t>& states) {
+    runs.clear();
+    if (states.empty()) return;
+    
+    // glitches shorter than MIN_RUN are folded into the run they interrupt
+    bool first_run = true;
+    uint8_t level = states[0];
+    uint32_t length = 0;
+    for (size_t i = 0; i < states.size(); i++) {
+        if (states[i] == level) {
+            length++;
+            continue;
+        }
+        size_t glitch = i;
+        while (glitch < states.size() && glitch - i < MIN_RUN && states[glitch] != level) glitch++;
+        if (glitch - i < MIN_RUN && glitch < states.size()) {
+            length += (uint32_t)(glitch - i);
+            i = glitch - 1;
+            continue;
+        }
+        
+        if (!first_run) runs.push_back(length);
+        first_run = false;
+        level = states[i];
+        length = 1;
+    }
+}
+
+double Demodulator::estimate_symbol_period(double& confidence, int& symbols) {
+    confidence = 0.0;
+    symbols = 0;
+    if (runs.size() < 2) return 0.0;
+    
+    // histogram of pulse widths: sort them and split into clusters wherever
+    // neighbours are more than CLUSTER_RATIO apart. the symbol period is the
+    // shortest cluster that is well populated, pwm long pulses and repeated
+    // symbols are multiples of it.
+    std::vector<uint32_t>& sorted = sorted_runs;
+    sorted.assign(runs.begin(), runs.end());
+    std::sort(sorted.begin(), sorted.end());
+    
+    const size_t min_population = std::max<size_t>(2, sorted.size() / 7);
+    double base = 0.0;
+    size_t cluster_start = 0;
+    for (size_t i = 1; i <= sorted.size(); i++) {
+        if (i < sorted.size() && sorted[i] <= sorted[i - 1] * CLUSTER_RATIO) continue;
+        if (i - cluster_start >= min_population) {
+            double sum = 0.0;
+            for (size_t k = cluster_start; k < i; k++) sum += sorted[k];
+            base = sum / (i - cluster_start);
+            break;
+        }
+        cluster_start = i;
+    }
+    if (base <= 0.0) return 0.0;
+    
+    // refine over every pulse that lands near a whole number of periods
+    double length_sum = 0.0;
+    long unit_sum = 0;
+    size_t on_grid = 0;
+    for (uint32_t run : runs) {
+        long units = std::lround(run / base);
+        if (units < 1) continue;
+        if (std::fabs(run - units * base) <= 0.25 * base) {
+            length_sum += run;
+            unit_sum += units;
+            on_grid++;
+        }
+    }
+    if (unit_sum == 0) return 0.0;
+    
+    confidence = (double)on_grid / runs.size();
+    symbols = (int)unit_sum;
+    return length_sum / unit_sum;
+}
+
+DemodResult Demodulator::demodulate(const std::complex<float>* samples, size_t count, double sample_rate) {
+    DemodResult result;
+    result.valid = false;
+    result.modulation = Modulation::UNKNOWN;
+    result.symbol_rate = 0.0;
+    result.modulation_depth_db = 0.0;
+    result.fsk_deviation = 0.0;
+    result.timing_confidence = 0.0;
+    result.symbols = 0;
+    result.spreading_factor = 0;
+    
+    if (count < MIN_SAMPLES || sample_rate <= 0) return result;
+    count = std::min(count, MAX_SAMPLES);
+    result.valid = true;
+    
+    // OOK: is there a clear high and low level, and how long does each last
+    envelope.resize(count);
+    envelope_power(samples, count, envelope.data());
+    
+    // a short boxcar keeps rayleigh noise from spanning the ook depth on its own
+    float window_sum = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        float power = envelope[i];
+        window_sum += power;
+        if (i >= ENVELOPE_SMOOTH) window_sum -= smoothing[i % ENVELOPE_SMOOTH];
+        smoothing[i % ENVELOPE_SMOOTH] = power;
+        envelope[i] = window_sum / std::min<size_t>(i + 1, ENVELOPE_SMOOTH);
+    }
+    float low = percentile(envelope, 0.05);
+    float high = percentile(envelope, 0.95);
+    result.modulation_depth_db = 10.0 * std::log10((high + 1e-20f) / (low + 1e-20f));
+    const float on_threshold = std::sqrt(high * low);
+    
+    levels.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        levels[i] = envelope[i] > on_threshold;
+    }
+    
+    if (result.modulation_depth_db >= OOK_MIN_DEPTH_DB) {
+        collect_runs(levels);
+        if (runs.size() >= 3) {
+            result.modulation = Modulation::OOK;
+            double period = estimate_symbol_period(result.timing_confidence, result.symbols);
+            result.symbol_rate = period > 0 ? sample_rate / period : 0.0;
+            return result;
+        }
+    }
+    
+    // FSK: two clusters in the instantaneous frequency while the carrier is on
+    discriminator.resize(count);
+    fm_discriminate(samples + 1, count - 1, samples[0], discriminator.data() + 1);
+    discriminator[0] = discriminator.size() > 1 ? discriminator[1] : 0.0f;
+    
+    on_frequency.clear();
+    for (size_t i = 0; i < count; i++) {
+        if (levels[i] || result.modulation_depth_db < OOK_MIN_DEPTH_DB) {
+            on_frequency.push_back(discriminator[i]);
+        }
+    }
+    if (on_frequency.size() < MIN_SAMPLES) return result;
+    
+    // two means, seeded from the quartiles
+    float low_mean = percentile(on_frequency, 0.25);
+    float high_mean = percentile(on_frequency, 0.75);
+    double low_spread = 0.0, high_spread = 0.0;
+    size_t low_count = 0, high_count = 0;
+    for (int iteration = 0; iteration < 4; iteration++) {
+        float middle = 0.5f * (low_mean + high_mean);
+        double low_sum = 0.0, high_sum = 0.0, low_sq = 0.0, high_sq = 0.0;
+        low_count = high_count = 0;
+        for (float f : on_frequency) {
+            if (f < middle) {
+                low_sum += f;
+                low_sq += f * f;
+                low_count++;
+            } else {
+                high_sum += f;
+                high_sq += f * f;
+                high_count++;
+            }
+        }
+        if (low_count == 0 || high_count == 0) return result;
+        low_mean = (float)(low_sum / low_count);
+        high_mean = (float)(high_sum / high_count);
+        low_spread = std::sqrt(std::max(0.0, low_sq / low_count - (double)low_mean * low_mean));
+        high_spread = std::sqrt(std::max(0.0, high_sq / high_count - (double)high_mean * high_mean));
+    }
+    
+    double separation = (high_mean - low_mean) / (low_spread + high_spread + 1e-9);
+    double smaller_share = (double)std::min(low_count, high_count) / on_frequency.size();
+    if (separation < FSK_MIN_SEPARATION || smaller_share < 0.1) return result;
+    
+    result.modulation = Modulation::FSK;
+    result.fsk_deviation = 0.5 * (high_mean - low_mean) * sample_rate / (2.0 * M_PI);
+    
+    const float middle = 0.5f * (low_mean + high_mean);
+    // the envelope levels are done with, reuse them for the tones
+    levels.resize(on_frequency.size());
+    for (size_t i = 0; i < on_frequency.size(); i++) {
+        levels[i] = on_frequency[i] > middle;
+    }
+    collect_runs(levels);
+    double period = estimate_symbol_period(result.timing_confidence, result.symbols);
+    result.symbol_rate = period > 0 ? sample_rate / period : 0.0;
+    return result;
+}
@@ -0,0 +1,63 @@
+#ifndef DEMODULATOR_H
+#define DEMODULATOR_H
+
+#include <vector>
+#include <complex>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "protocol_types.h"
+
+// what the demodulator could tell about one burst segment
+struct DemodResult {
+    bool valid;
+    Modulation modulation;         // ook or fsk here, lora css from the chirp detector, unknown if undecided
+    double symbol_rate;            // symbols per second, 0 if no timing was found (lora: bit rate)
+    double modulation_depth_db;    // envelope high vs low level
+    double fsk_deviation;          // hz, half the spacing of the two tones
+    double timing_confidence;      // share of pulses that sit on a multiple of the symbol period
+    int symbols;
+    int spreading_factor;          // set when the chirp detector found a lora preamble, else 0
+};
+
+// envelope and quadrature discriminator kernels, sse2 or neon where available
+void envelope_power(const std::complex<float>* in, size_t count, float* out);
+// out[i] = arg(in[i] * conj(in[i - 1])) in radians per sample, in[-1] is previous
+void fm_discriminate(const std::complex<float>* in, size_t count, std::complex<float> previous, float* out);
+
+// decides between ook and fsk on one burst segment and measures the symbol
+// rate from the pulse widths. meant to be fed only the samples of a detected
+// burst from a narrow channel, keeps its buffers between calls so one
+// instance must stay on one thread and stops allocating once they are big
+// enough for the longest burst.
+class Demodulator {
+private:
+    static const size_t MIN_SAMPLES = 32;
+    static const size_t MAX_SAMPLES = 65536;           // longer segments are cut
+    static const uint32_t MIN_RUN = 2;                 // shorter runs are glitches
+    static const size_t ENVELOPE_SMOOTH = 4;          // samples, well under a 10 kbps symbol at 128 kHz
+    static constexpr double OOK_MIN_DEPTH_DB = 10.0;
+    static constexpr double FSK_MIN_SEPARATION = 2.0;  // tone spacing over summed spread
+    static constexpr double CLUSTER_RATIO = 1.25;      // pulse widths further apart start a new cluster
+    
+    std::vector<float> envelope;
+    float smoothing[ENVELOPE_SMOOTH];
+    std::vector<float> discriminator;
+    std::vector<float> scratch;
+    std::vector<uint32_t> runs;
+    std::vector<uint32_t> sorted_runs;
+    std::vector<float> on_frequency;
+    std::vector<uint8_t> levels;       // envelope or tone per sample
+    
+    float percentile(const std::vector<float>& values, double fraction);
+    // run lengths of a thresholded sequence, the partial runs at both ends are dropped
+    void collect_runs(const std::vector<uint8_t>& states);
+    double estimate_symbol_period(double& confidence, int& symbols);
+    
+public:
+    Demodulator();
+    
+    DemodResult demodulate(const std::complex<float>* samples, size_t count, double sample_rate);
+};
+
+#endif // DEMODULATOR_H
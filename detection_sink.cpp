@@ -0,0 +1,143 @@
+#include "detection_sink.h"
+#include "async_log.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <unistd.h>
+
+// protocol names are our own strings, only quotes and backslashes could
+// ever need escaping. out must have room for the terminator.
+static size_t write_json_string(char* out, size_t capacity, const char* value) {
+    size_t len = 0;
+    if (len + 1 < capacity) out[len++] = '"';
+    for (const char* c = value; *c && len + 2 < capacity; c++) {
+        if (*c == '"' || *c == '\\') out[len++] = '\\';
+        out[len++] = *c;
+    }
+    if (len + 1 < capacity) out[len++] = '"';
+    out[len] = '\0';
+    return len;
+}
+
+// snprintf returns what it wanted to write, clamp to what it did
+static size_t clamp_written(int written, size_t capacity) {
+    if (written < 0) return 0;
+    return (size_t)written < capacity ? (size_t)written : capacity - 1;
+}
+
+size_t format_detection_json(const Detection& detection, const std::string& protocol_name,
+                             char* out, size_t capacity) {
+    if (capacity == 0) return 0;
+    const SignalCharacteristics& signal = detection.signal;
+    // steady clock times mean nothing outside the process, stamp with wall time
+    long long unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+        
+    size_t len = clamp_written(snprintf(out, capacity, "{\"time_ms\":%lld,\"protocol\":", unix_ms), capacity);
+    len += write_json_string(out + len, capacity - len, protocol_name.c_str());
+    len += clamp_written(snprintf(out + len, capacity - len,
+                                  ",\"frequency_hz\":%.1f,\"power_db\":%.1f,\"snr_db\":%.1f"
+                                  ",\"bandwidth_hz\":%.1f,\"modulation\":\"%s\",\"symbol_rate\":%.1f"
+                                  ",\"burst\":%s,\"burst_duration_s\":%.6f}",
+                                  signal.frequency, signal.power_db, signal.snr_db, signal.bandwidth,
+                                  modulation_name(signal.modulation), signal.symbol_rate,
+                                  signal.is_burst ? "true" : "false", signal.burst_duration),
+                         capacity - len);
+    return len;
+}
+
+size_t format_detection_text(const Detection& detection, const std::string& protocol_name,
+                             char* out, size_t capacity) {
+    if (capacity == 0) return 0;
+    return clamp_written(snprintf(out, capacity, "Detected: %s at %g MHz, %.1f dB", protocol_name.c_str(),
+                                  detection.signal.frequency / 1e6, detection.signal.power_db),
+                         capacity);
+}
+
+LineSink::LineSink(SinkFormat format) : format(format), out(&std::cout) {
+}
+
+bool LineSink::open(const std::string& path) {
+    if (path == "-") {
+        out = &std::cout;
+        return true;
+    }
+    
+    file.reset(new std::ofstream(path, std::ios::app));
+    if (!file->is_open()) {
+        std::cerr << "Failed to open detection log " << path << "!" << std::endl;
+        file.reset();
+        return false;
+    }
+    out = file.get();
+    return true;
+}
+
+void LineSink::emit(const Detection& detection, const std::string& protocol_name) {
+    char line[MAX_DETECTION_LINE];
+    if (format == SinkFormat::JSON) {
+        format_detection_json(detection, protocol_name, line, sizeof(line));
+    } else {
+        format_detection_text(detection, protocol_name, line, sizeof(line));
+    }
+    // the console can stall, only files are written from the database stage
+    if (out == &std::cout) {
+        AsyncLog::instance().write(line);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(write_mutex);
+    *out << line << std::endl;
+}
+
+UdpSink::UdpSink() : socket_fd(-1), address_len(0) {
+    std::memset(&address, 0, sizeof(address));
+}
+
+UdpSink::~UdpSink() {
+    if (socket_fd >= 0) close(socket_fd);
+}
+
+bool UdpSink::open(const std::string& host_port) {
+    size_t colon = host_port.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == host_port.size()) {
+        std::cerr << "UDP destination must be host:port, got " << host_port << std::endl;
+        return false;
+    }
+    std::string host = host_port.substr(0, colon);
+    std::string port = host_port.substr(colon + 1);
+    
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+        std::cerr << "Failed to resolve " << host_port << "!" << std::endl;
+        return false;
+    }
+    
+    socket_fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (socket_fd >= 0) {
+        std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+        address_len = result->ai_addrlen;
+    }
+    freeaddrinfo(result);
+    
+    if (socket_fd < 0) {
+        std::cerr << "Failed to create UDP socket!" << std::endl;
+        return false;
+    }
+    destination = host_port;
+    return true;
+}
+
+void UdpSink::emit(const Detection& detection, const std::string& protocol_name) {
+    if (socket_fd < 0) return;
+    // one sendto per datagram is atomic, no lock needed. a full socket buffer
+    // drops the detection rather than stalling the database stage.
+    char message[MAX_DETECTION_LINE];
+    size_t len = format_detection_json(detection, protocol_name, message, sizeof(message));
+    sendto(socket_fd, message, len, MSG_DONTWAIT,
+           reinterpret_cast<const sockaddr*>(&address), address_len);
+}
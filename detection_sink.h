@@ -0,0 +1,70 @@
+#ifndef DETECTION_SINK_H
+#define DETECTION_SINK_H
+
+#include <string>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sys/socket.h>
+#include "protocol_types.h"
+
+// where the analyzer reports classified signals besides the device database.
+// emit() is called from every pipeline's database stage, so sinks serialize
+// themselves and must not block for long.
+class DetectionSink {
+public:
+    virtual ~DetectionSink() {}
+    virtual void emit(const Detection& detection, const std::string& protocol_name) = 0;
+};
+
+enum class SinkFormat {
+    TEXT,      // same line the analyzer logs to the console
+    JSON       // one object per line
+};
+
+// longest line the formatters write, with room to spare
+static const size_t MAX_DETECTION_LINE = 512;
+
+// write into out without touching the heap and return the length, cut short
+// (but terminated) if capacity is too small. json is one object, neither
+// writes a trailing newline.
+size_t format_detection_json(const Detection& detection, const std::string& protocol_name,
+                             char* out, size_t capacity);
+size_t format_detection_text(const Detection& detection, const std::string& protocol_name,
+                             char* out, size_t capacity);
+
+// lines to stdout through the AsyncLog or to a log file, flushed after every detection
+class LineSink : public DetectionSink {
+private:
+    SinkFormat format;
+    std::ostream* out;
+    std::unique_ptr<std::ofstream> file;
+    std::mutex write_mutex;
+    
+public:
+    explicit LineSink(SinkFormat format = SinkFormat::TEXT);
+    
+    // "-" is stdout, anything else a file that is appended to
+    bool open(const std::string& path);
+    void set_format(SinkFormat new_format) { format = new_format; }
+    void emit(const Detection& detection, const std::string& protocol_name) override;
+};
+
+// one json datagram per detection, fire and forget
+class UdpSink : public DetectionSink {
+private:
+    int socket_fd;
+    std::string destination;   // host:port, for messages
+    sockaddr_storage address;
+    socklen_t address_len;
+    
+public:
+    UdpSink();
+    ~UdpSink();
+    
+    // host:port, resolved once here
+    bool open(const std::string& host_port);
+    void emit(const Detection& detection, const std::string& protocol_name) override;
+};
+
+#endif // DETECTION_SINK_H
@@ -0,0 +1,170 @@
+#include "device_database.h"
+#include <cmath>
+#include <algorithm>
+
+DeviceDatabase::DeviceDatabase(double tolerance_hz) : bucket_width(tolerance_hz), device_count(0),
+                                                      next_generation(1), expiry_cursor(0) {
+}
+
+int64_t DeviceDatabase::bucket_for(double frequency) const {
+    return (int64_t)std::floor(frequency / bucket_width);
+}
+
+void DeviceDatabase::index_frequency(uint32_t slot, int64_t bucket) {
+    frequency_index[bucket].push_back(slot);
+}
+
+void DeviceDatabase::unindex_frequency(uint32_t slot, int64_t bucket) {
+    auto it = frequency_index.find(bucket);
+    if (it == frequency_index.end()) return;
+    
+    std::vector<uint32_t>& members = it->second;
+    members.erase(std::remove(members.begin(), members.end(), slot), members.end());
+    if (members.empty()) {
+        frequency_index.erase(it);
+    }
+}
+
+DeviceHandle DeviceDatabase::find_by_frequency(double frequency) const {
+    // anything within the tolerance lives in this bucket or a neighbour
+    int64_t center = bucket_for(frequency);
+    DeviceHandle best = DeviceHandle::none();
+    double best_distance = bucket_width;
+    
+    for (int64_t bucket = center - 1; bucket <= center + 1; bucket++) {
+        auto it = frequency_index.find(bucket);
+        if (it == frequency_index.end()) continue;
+        
+        for (uint32_t index : it->second) {
+            const Slot& slot = slots[index];
+            double distance = std::abs(slot.device.signal.frequency - frequency);
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = DeviceHandle{index, slot.generation};
+            }
+        }
+    }
+    return best;
+}
+
+DeviceHandle DeviceDatabase::find_by_key(DeviceKey key) const {
+    auto it = key_index.find(key);
+    if (it == key_index.end()) return DeviceHandle::none();
+    return DeviceHandle{it->second, slots[it->second].generation};
+}
+
+DeviceHandle DeviceDatabase::insert(const DetectedDevice& device) {
+    uint32_t index;
+    if (!free_slots.empty()) {
+        index = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        index = (uint32_t)slots.size();
+        slots.push_back(Slot());
+    }
+    
+    Slot& slot = slots[index];
+    slot.device = device;
+    slot.generation = next_generation++;
+    if (next_generation == 0) next_generation = 1; // 0 marks free slots
+    slot.bucket = bucket_for(device.signal.frequency);
+    
+    index_frequency(index, slot.bucket);
+    key_index[device.device_key] = index;
+    device_count++;
+    
+    return DeviceHandle{index, slot.generation};
+}
+
+bool DeviceDatabase::remove(DeviceHandle handle) {
+    if (!get(handle)) return false;
+    
+    Slot& slot = slots[handle.index];
+    unindex_frequency(handle.index, slot.bucket);
+    key_index.erase(slot.device.device_key);
+    
+    slot.device = DetectedDevice();
+    slot.generation = 0;
+    free_slots.push_back(handle.index);
+    device_count--;
+    return true;
+}
+
+void DeviceDatabase::clear() {
+    slots.clear();
+    free_slots.clear();
+    frequency_index.clear();
+    key_index.clear();
+    device_count = 0;
+    expiry_cursor = 0;
+}
+
+DetectedDevice* DeviceDatabase::get(DeviceHandle handle) {
+    if (!handle.valid() || handle.index >= slots.size()) return nullptr;
+    Slot& slot = slots[handle.index];
+    return slot.generation == handle.generation ? &slot.device : nullptr;
+}
+
+const DetectedDevice* DeviceDatabase::get(DeviceHandle handle) const {
+    if (!handle.valid() || handle.index >= slots.size()) return nullptr;
+    const Slot& slot = slots[handle.index];
+    return slot.generation == handle.generation ? &slot.device : nullptr;
+}
+
+void DeviceDatabase::update_signal(DeviceHandle handle, const SignalCharacteristics& signal) {
+    DetectedDevice* device = get(handle);
+    if (!device) return;
+    
+    Slot& slot = slots[handle.index];
+    int64_t bucket = bucket_for(signal.frequency);
+    if (bucket != slot.bucket) {
+        unindex_frequency(handle.index, slot.bucket);
+        index_frequency(handle.index, bucket);
+        slot.bucket = bucket;
+    }
+    device->signal = signal;
+}
+
+size_t DeviceDatabase::remove_older_than(std::chrono::steady_clock::time_point cutoff) {
+    size_t removed = 0;
+    for (uint32_t index = 0; index < slots.size(); index++) {
+        const Slot& slot = slots[index];
+        if (slot.generation != 0 && slot.device.last_seen < cutoff) {
+            remove(DeviceHandle{index, slot.generation});
+            removed++;
+        }
+    }
+    return removed;
+}
+
+size_t DeviceDatabase::expire_step(std::chrono::steady_clock::time_point cutoff, size_t max_slots,
+                                   std::vector<DeviceKey>* removed_keys) {
+    size_t removed = 0;
+    size_t steps = std::min(max_slots, slots.size());
+    for (size_t n = 0; n < steps; n++) {
+        if (expiry_cursor >= slots.size()) expiry_cursor = 0;
+        const Slot& slot = slots[expiry_cursor];
+        if (slot.generation != 0 && slot.device.last_seen < cutoff) {
+            if (removed_keys) removed_keys->push_back(slot.device.device_key);
+            remove(DeviceHandle{expiry_cursor, slot.generation});
+            removed++;
+        }
+        expiry_cursor++;
+    }
+    return removed;
+}
+
+void DeviceDatabase::copy_to(std::vector<DetectedDevice>& out) const {
+    // assigning over the old entries keeps their strings' buffers
+    size_t count = 0;
+    for_each([&out, &count](const DetectedDevice& device) {
+        if (count < out.size()) {
+            out[count] = device;
+        } else {
+            out.push_back(device);
+        }
+        count++;
+        return true;
+    });
+    out.resize(count);
+}
@@ -0,0 +1,105 @@
+#ifndef DEVICE_DATABASE_H
+#define DEVICE_DATABASE_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include "protocol_types.h"
+
+// stable reference to a device. stays valid until that device is removed,
+// after which the generation no longer matches and lookups return null.
+struct DeviceHandle {
+    uint32_t index;
+    uint32_t generation;
+    
+    bool valid() const { return generation != 0; }
+    static DeviceHandle none() { return DeviceHandle{0, 0}; }
+};
+
+// immutable copy of the devices in slot order, published by the writer so
+// readers never take its lock. epoch goes up with every publish, a reader can
+// skip work when it hasn't moved.
+struct DeviceSnapshot {
+    uint64_t epoch;
+    std::vector<DetectedDevice> devices;
+    DeviceSnapshot() : epoch(0) {}
+};
+
+typedef std::shared_ptr<const DeviceSnapshot> DeviceSnapshotPtr;
+
+// device store with a frequency-bucketed index for tolerance matching and a
+// hash index by device key. not thread safe, the owner does the locking.
+class DeviceDatabase {
+private:
+    struct Slot {
+        DetectedDevice device;
+        uint32_t generation;   // 0 while the slot is free
+        int64_t bucket;
+    };
+    
+    double bucket_width;       // hz, equal to the match tolerance
+    
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+    size_t device_count;
+    uint32_t next_generation;
+    uint32_t expiry_cursor;    // slot the next expire_step starts at
+    
+    std::unordered_map<int64_t, std::vector<uint32_t>> frequency_index;
+    std::unordered_map<DeviceKey, uint32_t> key_index;
+    
+    int64_t bucket_for(double frequency) const;
+    void index_frequency(uint32_t slot, int64_t bucket);
+    void unindex_frequency(uint32_t slot, int64_t bucket);
+    
+public:
+    explicit DeviceDatabase(double tolerance_hz = 50000);
+    
+    // closest device within the tolerance, O(1) in the number of devices
+    DeviceHandle find_by_frequency(double frequency) const;
+    DeviceHandle find_by_key(DeviceKey key) const;
+    
+    DeviceHandle insert(const DetectedDevice& device);
+    bool remove(DeviceHandle handle);
+    void clear();
+    
+    DetectedDevice* get(DeviceHandle handle);
+    const DetectedDevice* get(DeviceHandle handle) const;
+    
+    // replace the signal of a device and move it in the frequency index
+    void update_signal(DeviceHandle handle, const SignalCharacteristics& signal);
+    
+    // drop devices last seen before cutoff, returns how many were removed
+    size_t remove_older_than(std::chrono::steady_clock::time_point cutoff);
+    // the same a few slots at a time, each call looks at up to max_slots
+    // slots from where the previous one stopped and wraps around. the keys
+    // of removed devices are appended to removed when given.
+    size_t expire_step(std::chrono::steady_clock::time_point cutoff, size_t max_slots,
+                       std::vector<DeviceKey>* removed = nullptr);
+    
+    // devices in slot order into out, reusing what out already holds
+    void copy_to(std::vector<DetectedDevice>& out) const;
+    
+    size_t size() const { return device_count; }
+    double get_tolerance() const { return bucket_width; }
+    
+    // visit devices in slot order without copying them. fn returns false to stop.
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const auto& slot : slots) {
+            if (slot.generation != 0 && !fn(slot.device)) return;
+        }
+    }
+    
+    template <typename Fn>
+    void for_each_mutable(Fn fn) {
+        for (auto& slot : slots) {
+            if (slot.generation != 0 && !fn(slot.device)) return;
+        }
+    }
+};
+
+#endif // DEVICE_DATABASE_H
@@ -0,0 +1,379 @@
+#include "device_store.h"
+#include <iostream>
+#include <unordered_map>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char STORE_MAGIC[4] = {'R', 'F', 'D', 'B'};
+static const uint32_t STORE_VERSION = 2;
+static const uint32_t JOURNAL_MAGIC = 0x4c4e524a;   // "JRNL"
+
+struct StoreHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t device_count;
+    uint32_t authorized_count;
+    uint32_t generation;       // journal entries of an older generation are older than this snapshot
+    int64_t saved_ms;
+};
+
+struct JournalEntry {
+    uint32_t magic;
+    uint32_t type;
+    int64_t time_ms;
+    uint32_t check;            // fnv-1a of the other fields
+    uint32_t generation;
+    StoredDevice device;
+};
+
+static_assert(sizeof(StoreHeader) == 32, "StoreHeader is an on disk format");
+static_assert(sizeof(JournalEntry) == 104, "JournalEntry is an on disk format");
+
+static uint32_t entry_check(const JournalEntry& entry) {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const void* data, size_t len) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < len; i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+    };
+    mix(&entry.type, sizeof(entry.type));
+    mix(&entry.time_ms, sizeof(entry.time_ms));
+    mix(&entry.generation, sizeof(entry.generation));
+    mix(&entry.device, sizeof(entry.device));
+    return hash;
+}
+
+// whole file read only, null and len 0 for an empty or missing one
+static const uint8_t* map_file(const std::string& file_path, size_t& len, bool& missing) {
+    len = 0;
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    missing = fd < 0 && errno == ENOENT;
+    if (fd < 0) return nullptr;
+    
+    struct stat info;
+    info.st_size = 0;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        map = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        missing = info.st_size == 0;
+        return nullptr;
+    }
+    len = (size_t)info.st_size;
+    return static_cast<const uint8_t*>(map);
+}
+
+static bool write_all(int fd, const void* data, size_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        ssize_t written = ::write(fd, bytes, len);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        len -= (size_t)written;
+    }
+    return true;
+}
+
+int64_t DeviceStore::wall_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+DeviceStore::DeviceStore() : journal_fd(-1), journal_entries(0), generation(0),
+                             compacting(false), compact_offset(0), compact_entries(0) {
+}
+
+DeviceStore::~DeviceStore() {
+    close();
+}
+
+bool DeviceStore::open(const std::string& store_path, StoredState& state) {
+    close();
+    path = store_path;
+    journal_path = store_path + ".journal";
+    state.devices.clear();
+    state.authorized.clear();
+    state.last_alive_ms = 0;
+    generation = 0;
+    
+    if (!load_snapshot(state) || !load_journal(state)) return false;
+    
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    compacting = false;
+    journal_fd = ::open(journal_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (journal_fd < 0) {
+        std::cerr << "Failed to open device journal " << journal_path << "!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void DeviceStore::close() {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    if (journal_fd >= 0) {
+        ::close(journal_fd);
+        journal_fd = -1;
+    }
+    journal_entries = 0;
+}
+
+bool DeviceStore::load_snapshot(StoredState& state) {
+    size_t len;
+    bool missing;
+    const uint8_t* map = map_file(path, len, missing);
+    if (!map) {
+        if (missing) return true;
+        std::cerr << "Failed to map device store " << path << "!" << std::endl;
+        return false;
+    }
+    
+    StoreHeader header;
+    bool valid = len >= sizeof(header);
+    if (valid) {
+        memcpy(&header, map, sizeof(header));
+        valid = memcmp(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC)) == 0 && header.version == STORE_VERSION &&
+                header.record_size == sizeof(StoredDevice) &&
+                len >= sizeof(header) + (uint64_t)header.device_count * sizeof(StoredDevice) +
+                       (uint64_t)header.authorized_count * sizeof(DeviceKey);
+    }
+    if (valid) {
+        // the records are laid out exactly as in memory, one copy each
+        const uint8_t* records = map + sizeof(header);
+        state.devices.resize(header.device_count);
+        memcpy(state.devices.data(), records, header.device_count * sizeof(StoredDevice));
+        const uint8_t* keys = records + header.device_count * sizeof(StoredDevice);
+        state.authorized.resize(header.authorized_count);
+        memcpy(state.authorized.data(), keys, header.authorized_count * sizeof(DeviceKey));
+        state.last_alive_ms = header.saved_ms;
+        generation = header.generation;
+    } else {
+        std::cerr << "Device store " << path << " is not a version " << STORE_VERSION << " store!" << std::endl;
+    }
+    munmap(const_cast<uint8_t*>(map), len);
+    return valid;
+}
+
+bool DeviceStore::load_journal(StoredState& state) {
+    size_t len;
+    bool missing;
+    const uint8_t* map = map_file(journal_path, len, missing);
+    if (!map) {
+        if (missing) return true;
+        std::cerr << "Failed to map device journal " << journal_path << "!" << std::endl;
+        return false;
+    }
+    
+    std::unordered_map<DeviceKey, size_t> device_index;
+    device_index.reserve(state.devices.size());
+    for (size_t i = 0; i < state.devices.size(); i++) {
+        device_index[state.devices[i].device_key] = i;
+    }
+    
+    size_t entries = len / sizeof(JournalEntry);
+    size_t applied = 0;
+    for (size_t e = 0; e < entries; e++) {
+        JournalEntry entry;
+        memcpy(&entry, map + e * sizeof(JournalEntry), sizeof(entry));
+        // only the last entry can be torn, a crash mid write
+        if (entry.magic != JOURNAL_MAGIC || entry.check != entry_check(entry)) break;
+        applied++;
+        // left over from before a compaction that didn't get to drop them. newer
+        // ones were appended while a compaction that never finished was writing.
+        if ((int32_t)(entry.generation - generation) < 0) continue;
+        state.last_alive_ms = std::max(state.last_alive_ms, entry.time_ms);
+        
+        DeviceKey key = entry.device.device_key;
+        switch ((EntryType)entry.type) {
+            case EntryType::DEVICE: {
+                auto it = device_index.find(key);
+                if (it != device_index.end()) {
+                    state.devices[it->second] = entry.device;
+                } else {
+                    device_index[key] = state.devices.size();
+                    state.devices.push_back(entry.device);
+                }
+                break;
+            }
+            case EntryType::REMOVE: {
+                auto it = device_index.find(key);
+                if (it == device_index.end()) break;
+                // the last record takes the removed one's place
+                size_t index = it->second;
+                device_index.erase(it);
+                if (index != state.devices.size() - 1) {
+                    state.devices[index] = state.devices.back();
+                    device_index[state.devices[index].device_key] = index;
+                }
+                state.devices.pop_back();
+                break;
+            }
+            case EntryType::AUTHORIZE:
+                if (std::find(state.authorized.begin(), state.authorized.end(), key) == state.authorized.end()) {
+                    state.authorized.push_back(key);
+                }
+                break;
+            case EntryType::REVOKE:
+                state.authorized.erase(std::remove(state.authorized.begin(), state.authorized.end(), key),
+                                       state.authorized.end());
+                break;
+        }
+    }
+    munmap(const_cast<uint8_t*>(map), len);
+    
+    if (applied < entries || len % sizeof(JournalEntry) != 0) {
+        std::cerr << "WARNING: device journal " << journal_path << " ends in a torn entry, "
+                  << applied << " of " << entries << " entries used." << std::endl;
+        // appending after the tear would leave the new entries unreachable
+        if (truncate(journal_path.c_str(), (off_t)(applied * sizeof(JournalEntry))) != 0) {
+            std::cerr << "Failed to truncate device journal " << journal_path << "!" << std::endl;
+            return false;
+        }
+    }
+    journal_entries = applied;
+    return true;
+}
+
+bool DeviceStore::append(EntryType type, const StoredDevice& device) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    if (journal_fd < 0) return false;
+    
+    JournalEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.magic = JOURNAL_MAGIC;
+    entry.type = (uint32_t)type;
+    entry.time_ms = wall_time_ms();
+    entry.generation = generation;
+    entry.device = device;
+    entry.check = entry_check(entry);
+    
+    // O_APPEND and a single write, an entry is either all there or torn at the end
+    if (!write_all(journal_fd, &entry, sizeof(entry))) {
+        std::cerr << "Failed to append to device journal " << journal_path << "!" << std::endl;
+        return false;
+    }
+    journal_entries++;
+    return true;
+}
+
+bool DeviceStore::append_remove(DeviceKey key) {
+    StoredDevice device;
+    memset(&device, 0, sizeof(device));
+    device.device_key = key;
+    return append(EntryType::REMOVE, device);
+}
+
+bool DeviceStore::append_authorized(DeviceKey key, bool authorized) {
+    StoredDevice device;
+    memset(&device, 0, sizeof(device));
+    device.device_key = key;
+    return append(authorized ? EntryType::AUTHORIZE : EntryType::REVOKE, device);
+}
+
+bool DeviceStore::begin_compact() {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    if (journal_fd < 0 || compacting) return false;
+    
+    // the length, not the count, a failed append may have left part of an entry
+    struct stat info;
+    if (fstat(journal_fd, &info) != 0) return false;
+    compact_offset = info.st_size;
+    compact_entries = journal_entries;
+    compacting = true;
+    // from here on entries are newer than the copy. until the new snapshot is
+    // in place they are applied on top of the old one, after that on top of it.
+    generation++;
+    return true;
+}
+
+bool DeviceStore::finish_compact(const std::vector<StoredDevice>& devices, const std::vector<DeviceKey>& authorized) {
+    uint32_t snapshot_generation;
+    {
+        std::lock_guard<std::mutex> lock(journal_mutex);
+        if (!compacting) return false;
+        snapshot_generation = generation;
+    }
+    
+    StoreHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+    header.version = STORE_VERSION;
+    header.record_size = sizeof(StoredDevice);
+    header.device_count = (uint32_t)devices.size();
+    header.authorized_count = (uint32_t)authorized.size();
+    header.generation = snapshot_generation;
+    header.saved_ms = wall_time_ms();
+    
+    // a crash at any point leaves either the old snapshot and journal or the new snapshot
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool written = fd >= 0 && write_all(fd, &header, sizeof(header)) &&
+                   write_all(fd, devices.data(), devices.size() * sizeof(StoredDevice)) &&
+                   write_all(fd, authorized.data(), authorized.size() * sizeof(DeviceKey)) &&
+                   fsync(fd) == 0;
+    if (fd >= 0) ::close(fd);
+    if (!written || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write device store " << path << "!" << std::endl;
+        unlink(temp_path.c_str());
+        std::lock_guard<std::mutex> lock(journal_mutex);
+        compacting = false;
+        return false;
+    }
+    
+    // the entries before compact_offset are in the snapshot now, and should
+    // dropping them fail they are older than its generation and skipped
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    bool dropped = drop_compacted_entries();
+    compacting = false;
+    return dropped;
+}
+
+// keeps the entries appended since begin_compact(), called with the journal
+// lock held so no append sneaks in between the copy and the swap. that tail
+// is what arrived while the snapshot was written, a few entries at most.
+bool DeviceStore::drop_compacted_entries() {
+    if (journal_fd < 0) return false;
+    std::vector<uint8_t> tail;
+    struct stat info;
+    int read_fd = ::open(journal_path.c_str(), O_RDONLY);
+    bool ok = read_fd >= 0 && fstat(read_fd, &info) == 0 && info.st_size >= compact_offset;
+    if (ok) {
+        tail.resize((size_t)(info.st_size - compact_offset));
+        size_t done = 0;
+        while (ok && done < tail.size()) {
+            ssize_t got = pread(read_fd, tail.data() + done, tail.size() - done, compact_offset + (off_t)done);
+            if (got < 0 && errno == EINTR) continue;
+            ok = got > 0;
+            if (ok) done += (size_t)got;
+        }
+    }
+    if (read_fd >= 0) ::close(read_fd);
+    
+    // the tail goes into a new journal that replaces the old one, a crash
+    // leaves one or the other and both load to the same devices
+    std::string temp_path = journal_path + ".tmp";
+    int fd = ok ? ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644) : -1;
+    ok = fd >= 0 && write_all(fd, tail.data(), tail.size()) && fsync(fd) == 0 &&
+         std::rename(temp_path.c_str(), journal_path.c_str()) == 0;
+    if (!ok) {
+        std::cerr << "Failed to empty device journal " << journal_path << "!" << std::endl;
+        if (fd >= 0) ::close(fd);
+        unlink(temp_path.c_str());
+        return false;
+    }
+    ::close(journal_fd);
+    journal_fd = fd;
+    journal_entries -= std::min<size_t>(compact_entries, journal_entries);
+    return true;
+}
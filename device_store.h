@@ -0,0 +1,115 @@
+#ifndef DEVICE_STORE_H
+#define DEVICE_STORE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <mutex>
+#include <atomic>
+#include "protocol_types.h"
+
+// one device as it is kept on disk. fixed size and without pointers so a
+// snapshot is an array of these that is used straight from the mapping.
+// times are wall clock ms, the steady clock doesn't survive a restart.
+// names and security flags follow from the protocol and aren't stored.
+struct StoredDevice {
+    uint64_t device_key;
+    int64_t first_seen_ms;
+    int64_t last_seen_ms;
+    double frequency;
+    double bandwidth;
+    double power_db;
+    double snr_db;
+    double symbol_rate;
+    double burst_duration;
+    uint32_t packet_count;
+    uint8_t protocol;
+    uint8_t modulation;
+    uint8_t is_authorized;
+    uint8_t flags;             // STORED_BURST, STORED_SUSPICIOUS
+};
+
+static const uint8_t STORED_BURST = 1;
+static const uint8_t STORED_SUSPICIOUS = 2;
+
+static_assert(sizeof(StoredDevice) == 80, "StoredDevice is an on disk format");
+static_assert(std::is_trivially_copyable<StoredDevice>::value, "StoredDevice is copied as bytes");
+
+// what a store held when it was opened: the snapshot with the journal
+// applied. last_alive_ms is the newest time written, when the previous run
+// was last known to be up.
+struct StoredState {
+    std::vector<StoredDevice> devices;
+    std::vector<DeviceKey> authorized;
+    int64_t last_alive_ms;
+};
+
+// device database persistence. <path> is a binary snapshot, a header then
+// the devices then the authorized keys, loaded with one mmap and a copy.
+// changes since the snapshot go to <path>.journal as fixed size entries
+// appended with one write each, so they survive a crash of the process.
+// compacting is split so the caller's lock is held only for the copy:
+// begin_compact() moves new entries on to the next generation, then
+// finish_compact() writes the copy as a new snapshot next to the old one,
+// renames it over it and drops the journal entries it now holds. a torn
+// last journal entry is cut off, entries from before the current snapshot
+// are skipped.
+class DeviceStore {
+public:
+    enum class EntryType : uint32_t {
+        DEVICE = 1,            // new or changed device, the whole record
+        REMOVE,                // device forgotten, only device_key is used
+        AUTHORIZE,             // key goes on the allowlist
+        REVOKE                 // key comes off the allowlist
+    };
+    
+private:
+    std::string path;
+    std::string journal_path;
+    
+    // appends and the journal swap at the end of a compaction
+    mutable std::mutex journal_mutex;
+    int journal_fd;
+    std::atomic<size_t> journal_entries;
+    uint32_t generation;       // stamped on every journal entry, the snapshot's or one ahead
+    
+    bool compacting;
+    off_t compact_offset;      // journal length at begin_compact(), the entries the snapshot holds
+    size_t compact_entries;
+    
+    bool load_snapshot(StoredState& state);
+    bool load_journal(StoredState& state);
+    bool append(EntryType type, const StoredDevice& device);
+    bool drop_compacted_entries();
+    
+public:
+    DeviceStore();
+    ~DeviceStore();
+    DeviceStore(const DeviceStore&) = delete;
+    DeviceStore& operator=(const DeviceStore&) = delete;
+    
+    // missing files are an empty store, unreadable or foreign ones an error
+    bool open(const std::string& store_path, StoredState& state);
+    void close();
+    bool is_open() const {
+        std::lock_guard<std::mutex> lock(journal_mutex);
+        return journal_fd >= 0;
+    }
+    
+    bool append_device(const StoredDevice& device) { return append(EntryType::DEVICE, device); }
+    bool append_remove(DeviceKey key);
+    bool append_authorized(DeviceKey key, bool authorized);
+    size_t get_journal_entries() const { return journal_entries; }
+    
+    // begin_compact() is called under the same lock as the appends, with the
+    // devices and allowlist copied at that point. it fails if the store is
+    // closed or a compaction is still running. finish_compact() then runs
+    // without the lock, on any thread, while appends go on.
+    bool begin_compact();
+    bool finish_compact(const std::vector<StoredDevice>& devices, const std::vector<DeviceKey>& authorized);
+    
+    static int64_t wall_time_ms();
+};
+
+#endif // DEVICE_STORE_H
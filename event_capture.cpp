@@ -0,0 +1,202 @@
+#include "event_capture.h"
+#include "sdr.h"
+#include "iq_recorder.h"
+#include "protocol_analyzer.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <sys/stat.h>
+
+static uint64_t wall_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// device ids are free form, keep file names to a safe alphabet
+static std::string file_name_part(const std::string& text) {
+    std::string part = text;
+    for (auto& c : part) {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '.') c = '_';
+    }
+    return part;
+}
+
+EventCapture::EventCapture() : sdr(nullptr), analyzer(nullptr), pre_ms(DEFAULT_PRE_MS), post_ms(DEFAULT_POST_MS), running(false),
+                               queued_start_byte(0), queued_end_byte(0), dumps_written(0), dumps_dropped(0) {
+}
+
+EventCapture::~EventCapture() {
+    stop();
+}
+
+bool EventCapture::start(SimpleSDR* source_sdr, const ProtocolAnalyzer* device_analyzer,
+                         const std::string& dump_directory, const std::string& dump_name,
+                         uint32_t pre_window_ms, uint32_t post_window_ms) {
+    if (running) return true;
+    
+    struct stat info;
+    if (stat(dump_directory.c_str(), &info) < 0 || !S_ISDIR(info.st_mode)) {
+        std::cerr << "Event capture directory " << dump_directory << " does not exist!" << std::endl;
+        return false;
+    }
+    
+    sdr = source_sdr;
+    analyzer = device_analyzer;
+    directory = dump_directory;
+    name = dump_name;
+    pre_ms = pre_window_ms;
+    post_ms = post_window_ms;
+    
+    // the pre-event window comes out of the capture ring, warn if it can't
+    double history_ms = sdr->get_history_bytes() * 1000.0 / (2.0 * sdr->get_sample_rate());
+    if (pre_ms > history_ms * 3 / 4) {
+        std::cerr << "WARNING: " << pre_ms << " ms before events but only " << (int)history_ms
+                  << " ms of capture history, dumps will be cut short." << std::endl;
+    }
+    
+    reader = sdr->create_reader();
+    running = true;
+    worker = std::thread(&EventCapture::dump_loop, this);
+    return true;
+}
+
+void EventCapture::stop() {
+    if (!worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        running = false;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+void EventCapture::trigger(uint64_t sample, const DeviceAlert& alert) {
+    if (!running || !alert.reason[0]) return;
+    
+    uint64_t event_byte = sample * 2;
+    TuningSegment tuning;
+    if (!sdr->find_tuning(event_byte, tuning)) return;
+    
+    // a dump never spans a retune, the samples on either side are unrelated
+    uint64_t pre_bytes = (uint64_t)tuning.sample_rate * 2 * pre_ms / 1000;
+    uint64_t post_bytes = (uint64_t)tuning.sample_rate * 2 * post_ms / 1000;
+    uint64_t start_byte = std::max(event_byte > pre_bytes ? event_byte - pre_bytes : 0, tuning.start_byte);
+    uint64_t end_byte = std::min(event_byte + post_bytes, tuning.end_byte);
+    
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        auto last = last_dump.find(alert.device_key);
+        if (last != last_dump.end() && now - last->second < std::chrono::seconds(COOLDOWN_S)) return;
+        // one burst often matches several devices, it is in the queued dump already
+        if (event_byte >= queued_start_byte && event_byte < queued_end_byte) return;
+        if (pending.size() >= MAX_PENDING) {
+            dumps_dropped++;
+            return;
+        }
+        // the only allocations are here, once per dump actually queued.
+        // devices past their cooldown are forgotten then, the map only holds
+        // those dumped in the last COOLDOWN_S
+        for (auto it = last_dump.begin(); it != last_dump.end();) {
+            if (now - it->second >= std::chrono::seconds(COOLDOWN_S)) {
+                it = last_dump.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        last_dump[alert.device_key] = now;
+        PendingDump dump;
+        dump.start_byte = start_byte;
+        dump.event_byte = event_byte;
+        dump.end_byte = end_byte;
+        dump.center_freq = tuning.center_freq;
+        dump.sample_rate = tuning.sample_rate;
+        dump.device_key = alert.device_key;
+        dump.reason = alert.reason;
+        pending.push_back(dump);
+        queued_start_byte = start_byte;
+        queued_end_byte = end_byte;
+    }
+    wake.notify_one();
+}
+
+void EventCapture::dump_loop() {
+    while (true) {
+        PendingDump dump;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            wake.wait(lock, [this] { return !running || !pending.empty(); });
+            if (pending.empty()) return;
+            dump = pending.front();
+            pending.pop_front();
+        }
+        
+        // the post-event window may still be on its way
+        while (running && sdr->is_capturing() && sdr->get_captured_bytes() < dump.end_byte) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        write_dump(dump);
+    }
+}
+
+void EventCapture::write_dump(const PendingDump& dump) {
+    uint64_t start = reader->seek(dump.start_byte);
+    uint64_t end = std::min(dump.end_byte, sdr->get_captured_bytes()) & ~uint64_t(1);
+    if (start >= end || start > dump.event_byte) {
+        // the event itself is already gone from the ring
+        dumps_dropped++;
+        return;
+    }
+    
+    uint64_t captured = sdr->get_captured_bytes();
+    uint64_t start_time_ms = wall_time_ms() - (captured - start) * 1000 / (2 * (uint64_t)dump.sample_rate);
+    std::string device_id = analyzer->format_device_id(dump.device_key);
+    std::string path = directory + "/event-" + std::to_string(start_time_ms) + "-" + file_name_part(name) +
+                       "-" + file_name_part(device_id) + ".iq";
+    std::ofstream data_file(path, std::ios::binary | std::ios::trunc);
+    std::ofstream sidecar(IQRecorder::sidecar_path(path), std::ios::trunc);
+    if (!data_file || !sidecar) {
+        std::cerr << "Failed to write event capture " << path << "!" << std::endl;
+        dumps_dropped++;
+        return;
+    }
+    
+    uint64_t written = 0;
+    bool torn = false;
+    while (reader->position() < end) {
+        uint64_t pos = reader->position();
+        const uint8_t* data;
+        size_t len = reader->acquire(data, (size_t)std::min<uint64_t>(end - pos, (uint64_t)CHUNK_BYTES));
+        if (len == 0 || reader->position() != pos) {
+            // lapped by the capture, keep what made it out
+            torn = true;
+            break;
+        }
+        data_file.write(reinterpret_cast<const char*>(data), len);
+        written += len;
+        if (!reader->release(len)) {
+            torn = true;
+            break;
+        }
+    }
+    
+    // same sidecar an IQRecorder writes, plus what triggered the dump
+    sidecar << "format=u8iq" << std::endl
+            << "sample_rate=" << dump.sample_rate << std::endl
+            << "center_freq=" << dump.center_freq << std::endl
+            << "gain=" << sdr->get_gain() << std::endl
+            << "start_time_ms=" << start_time_ms << std::endl
+            << "tune offset=0 settle=0 center=" << dump.center_freq << " rate=" << dump.sample_rate
+            << " time_ms=" << start_time_ms << std::endl
+            << "event_offset=" << dump.event_byte - start << std::endl
+            << "device_id=" << device_id << std::endl
+            << "reason=" << dump.reason << std::endl
+            << "bytes=" << written << std::endl
+            << "dropped_bytes=" << (end - start) - written << std::endl
+            << "end_time_ms=" << start_time_ms + written * 1000 / (2 * (uint64_t)dump.sample_rate) << std::endl;
+            
+    dumps_written++;
+    std::cout << "Event capture " << path << ": " << dump.reason
+              << (torn ? " (cut short)" : "") << std::endl;
+}
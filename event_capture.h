@@ -0,0 +1,88 @@
+#ifndef EVENT_CAPTURE_H
+#define EVENT_CAPTURE_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include "sample_ring.h"
+#include "protocol_types.h"
+
+class SimpleSDR;
+class ProtocolAnalyzer;
+
+// cuts the iq around alerting detections out of a SimpleSDR's capture ring,
+// which doubles as the rolling pre-event history (see set_history_seconds).
+// trigger() is called from the pipeline's database stage and only queues the
+// window, a worker waits for the post-event samples and writes the dump in
+// IQRecorder's format so it can be replayed. the capture never waits for it,
+// a window the ring no longer holds is cut short instead.
+class EventCapture {
+private:
+    struct PendingDump {
+        uint64_t start_byte;
+        uint64_t event_byte;
+        uint64_t end_byte;
+        uint32_t center_freq;
+        uint32_t sample_rate;
+        DeviceKey device_key;
+        std::string reason;
+    };
+    
+    SimpleSDR* sdr;
+    const ProtocolAnalyzer* analyzer;   // formats the device ids
+    std::string directory;
+    std::string name;              // tells the tuners' dumps apart
+    uint32_t pre_ms;
+    uint32_t post_ms;
+    
+    std::unique_ptr<SampleRingReader> reader;   // worker only, seeked per dump
+    std::thread worker;
+    std::atomic<bool> running;
+    
+    std::mutex queue_mutex;
+    std::condition_variable wake;
+    std::deque<PendingDump> pending;
+    // one dump per device per cooldown, a chatty remote would fill the disk.
+    // pruned of expired entries whenever a dump is queued
+    std::unordered_map<DeviceKey, std::chrono::steady_clock::time_point> last_dump;
+    uint64_t queued_start_byte;    // the newest queued window
+    uint64_t queued_end_byte;
+    
+    std::atomic<uint64_t> dumps_written;
+    std::atomic<uint64_t> dumps_dropped;
+    
+    static const size_t MAX_PENDING = 16;
+    static const int COOLDOWN_S = 30;
+    static const size_t CHUNK_BYTES = 262144;
+    
+    void dump_loop();
+    void write_dump(const PendingDump& dump);
+    
+public:
+    static const uint32_t DEFAULT_PRE_MS = 500;
+    static const uint32_t DEFAULT_POST_MS = 500;
+    
+    EventCapture();
+    ~EventCapture();
+    
+    // directory must exist, files are named event-<time>-<name>-<device>.iq
+    bool start(SimpleSDR* sdr, const ProtocolAnalyzer* analyzer, const std::string& directory,
+               const std::string& name, uint32_t pre_ms, uint32_t post_ms);
+    // writes what is already queued, cut short at the current capture position
+    void stop();
+    bool is_running() const { return running; }
+    
+    // sample is a capture sample index of the event, typically the burst start
+    void trigger(uint64_t sample, const DeviceAlert& alert);
+    
+    uint64_t get_dumps_written() const { return dumps_written; }
+    uint64_t get_dumps_dropped() const { return dumps_dropped; }
+};
+
+#endif // EVENT_CAPTURE_H
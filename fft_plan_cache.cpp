@@ -0,0 +1,119 @@
+#include "fft_plan_cache.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+
+// planning scratch buffers are offset so their alignment matches the
+// caller's, fftwf_malloc memory itself has alignment 0
+static fftwf_complex* offset_buffer(void* base, int alignment) {
+    return reinterpret_cast<fftwf_complex*>(static_cast<uint8_t*>(base) + alignment);
+}
+
+FFTPlanCache::FFTPlanCache() : planner_flags(FFTW_MEASURE), wisdom_loaded(false) {
+    const char* path = std::getenv("RF_FFTW_WISDOM");
+    const char* home = std::getenv("HOME");
+    if (path && *path) {
+        wisdom_path = path;
+    } else if (home && *home) {
+        wisdom_path = std::string(home) + "/.rf_security_fftw_wisdom";
+    } else {
+        wisdom_path = ".rf_security_fftw_wisdom";
+    }
+    
+    const char* patient = std::getenv("RF_FFTW_PATIENT");
+    if (patient && *patient == '1') {
+        planner_flags = FFTW_PATIENT;
+    }
+}
+
+FFTPlanCache::~FFTPlanCache() {
+    for (auto& entry : plans) {
+        fftwf_destroy_plan(entry.second);
+    }
+}
+
+FFTPlanCache& FFTPlanCache::instance() {
+    static FFTPlanCache cache;
+    return cache;
+}
+
+void FFTPlanCache::set_wisdom_path(const std::string& path) {
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    wisdom_path = path;
+    wisdom_loaded = false;
+}
+
+void FFTPlanCache::load_wisdom_locked() {
+    if (wisdom_loaded) return;
+    wisdom_loaded = true;
+    
+    if (fftwf_import_wisdom_from_filename(wisdom_path.c_str())) {
+        std::cout << "Loaded FFTW wisdom from " << wisdom_path << std::endl;
+    }
+}
+
+fftwf_plan FFTPlanCache::create_plan(int size, int direction, int in_alignment, int out_alignment,
+                                     bool in_place, bool& measured) {
+    // measuring clobbers the arrays, so plan on scratch buffers with the
+    // same alignment as the caller's instead of on the caller's data
+    const size_t bytes = sizeof(fftwf_complex) * size + 64;
+    void* in_base = fftwf_malloc(bytes);
+    void* out_base = in_place ? nullptr : fftwf_malloc(bytes);
+    if (!in_base || (!in_place && !out_base)) {
+        fftwf_free(in_base);
+        fftwf_free(out_base);
+        return nullptr;
+    }
+    
+    fftwf_complex* in = offset_buffer(in_base, in_alignment);
+    fftwf_complex* out = in_place ? in : offset_buffer(out_base, out_alignment);
+    
+    // wisdom only planning is instant and tells us whether we need to measure
+    fftwf_plan plan = fftwf_plan_dft_1d(size, in, out, direction, planner_flags | FFTW_WISDOM_ONLY);
+    measured = false;
+    if (!plan) {
+        plan = fftwf_plan_dft_1d(size, in, out, direction, planner_flags);
+        measured = true;
+    }
+    
+    fftwf_free(in_base);
+    fftwf_free(out_base);
+    return plan;
+}
+
+fftwf_plan FFTPlanCache::get_plan(int size, int direction, fftwf_complex* in, fftwf_complex* out) {
+    bool in_place = (in == out);
+    int in_alignment = fftwf_alignment_of(reinterpret_cast<float*>(in));
+    int out_alignment = fftwf_alignment_of(reinterpret_cast<float*>(out));
+    PlanKey key(size, direction, in_alignment, out_alignment, in_place);
+    
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    auto it = plans.find(key);
+    if (it != plans.end()) return it->second;
+    
+    load_wisdom_locked();
+    
+    bool measured = false;
+    fftwf_plan plan = create_plan(size, direction, in_alignment, out_alignment, in_place, measured);
+    if (!plan) {
+        std::cerr << "FFTW planning failed for size " << size << std::endl;
+        return nullptr;
+    }
+    plans[key] = plan;
+    
+    // only touch the file when planning actually learned something new
+    if (measured && !fftwf_export_wisdom_to_filename(wisdom_path.c_str())) {
+        std::cerr << "Could not write FFTW wisdom to " << wisdom_path << std::endl;
+    }
+    return plan;
+}
+
+size_t FFTPlanCache::get_plan_count() {
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    return plans.size();
+}
+
+bool FFTPlanCache::save_wisdom() {
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    return fftwf_export_wisdom_to_filename(wisdom_path.c_str()) != 0;
+}
@@ -0,0 +1,51 @@
+#ifndef FFT_PLAN_CACHE_H
+#define FFT_PLAN_CACHE_H
+
+#include <fftw3.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+// process wide cache of fftw plans. plans are keyed by (size, direction,
+// alignment) so any buffers with matching alignment can run them through
+// fftwf_execute_dft. wisdom is loaded from disk on first use and written
+// back whenever a new plan had to be measured, so only the very first
+// launch pays for FFTW_MEASURE / FFTW_PATIENT planning.
+class FFTPlanCache {
+private:
+    // size, direction, input alignment, output alignment, in-place
+    typedef std::tuple<int, int, int, int, bool> PlanKey;
+    
+    std::map<PlanKey, fftwf_plan> plans;
+    std::mutex planner_mutex;  // the fftw planner is not thread safe
+    std::string wisdom_path;
+    unsigned planner_flags;
+    bool wisdom_loaded;
+    
+    FFTPlanCache();
+    ~FFTPlanCache();
+    FFTPlanCache(const FFTPlanCache&) = delete;
+    FFTPlanCache& operator=(const FFTPlanCache&) = delete;
+    
+    void load_wisdom_locked();
+    fftwf_plan create_plan(int size, int direction, int in_alignment, int out_alignment,
+                           bool in_place, bool& measured);
+                           
+public:
+    static FFTPlanCache& instance();
+    
+    // in/out are only used to look at alignment, they are never written.
+    // the returned plan belongs to the cache, don't destroy it.
+    fftwf_plan get_plan(int size, int direction, fftwf_complex* in, fftwf_complex* out);
+    
+    // must be called before the first get_plan() to take effect
+    void set_wisdom_path(const std::string& path);
+    void set_planner_flags(unsigned flags) { planner_flags = flags; }
+    
+    const std::string& get_wisdom_path() const { return wisdom_path; }
+    size_t get_plan_count();
+    bool save_wisdom();
+};
+
+#endif // FFT_PLAN_CACHE_H
@@ -0,0 +1,38 @@
+#ifndef FIXED_VECTOR_H
+#define FIXED_VECTOR_H
+
+#include <cstddef>
+
+// vector with its storage inline, for per block results that must not touch
+// the heap. push_back fails once capacity is reached, the caller decides
+// what to drop. T must be default constructible and cheap to copy.
+template <typename T, size_t N>
+class FixedVector {
+private:
+    T items[N];
+    size_t count;
+
+public:
+    FixedVector() : count(0) {}
+
+    bool push_back(const T& item) {
+        if (count == N) return false;
+        items[count++] = item;
+        return true;
+    }
+    void clear() { count = 0; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+    static size_t capacity() { return N; }
+
+    T& operator[](size_t index) { return items[index]; }
+    const T& operator[](size_t index) const { return items[index]; }
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+};
+
+#endif // FIXED_VECTOR_H
@@ -1,19 +1,23 @@
 #include "gui.h"
 #include "sdr.h"
 #include "protocol_analyzer.h"
+#include "pipeline.h"
+#include "async_log.h"
 #include <iostream>
 #include <cmath>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
-#include <cstring>
+#include <cstdio>
 
 SDRGui::SDRGui() : window(nullptr), renderer(nullptr), font(nullptr), 
                    running(false), target_frequency(100000000), target_gain(0),
                    frequency_changed(false), gain_changed(false), 
                    protocol_scanning_enabled(false), protocol_scanning_paused(false),
                    user_manual_control(false), sdr_ref(nullptr), protocol_analyzer_ref(nullptr),
-                   fft_in(nullptr), fft_out(nullptr), waterfall_texture(nullptr), waterfall_pixels(nullptr) {
+                   pipeline_ref(nullptr), last_spectrum_sequence(0), have_spectrum(false),
+                   waterfall_texture(nullptr), waterfall_head(0), panel_epoch(0), panel_device_count(0),
+                   panel_alert_version(0), show_metrics(false) {
 }
 
 SDRGui::~SDRGui() {
@@ -56,16 +60,8 @@ bool SDRGui::initialize() {
         return false;
     }
     
-    // setup fft
-    fft_in = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * FFT_SIZE);
-    fft_out = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * FFT_SIZE);
-    fft_plan = fftwf_plan_dft_1d(FFT_SIZE, fft_in, fft_out, FFTW_FORWARD, FFTW_ESTIMATE);
-    
-    if (!fft_in || !fft_out) {
-        std::cerr << "FFT memory allocation failed!" << std::endl;
-        cleanup();
-        return false;
-    }
+    // labels are rasterized once and then drawn from cached textures
+    text_cache.reset(new TextCache(renderer, font));
     
     // setup waterfall
     init_waterfall();
@@ -78,18 +74,8 @@ void SDRGui::cleanup() {
     // cleanup waterfall
     cleanup_waterfall();
     
-    // cleanup fft
-    if (fft_plan) {
-        fftwf_destroy_plan(fft_plan);
-    }
-    if (fft_in) {
-        fftwf_free(fft_in);
-        fft_in = nullptr;
-    }
-    if (fft_out) {
-        fftwf_free(fft_out);
-        fft_out = nullptr;
-    }
+    // cached textures must go before the renderer and font
+    text_cache.reset();
     
     if (font) {
         TTF_CloseFont(font);
@@ -199,6 +185,15 @@ void SDRGui::handle_keyboard(SDL_Keycode key) {
             }
             break;
             
+        case SDLK_w:
+            // switch between wideband hops and fixed 250 khz steps
+            if (protocol_analyzer_ref) {
+                bool wideband = protocol_analyzer_ref->get_scan_mode() == ScanMode::WIDEBAND;
+                protocol_analyzer_ref->set_scan_mode(wideband ? ScanMode::NARROW : ScanMode::WIDEBAND);
+                std::cout << "Scan mode: " << (wideband ? "narrow" : "wideband") << std::endl;
+            }
+            break;
+            
         case SDLK_m:
             // return to manual control
             user_manual_control = true;
@@ -206,6 +201,12 @@ void SDRGui::handle_keyboard(SDL_Keycode key) {
             std::cout << "Manual frequency control enabled" << std::endl;
             break;
             
+        case SDLK_i:
+            // pipeline timings and queue depths on top of the spectrum
+            show_metrics = !show_metrics;
+            metrics_lines.clear();
+            break;
+            
         case SDLK_ESCAPE:
         case SDLK_q:
             running = false;
@@ -218,6 +219,10 @@ void SDRGui::update() {
 }
 
 void SDRGui::render() {
+    // nothing to draw while minimized, the pipeline keeps running regardless
+    if (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED) return;
+    auto started = std::chrono::steady_clock::now();
+    
     // clear screen
     SDL_SetRenderDrawColor(renderer, bg_color.r, bg_color.g, bg_color.b, bg_color.a);
     SDL_RenderClear(renderer);
@@ -225,9 +230,18 @@ void SDRGui::render() {
     // draw grid
     draw_grid();
     
-    // render spectrum if sdr data is available
-    if (sdr_ref && !sdr_ref->get_iq_buffer().empty()) {
-        render_spectrum(sdr_ref->get_iq_buffer());
+    // render spectrum from the newest frame the pipeline published
+    SpectrumFramePtr frame = pipeline_ref ? pipeline_ref->get_latest_spectrum() : SpectrumFramePtr();
+    if (frame && !frame->power_db.empty()) {
+        if (!have_spectrum || frame->sequence != last_spectrum_sequence) {
+            SpectrumEngine::resample_bins(frame->power_db, WINDOW_WIDTH, display_bins);
+            
+            // one waterfall line per capture block, not per gui frame
+            update_waterfall_data(display_bins);
+            last_spectrum_sequence = frame->sequence;
+            have_spectrum = true;
+        }
+        render_spectrum(display_bins);
     }
     
     // render waterfall
@@ -239,6 +253,12 @@ void SDRGui::render() {
     // render protocol panel
     render_protocol_panel();
     
+    if (show_metrics) {
+        render_metrics_overlay();
+    }
+    
+    // present waits for vsync, it isn't our drawing time
+    render_latency.record_since(started);
     SDL_RenderPresent(renderer);
 }
 
@@ -266,13 +286,8 @@ void SDRGui::draw_grid() {
     }
 }
 
-void SDRGui::render_spectrum(const std::vector<std::complex<float>>& iq_data) {
-    if (iq_data.empty()) return;
-    
-    std::vector<float> fft_mag = compute_fft_magnitude(iq_data);
-    
-    // update waterfall with new fft data
-    update_waterfall_data(fft_mag);
+void SDRGui::render_spectrum(const std::vector<float>& fft_mag) {
+    if (fft_mag.empty()) return;
     
     SDL_SetRenderDrawColor(renderer, spectrum_color.r, spectrum_color.g, spectrum_color.b, spectrum_color.a);
     
@@ -326,46 +341,18 @@ void SDRGui::render_controls() {
     
     // instructions
     int instruction_y = control_y + TEXT_LINE_HEIGHT * 2 + SECTION_SPACING / 2;
-    render_text("Controls: Arrows (freq) +/- (gain) S (scan) P (pause) M (manual) Q (quit)", MARGIN, instruction_y);
-    render_text("Protocol Scanner: S=Start/Stop P=Pause M=Manual Control", MARGIN, instruction_y + TEXT_LINE_HEIGHT);
+    render_text("Controls: Arrows (freq) +/- (gain) S (scan) P (pause) M (manual) I (metrics) Q (quit)", MARGIN, instruction_y);
+    render_text("Protocol Scanner: S=Start/Stop P=Pause W=Wideband/Narrow M=Manual Control", MARGIN, instruction_y + TEXT_LINE_HEIGHT);
 }
 
 void SDRGui::render_text(const std::string& text, int x, int y) {
-    if (!font) return;
-    
-    SDL_Surface* text_surface = TTF_RenderText_Solid(font, text.c_str(), text_color);
-    if (!text_surface) return;
-    
-    SDL_Texture* text_texture = SDL_CreateTextureFromSurface(renderer, text_surface);
-    if (!text_texture) {
-        SDL_FreeSurface(text_surface);
-        return;
-    }
-    
-    SDL_Rect dest_rect = {x, y, text_surface->w, text_surface->h};
-    SDL_RenderCopy(renderer, text_texture, nullptr, &dest_rect);
-    
-    SDL_DestroyTexture(text_texture);
-    SDL_FreeSurface(text_surface);
+    render_text_colored(text, x, y, text_color);
 }
 
 void SDRGui::render_text_colored(const std::string& text, int x, int y, SDL_Color color) {
-    if (!font) return;
+    if (!text_cache) return;
     
-    SDL_Surface* text_surface = TTF_RenderText_Solid(font, text.c_str(), color);
-    if (!text_surface) return;
-    
-    SDL_Texture* text_texture = SDL_CreateTextureFromSurface(renderer, text_surface);
-    if (!text_texture) {
-        SDL_FreeSurface(text_surface);
-        return;
-    }
-    
-    SDL_Rect dest_rect = {x, y, text_surface->w, text_surface->h};
-    SDL_RenderCopy(renderer, text_texture, nullptr, &dest_rect);
-    
-    SDL_DestroyTexture(text_texture);
-    SDL_FreeSurface(text_surface);
+    text_cache->draw(text, x, y, color);
 }
 
 void SDRGui::render_protocol_panel() {
@@ -391,24 +378,42 @@ void SDRGui::render_protocol_panel() {
         render_text_colored(scan_freq.str(), 250, panel_y + MARGIN/2, SDL_Color{255, 255, 100, 255});
     }
     
+    // devices from one snapshot, redone only when it changed
+    DeviceSnapshotPtr snapshot = protocol_analyzer_ref->get_device_snapshot();
+    const size_t max_display = 4;
+    if (snapshot->epoch != panel_epoch) {
+        panel_epoch = snapshot->epoch;
+        panel_device_count = snapshot->devices.size();
+        panel_devices.clear();
+        for (const auto& device : snapshot->devices) {
+            if (panel_devices.size() == max_display) break;
+            panel_devices.push_back(PanelDevice{device.device_type, device.signal.frequency, device.is_authorized});
+        }
+    }
+    
+    // the top alert only when the alert engine moved, one atomic load otherwise
+    const AlertEngine& alert_engine = protocol_analyzer_ref->get_alert_engine();
+    uint64_t alert_version = alert_engine.get_version();
+    if (alert_version != panel_alert_version) {
+        panel_alert_version = alert_version;
+        SecurityAlert top;
+        panel_alert = alert_engine.get_top(top) ? top.text : std::string();
+    }
+    
     // device count
-    auto detected_devices = protocol_analyzer_ref->get_detected_devices();
     std::ostringstream device_count;
-    device_count << "Devices Found: " << detected_devices.size();
+    device_count << "Devices Found: " << panel_device_count;
     render_text(device_count.str(), MARGIN, panel_y + MARGIN/2 + TEXT_LINE_HEIGHT);
     
     // show last few detected protocols
     int x_offset = 250;
-    int max_display = 4;
     int displayed = 0;
     
-    for (const auto& device : detected_devices) {
-        if (displayed >= max_display) break;
-        
+    for (const auto& device : panel_devices) {
         std::ostringstream protocol_info;
-        protocol_info << protocol_analyzer_ref->get_protocol_name(device.protocol) 
+        protocol_info << device.name 
                       << " (" << std::fixed << std::setprecision(1) 
-                      << (device.signal.frequency / 1000000.0) << "MHz)";
+                      << (device.frequency / 1000000.0) << "MHz)";
         
         SDL_Color device_color = device.is_authorized ? 
             SDL_Color{100, 255, 100, 255} :  // green for authorized
@@ -424,63 +429,72 @@ void SDRGui::render_protocol_panel() {
     }
     
     // Security alerts with better positioning
-    auto alerts = protocol_analyzer_ref->get_security_alerts();
-    if (!alerts.empty()) {
+    if (!panel_alert.empty()) {
         render_text_colored("SECURITY ALERT!", 550, panel_y + MARGIN/2, SDL_Color{255, 50, 50, 255});
         
         // Show first alert
-        if (!alerts.empty()) {
-            std::string alert_text = alerts[0];
-            if (alert_text.length() > 50) {
-                alert_text = alert_text.substr(0, 47) + "...";
-            }
-            render_text_colored(alert_text, 550, panel_y + MARGIN/2 + TEXT_LINE_HEIGHT, SDL_Color{255, 150, 150, 255});
+        std::string alert_text = panel_alert;
+        if (alert_text.length() > 50) {
+            alert_text = alert_text.substr(0, 47) + "...";
         }
+        render_text_colored(alert_text, 550, panel_y + MARGIN/2 + TEXT_LINE_HEIGHT, SDL_Color{255, 150, 150, 255});
     }
 }
 
-std::vector<float> SDRGui::compute_fft_magnitude(const std::vector<std::complex<float>>& iq_data) {
-    std::vector<float> magnitudes;
-    
-    if (iq_data.empty() || !fft_in || !fft_out) {
-        return magnitudes;
-    }
-    
-    // Take a chunk of data for FFT
-    int samples_to_use = std::min((int)iq_data.size(), FFT_SIZE);
-    
-    // Copy I/Q data to FFT input buffer
-    for (int i = 0; i < samples_to_use; i++) {
-        fft_in[i][0] = iq_data[i].real();  // Real part
-        fft_in[i][1] = iq_data[i].imag();  // Imaginary part
+void SDRGui::update_metrics_lines() {
+    metrics_lines.clear();
+    char line[128];
+    if (pipeline_ref) {
+        metrics_lines.push_back("Stage        p50 / p99 us   queued");
+        for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+            PipelineStage stage = (PipelineStage)i;
+            const LatencyHistogram& latency = pipeline_ref->get_stage_latency(stage);
+            snprintf(line, sizeof(line), "%-12s %6.0f / %-6.0f %zu", pipeline_stage_name(stage),
+                     latency.percentile_us(0.5), latency.percentile_us(0.99), pipeline_ref->get_queue_depth(stage));
+            metrics_lines.push_back(line);
+        }
+        const LatencyHistogram& block_latency = pipeline_ref->get_block_latency();
+        snprintf(line, sizeof(line), "Block latency: %.1f / %.1f ms",
+                 block_latency.percentile_us(0.5) / 1e3, block_latency.percentile_us(0.99) / 1e3);
+        metrics_lines.push_back(line);
+        snprintf(line, sizeof(line), "Capture: %llu overruns, %llu KB lost, %llu torn",
+                 (unsigned long long)(sdr_ref ? sdr_ref->get_overrun_count() : 0),
+                 (unsigned long long)(pipeline_ref->get_input_dropped_bytes() / 1024),
+                 (unsigned long long)pipeline_ref->get_torn_blocks());
+        metrics_lines.push_back(line);
+    }
+    snprintf(line, sizeof(line), "Render: %.1f / %.1f ms",
+             render_latency.percentile_us(0.5) / 1e3, render_latency.percentile_us(0.99) / 1e3);
+    metrics_lines.push_back(line);
+    snprintf(line, sizeof(line), "Log lines dropped: %llu",
+             (unsigned long long)AsyncLog::instance().get_dropped_lines());
+    metrics_lines.push_back(line);
+    metrics_updated = std::chrono::steady_clock::now();
+}
+
+void SDRGui::render_metrics_overlay() {
+    auto now = std::chrono::steady_clock::now();
+    if (metrics_lines.empty() || now - metrics_updated >= std::chrono::milliseconds(METRICS_REFRESH_MS)) {
+        update_metrics_lines();
     }
     
-    // Zero-pad if needed
-    for (int i = samples_to_use; i < FFT_SIZE; i++) {
-        fft_in[i][0] = 0.0f;
-        fft_in[i][1] = 0.0f;
-    }
+    // dimmed box over the right side of the spectrum
+    const int width = 340;
+    SDL_Rect box = {WINDOW_WIDTH - width - MARGIN / 2, SPECTRUM_OFFSET, width,
+                    (int)metrics_lines.size() * TEXT_LINE_HEIGHT + MARGIN / 2};
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 200);
+    SDL_RenderFillRect(renderer, &box);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
     
-    // Execute FFT
-    fftwf_execute(fft_plan);
-    
-    // Calculate magnitude spectrum in dB
-    magnitudes.reserve(FFT_SIZE);
-    for (int i = 0; i < FFT_SIZE; i++) {
-        float real = fft_out[i][0];
-        float imag = fft_out[i][1];
-        float magnitude = std::sqrt(real * real + imag * imag);
-        float magnitude_db = 20.0f * std::log10(magnitude + 1e-10f);
-        magnitudes.push_back(magnitude_db);
+    for (size_t i = 0; i < metrics_lines.size(); i++) {
+        render_text_colored(metrics_lines[i], box.x + MARGIN / 3, box.y + MARGIN / 4 + (int)i * TEXT_LINE_HEIGHT,
+                            SDL_Color{200, 255, 200, 255});
     }
-    
-    return magnitudes;
 }
 
 void SDRGui::init_waterfall() {
-    // Initialize waterfall data buffer
-    waterfall_data.clear();
-    waterfall_data.reserve(WATERFALL_HISTORY);
+    waterfall_head = 0;
     
     // Create waterfall texture
     waterfall_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, 
@@ -492,9 +506,16 @@ void SDRGui::init_waterfall() {
         return;
     }
     
-    // Allocate pixel buffer
-    waterfall_pixels = new uint32_t[WINDOW_WIDTH * WATERFALL_HEIGHT];
-    memset(waterfall_pixels, 0, WINDOW_WIDTH * WATERFALL_HEIGHT * sizeof(uint32_t));
+    // Start out black, this is the only full texture upload
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(waterfall_texture, nullptr, &pixels, &pitch) == 0) {
+        for (int y = 0; y < WATERFALL_HEIGHT; y++) {
+            uint32_t* row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(pixels) + y * pitch);
+            std::fill(row, row + WINDOW_WIDTH, 0x000000FFu);
+        }
+        SDL_UnlockTexture(waterfall_texture);
+    }
 }
 
 void SDRGui::cleanup_waterfall() {
@@ -502,25 +523,27 @@ void SDRGui::cleanup_waterfall() {
         SDL_DestroyTexture(waterfall_texture);
         waterfall_texture = nullptr;
     }
-    
-    if (waterfall_pixels) {
-        delete[] waterfall_pixels;
-        waterfall_pixels = nullptr;
-    }
-    
-    waterfall_data.clear();
 }
 
 void SDRGui::update_waterfall_data(const std::vector<float>& fft_magnitudes) {
-    if (fft_magnitudes.empty()) return;
+    if (!waterfall_texture || fft_magnitudes.empty()) return;
+    
+    // Move the head up one row, overwriting the oldest line
+    waterfall_head = (waterfall_head + WATERFALL_HEIGHT - 1) % WATERFALL_HEIGHT;
     
-    // Add new line to waterfall data
-    waterfall_data.push_back(fft_magnitudes);
+    // Lock just that row and write the new line straight into the texture
+    SDL_Rect row_rect = {0, waterfall_head, WINDOW_WIDTH, 1};
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(waterfall_texture, &row_rect, &pixels, &pitch) != 0) return;
     
-    // Keep only the most recent history
-    if (waterfall_data.size() > WATERFALL_HISTORY) {
-        waterfall_data.erase(waterfall_data.begin());
+    uint32_t* row = static_cast<uint32_t*>(pixels);
+    for (int x = 0; x < WINDOW_WIDTH; x++) {
+        int fft_index = x * fft_magnitudes.size() / WINDOW_WIDTH;
+        row[x] = magnitude_to_color(fft_magnitudes[fft_index]);
     }
+    
+    SDL_UnlockTexture(waterfall_texture);
 }
 
 uint32_t SDRGui::magnitude_to_color(float magnitude_db) {
@@ -538,37 +561,19 @@ uint32_t SDRGui::magnitude_to_color(float magnitude_db) {
 }
 
 void SDRGui::render_waterfall() {
-    if (!waterfall_texture || !waterfall_pixels || waterfall_data.empty()) return;
+    if (!waterfall_texture) return;
     
-    // Shift existing pixels down
-    for (int y = WATERFALL_HEIGHT - 1; y > 0; y--) {
-        memcpy(&waterfall_pixels[y * WINDOW_WIDTH], 
-               &waterfall_pixels[(y - 1) * WINDOW_WIDTH], 
-               WINDOW_WIDTH * sizeof(uint32_t));
-    }
+    // Newest line is at waterfall_head, so draw head..bottom first, then
+    // wrap around and draw top..head underneath it
+    int upper_rows = WATERFALL_HEIGHT - waterfall_head;
     
-    // Add new line at top
-    const std::vector<float>& latest_fft = waterfall_data.back();
-    int top_row = 0;
+    SDL_Rect upper_src = {0, waterfall_head, WINDOW_WIDTH, upper_rows};
+    SDL_Rect upper_dst = {0, WATERFALL_OFFSET, WINDOW_WIDTH, upper_rows};
+    SDL_RenderCopy(renderer, waterfall_texture, &upper_src, &upper_dst);
     
-    for (int x = 0; x < WINDOW_WIDTH; x++) {
-        int fft_index = x * latest_fft.size() / WINDOW_WIDTH;
-        if (fft_index >= 0 && fft_index < (int)latest_fft.size()) {
-            waterfall_pixels[top_row + x] = magnitude_to_color(latest_fft[fft_index]);
-        } else {
-            waterfall_pixels[top_row + x] = 0xFF000000; // Black
-        }
-    }
-    
-    // Update texture
-    void* pixels;
-    int pitch;
-    if (SDL_LockTexture(waterfall_texture, nullptr, &pixels, &pitch) == 0) {
-        memcpy(pixels, waterfall_pixels, WINDOW_WIDTH * WATERFALL_HEIGHT * sizeof(uint32_t));
-        SDL_UnlockTexture(waterfall_texture);
+    if (waterfall_head > 0) {
+        SDL_Rect lower_src = {0, 0, WINDOW_WIDTH, waterfall_head};
+        SDL_Rect lower_dst = {0, WATERFALL_OFFSET + upper_rows, WINDOW_WIDTH, waterfall_head};
+        SDL_RenderCopy(renderer, waterfall_texture, &lower_src, &lower_dst);
     }
-    
-    // Render waterfall
-    SDL_Rect waterfall_rect = {0, WATERFALL_OFFSET, WINDOW_WIDTH, WATERFALL_HEIGHT};
-    SDL_RenderCopy(renderer, waterfall_texture, nullptr, &waterfall_rect);
 }
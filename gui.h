@@ -3,19 +3,25 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
-#include <fftw3.h>
 #include <vector>
 #include <complex>
 #include <string>
+#include <memory>
+#include <chrono>
+#include "text_cache.h"
+#include "protocol_types.h"
+#include "metrics.h"
 
 class SimpleSDR; // forward declaration
 class ProtocolAnalyzer; // forward declaration
+class Pipeline; // forward declaration
 
 class SDRGui {
 private:
     SDL_Window* window;
     SDL_Renderer* renderer;
     TTF_Font* font;
+    std::unique_ptr<TextCache> text_cache;
     bool running;
     
     // window size
@@ -51,17 +57,39 @@ private:
     
     SimpleSDR* sdr_ref;
     ProtocolAnalyzer* protocol_analyzer_ref;
+    Pipeline* pipeline_ref;
     
-    // fft stuff
-    static const int FFT_SIZE = 1024;
-    fftwf_complex *fft_in, *fft_out;
-    fftwf_plan fft_plan;
+    // spectrum frames come from the pipeline's shared engine, the gui only
+    // resamples the bins to the window width
+    std::vector<float> display_bins;
+    uint64_t last_spectrum_sequence;
+    bool have_spectrum;
     
-    // waterfall display
-    static const int WATERFALL_HISTORY = 300;
-    std::vector<std::vector<float>> waterfall_data;
+    // waterfall display, the texture is a circular buffer of rows. only the
+    // newest row is written and the scroll is done with two render copies.
     SDL_Texture* waterfall_texture;
-    uint32_t* waterfall_pixels;
+    int waterfall_head;        // texture row holding the newest line
+    
+    // what the protocol panel shows, refilled from the analyzer's device
+    // snapshot and alert engine only when they move instead of every frame
+    struct PanelDevice {
+        std::string name;
+        double frequency;
+        bool is_authorized;
+    };
+    std::vector<PanelDevice> panel_devices;
+    uint64_t panel_epoch;
+    size_t panel_device_count;
+    uint64_t panel_alert_version;
+    std::string panel_alert;   // most important active alert, empty if none
+    
+    // pipeline instrumentation overlay, toggled with i. the text is rebuilt
+    // a few times a second so changing numbers don't churn the text cache.
+    static const int METRICS_REFRESH_MS = 500;
+    bool show_metrics;
+    LatencyHistogram render_latency;   // gui thread only
+    std::vector<std::string> metrics_lines;
+    std::chrono::steady_clock::time_point metrics_updated;
     
 public:
     SDRGui();
@@ -77,6 +105,7 @@ public:
     
     void set_sdr_reference(SimpleSDR* sdr) { sdr_ref = sdr; }
     void set_protocol_analyzer_reference(ProtocolAnalyzer* analyzer) { protocol_analyzer_ref = analyzer; }
+    void set_pipeline_reference(Pipeline* pipeline) { pipeline_ref = pipeline; }
     
     // protocol scanning controls
     bool is_protocol_scanning_enabled() const { return protocol_scanning_enabled; }
@@ -93,18 +122,17 @@ public:
     void clear_gain_change() { gain_changed = false; }
     
 private:
-    void render_spectrum(const std::vector<std::complex<float>>& iq_data);
+    void render_spectrum(const std::vector<float>& fft_mag);
     void render_waterfall();
     void render_controls();
     void render_protocol_panel();
+    void render_metrics_overlay();
+    void update_metrics_lines();
     void render_text(const std::string& text, int x, int y);
     void render_text_colored(const std::string& text, int x, int y, SDL_Color color);
     void draw_grid();
     void handle_keyboard(SDL_Keycode key);
     
-    // fft for spectrum display
-    std::vector<float> compute_fft_magnitude(const std::vector<std::complex<float>>& iq_data);
-    
     // waterfall functions
     void update_waterfall_data(const std::vector<float>& fft_magnitudes);
     void init_waterfall();
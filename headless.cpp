@@ -0,0 +1,415 @@
+#include "sdr.h"
+#include "protocol_analyzer.h"
+#include "tuner_set.h"
+#include "detection_sink.h"
+#include "collector_sink.h"
+#include "iq_recorder.h"
+#include "async_log.h"
+#include "metrics.h"
+#include "task_pool.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <signal.h>
+#include <unistd.h>
+
+// capture and analysis without sdl, for sensors that have no display.
+// detections go to stdout and optionally a log file, udp datagrams and a
+// collector that takes batched binary records.
+
+static const int STATS_INTERVAL_S = 60;
+static const int METRICS_INTERVAL_S = 10;
+
+static std::atomic<bool> stop_requested(false);
+static TunerSet* tuners_instance = nullptr;
+
+static void signal_handler(int signal) {
+    (void)signal;
+    stop_requested = true;
+    if (tuners_instance) {
+        tuners_instance->request_stop();
+    }
+}
+
+// prometheus text format for node_exporter's textfile collector or anything
+// else that scrapes files. written next to path and renamed over it so a
+// scrape never sees half a file.
+static bool write_metrics(const std::string& path, TunerSet& tuners, const ProtocolAnalyzer& analyzer,
+                          const CollectorSink* collector) {
+    std::string temp_path = path + ".tmp";
+    std::ofstream out(temp_path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to write metrics to " << temp_path << "!" << std::endl;
+        return false;
+    }
+    
+    write_prometheus_header(out, "rfsec_stage_latency_seconds", "histogram",
+                            "Time a pipeline stage spends on one block, without queue waits.");
+    for (size_t i = 0; i < tuners.size(); i++) {
+        for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+            PipelineStage stage = (PipelineStage)s;
+            std::string labels = "tuner=\"" + std::to_string(i) + "\",stage=\"" + pipeline_stage_name(stage) + "\"";
+            write_prometheus_histogram(out, "rfsec_stage_latency_seconds", labels,
+                                       tuners[i].pipeline.get_stage_latency(stage));
+        }
+    }
+    write_prometheus_header(out, "rfsec_block_latency_seconds", "histogram",
+                            "Time from converting a block to recording its detections.");
+    for (size_t i = 0; i < tuners.size(); i++) {
+        write_prometheus_histogram(out, "rfsec_block_latency_seconds", "tuner=\"" + std::to_string(i) + "\"",
+                                   tuners[i].pipeline.get_block_latency());
+    }
+    write_prometheus_header(out, "rfsec_queue_depth", "gauge",
+                            "Blocks waiting in front of a pipeline stage.");
+    for (size_t i = 0; i < tuners.size(); i++) {
+        for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+            PipelineStage stage = (PipelineStage)s;
+            std::string labels = "tuner=\"" + std::to_string(i) + "\",stage=\"" + pipeline_stage_name(stage) + "\"";
+            write_prometheus_value(out, "rfsec_queue_depth", labels, (double)tuners[i].pipeline.get_queue_depth(stage));
+        }
+    }
+    
+    // per tuner counters
+    struct Counter {
+        const char* name;
+        const char* help;
+        uint64_t (*read)(Tuner& tuner);
+    };
+    static const Counter counters[] = {
+        {"rfsec_blocks_analyzed_total", "Blocks that went through every stage.",
+         [](Tuner& t) { return t.pipeline.get_blocks_analyzed(); }},
+        {"rfsec_samples_analyzed_total", "IQ samples that went through every stage.",
+         [](Tuner& t) { return t.pipeline.get_samples_analyzed(); }},
+        {"rfsec_capture_overruns_total", "Times a ring reader was lapped by the capture.",
+         [](Tuner& t) { return t.sdr.get_overrun_count(); }},
+        {"rfsec_input_dropped_bytes_total", "Capture bytes the pipeline lost to overruns.",
+         [](Tuner& t) { return t.pipeline.get_input_dropped_bytes(); }},
+        {"rfsec_torn_blocks_total", "Blocks overwritten while they were being converted.",
+         [](Tuner& t) { return t.pipeline.get_torn_blocks(); }},
+        {"rfsec_settle_dropped_bytes_total", "Capture bytes skipped while the tuner settled.",
+         [](Tuner& t) { return t.pipeline.get_settle_dropped_bytes(); }},
+        {"rfsec_event_dumps_total", "IQ dumps written around alerting detections.",
+         [](Tuner& t) { return t.events.get_dumps_written(); }},
+    };
+    for (const Counter& counter : counters) {
+        write_prometheus_header(out, counter.name, "counter", counter.help);
+        for (size_t i = 0; i < tuners.size(); i++) {
+            write_prometheus_value(out, counter.name, "tuner=\"" + std::to_string(i) + "\"",
+                                   (double)counter.read(tuners[i]));
+        }
+    }
+    
+    write_prometheus_header(out, "rfsec_devices_tracked", "gauge", "Devices in the device database.");
+    write_prometheus_value(out, "rfsec_devices_tracked", "", (double)analyzer.get_device_count());
+    const AlertEngine& alerts = analyzer.get_alert_engine();
+    write_prometheus_header(out, "rfsec_alerts_raised_total", "counter", "Security alerts raised.");
+    write_prometheus_value(out, "rfsec_alerts_raised_total", "", (double)alerts.get_raised_count());
+    write_prometheus_header(out, "rfsec_alerts_active", "gauge", "Security alerts not yet resolved.");
+    write_prometheus_value(out, "rfsec_alerts_active", "", (double)alerts.get_active_count());
+    write_prometheus_header(out, "rfsec_log_dropped_lines_total", "counter",
+                            "Console lines dropped because the log queue was full.");
+    write_prometheus_value(out, "rfsec_log_dropped_lines_total", "", (double)AsyncLog::instance().get_dropped_lines());
+    if (collector) {
+        write_prometheus_header(out, "rfsec_collector_records_sent_total", "counter",
+                                "Detection, device and spectrum records sent to the collector.");
+        write_prometheus_value(out, "rfsec_collector_records_sent_total", "", (double)collector->get_records_sent());
+        write_prometheus_header(out, "rfsec_collector_records_dropped_total", "counter",
+                                "Records dropped because the queue was full or a send failed.");
+        write_prometheus_value(out, "rfsec_collector_records_dropped_total", "", (double)collector->get_records_dropped());
+        write_prometheus_header(out, "rfsec_collector_batches_sent_total", "counter", "Batches sent to the collector.");
+        write_prometheus_value(out, "rfsec_collector_batches_sent_total", "", (double)collector->get_batches_sent());
+        write_prometheus_header(out, "rfsec_collector_connects_total", "counter", "Connections made to a tcp collector.");
+        write_prometheus_value(out, "rfsec_collector_connects_total", "", (double)collector->get_connects());
+        write_prometheus_header(out, "rfsec_collector_connected", "gauge", "Whether the collector can be sent to.");
+        write_prometheus_value(out, "rfsec_collector_connected", "", collector->is_connected() ? 1.0 : 0.0);
+    }
+    
+    out.close();
+    if (!out || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write metrics to " << path << "!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// alerts raised since cursor, returns the cursor to continue from
+static uint64_t print_alerts(const ProtocolAnalyzer& analyzer, uint64_t cursor, std::vector<SecurityAlert>& alerts) {
+    uint64_t missed = 0;
+    alerts.clear();
+    cursor = analyzer.get_alert_engine().read(cursor, alerts, AlertEngine::HISTORY_SIZE, &missed);
+    if (missed > 0) log_printf("ALERT %llu alerts lost, printing fell behind", (unsigned long long)missed);
+    for (const auto& alert : alerts) {
+        log_printf("ALERT [%s] %s", alert_severity_name(alert.severity), alert.text.c_str());
+    }
+    return cursor;
+}
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] [start frequency in Hz]" << std::endl
+              << "  -d <index or serial>   dongle to open, repeat for more (default 0)" << std::endl
+              << "  --log <path>           append detections to a log file" << std::endl
+              << "  --udp <host:port>      send every detection as a json datagram" << std::endl
+              << "  --collector <url>      stream batched binary records to udp://host:port or tcp://host:port" << std::endl
+              << "  --site <name>          sensor name in every collector batch (default the hostname)" << std::endl
+              << "  --collector-spectrum <ms>" << std::endl
+              << "                         also send every dongle's spectrum, decimated, every ms (default off)" << std::endl
+              << "  --json                 json lines on stdout and in the log" << std::endl
+              << "  --quiet                nothing on stdout" << std::endl
+              << "  --no-scan              stay on the start frequency" << std::endl
+              << "  --record <path>        record the first dongle's raw iq, sidecar in <path>.meta" << std::endl
+              << "  --replay <path>        analyze a recording instead of a dongle, then exit" << std::endl
+              << "  --fast                 replay as fast as the analyzer keeps up, reports MS/s" << std::endl
+              << "  --events <dir>         dump the iq around alerting detections into dir" << std::endl
+              << "  --pre-ms <ms>          event dump length before the event (default "
+              << EventCapture::DEFAULT_PRE_MS << ")" << std::endl
+              << "  --post-ms <ms>         event dump length after the event (default "
+              << EventCapture::DEFAULT_POST_MS << ")" << std::endl
+              << "  --history <seconds>    capture ring length, bounds --pre-ms (default about 4)" << std::endl
+              << "  --metrics <path>       pipeline metrics in prometheus text format, rewritten every "
+              << METRICS_INTERVAL_S << " s" << std::endl
+              << "  --signatures <path>    signature pack or directory of .sig packs, reloaded on change" << std::endl
+              << "  --devices <path>       keep the device database and the allowlist in path across restarts" << std::endl
+              << "  --dwell <MHz>=<ms>     time on each hop of the scan ranges covering MHz, repeat for more" << std::endl
+              << "                         (default 100 ms)" << std::endl
+              << "  --threads <n>          analysis worker threads, 0 keeps it on the pipeline threads" << std::endl
+              << "                         (default one less than the cores)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // sinks are declared before the tuners so no pipeline outlives them. the
+    // collector's sender reads the pipelines' spectra though, so once it is
+    // open every return stops it before the tuners go away
+    ProtocolAnalyzer analyzer;
+    LineSink stdout_sink;
+    LineSink log_sink;
+    UdpSink udp_sink;
+    CollectorSink collector;
+    TunerSet tuners;
+    IQRecorder recorder;
+    
+    std::vector<std::string> device_selectors;
+    std::vector<std::string> dwell_specs;
+    std::string record_path;
+    std::string replay_path;
+    bool fast_replay = false;
+    std::string event_directory;
+    uint32_t pre_ms = EventCapture::DEFAULT_PRE_MS;
+    uint32_t post_ms = EventCapture::DEFAULT_POST_MS;
+    double history_seconds = 0.0;
+    std::string log_path;
+    std::string udp_destination;
+    std::string collector_url;
+    std::string site_name;
+    int collector_spectrum_ms = 0;
+    std::string metrics_path;
+    std::string store_path;
+    std::string signature_path;
+    SinkFormat format = SinkFormat::TEXT;
+    bool quiet = false;
+    bool scan = true;
+    uint32_t start_frequency = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-d" && has_value) {
+            device_selectors.push_back(argv[++i]);
+        } else if (arg == "--log" && has_value) {
+            log_path = argv[++i];
+        } else if (arg == "--udp" && has_value) {
+            udp_destination = argv[++i];
+        } else if (arg == "--collector" && has_value) {
+            collector_url = argv[++i];
+        } else if (arg == "--site" && has_value) {
+            site_name = argv[++i];
+        } else if (arg == "--collector-spectrum" && has_value) {
+            collector_spectrum_ms = std::atoi(argv[++i]);
+        } else if (arg == "--json") {
+            format = SinkFormat::JSON;
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else if (arg == "--no-scan") {
+            scan = false;
+        } else if (arg == "--record" && has_value) {
+            record_path = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            replay_path = argv[++i];
+        } else if (arg == "--fast") {
+            fast_replay = true;
+        } else if (arg == "--events" && has_value) {
+            event_directory = argv[++i];
+        } else if (arg == "--pre-ms" && has_value) {
+            pre_ms = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--post-ms" && has_value) {
+            post_ms = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--history" && has_value) {
+            history_seconds = std::atof(argv[++i]);
+        } else if (arg == "--metrics" && has_value) {
+            metrics_path = argv[++i];
+        } else if (arg == "--signatures" && has_value) {
+            signature_path = argv[++i];
+        } else if (arg == "--devices" && has_value) {
+            store_path = argv[++i];
+        } else if (arg == "--dwell" && has_value) {
+            dwell_specs.push_back(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            TaskPool::configure(std::strtoul(argv[++i], nullptr, 10));
+        } else if (!arg.empty() && arg.find_first_not_of("0123456789") == std::string::npos) {
+            start_frequency = std::stoul(arg);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    bool replay = !replay_path.empty();
+    if (replay && (!device_selectors.empty() || !record_path.empty())) {
+        std::cerr << "--replay can't be combined with -d or --record" << std::endl;
+        return 1;
+    }
+    
+    tuners_instance = &tuners;
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    
+    // sinks first, a bad path or host should fail before the dongles are opened
+    if (!quiet) {
+        stdout_sink.set_format(format);
+        stdout_sink.open("-");
+        analyzer.add_detection_sink(&stdout_sink);
+    }
+    if (!log_path.empty()) {
+        log_sink.set_format(format);
+        if (!log_sink.open(log_path)) return 1;
+        analyzer.add_detection_sink(&log_sink);
+    }
+    if (!udp_destination.empty()) {
+        if (!udp_sink.open(udp_destination)) return 1;
+        analyzer.add_detection_sink(&udp_sink);
+    }
+    
+    // a recording brings its own tuning, the scan would only fight it
+    if (replay) {
+        if (!tuners.open_replay(replay_path, !fast_replay)) return 1;
+        scan = false;
+    } else if (!tuners.open(device_selectors)) {
+        return 1;
+    }
+    if (!analyzer.initialize()) {
+        std::cerr << "Failed to initialize Protocol Analyzer!" << std::endl;
+        return 1;
+    }
+    if (!signature_path.empty() && !analyzer.load_signature_packs(signature_path, true)) {
+        return 1;
+    }
+    if (!store_path.empty() && !analyzer.open_device_store(store_path)) {
+        return 1;
+    }
+    if (history_seconds > 0.0 && !tuners.set_history_seconds(history_seconds)) {
+        return 1;
+    }
+    tuners.connect(analyzer);
+    for (const auto& spec : dwell_specs) {
+        if (!tuners.set_range_dwell(analyzer, spec)) return 1;
+    }
+    if (!event_directory.empty() && !tuners.start_event_capture(analyzer, event_directory, pre_ms, post_ms)) {
+        return 1;
+    }
+    // after connect so the pipelines exist, before start so no detection is missed
+    if (!collector_url.empty()) {
+        if (site_name.empty()) {
+            char hostname[256] = {0};
+            gethostname(hostname, sizeof(hostname) - 1);
+            site_name = hostname;
+        }
+        collector.set_device_source(&analyzer);
+        collector.set_spectrum_interval_ms(collector_spectrum_ms);
+        for (size_t i = 0; i < tuners.size(); i++) collector.add_spectrum_source(&tuners[i].pipeline);
+        if (!collector.open(collector_url, site_name)) return 1;
+        analyzer.add_detection_sink(&collector);
+    }
+    
+    if (start_frequency) {
+        tuners.primary().sdr.set_frequency(start_frequency);
+    }
+    
+    // before the capture starts so the recording has its first bytes
+    if (!record_path.empty() && !recorder.start(&tuners.primary().sdr, record_path)) {
+        collector.stop();
+        return 1;
+    }
+    
+    if (!tuners.start()) {
+        collector.stop();
+        return 1;
+    }
+    auto started = std::chrono::steady_clock::now();
+    if (scan) {
+        analyzer.start_frequency_scan();
+        tuners.set_paused(false);
+    }
+    std::cerr << "Headless mode running, ctrl+c to stop" << std::endl;
+    
+    // nothing to pace here, the pipelines run at the capture rate on their
+    // own threads. wake up now and then to notice a stop and report health.
+    auto last_stats = std::chrono::steady_clock::now();
+    auto last_metrics = last_stats;
+    const CollectorSink* metrics_collector = collector_url.empty() ? nullptr : &collector;
+    uint64_t alert_cursor = 0;
+    std::vector<SecurityAlert> new_alerts;
+    while (!stop_requested) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (!quiet) alert_cursor = print_alerts(analyzer, alert_cursor, new_alerts);
+        if (replay && tuners.primary().pipeline.is_drained()) break;
+        
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_stats >= std::chrono::seconds(STATS_INTERVAL_S)) {
+            last_stats = now;
+            for (size_t i = 0; i < tuners.size(); i++) {
+                Tuner& tuner = tuners[i];
+                std::cerr << "Tuner " << i << ": " << tuner.pipeline.get_blocks_analyzed() << " blocks analyzed, "
+                          << tuner.sdr.get_overrun_count() << " overruns, "
+                          << tuner.pipeline.get_torn_blocks() << " torn blocks, "
+                          << tuner.events.get_dumps_written() << " event dumps" << std::endl;
+            }
+            std::cerr << "Devices tracked: " << analyzer.get_device_count() << std::endl;
+        }
+        if (!metrics_path.empty() && now - last_metrics >= std::chrono::seconds(METRICS_INTERVAL_S)) {
+            last_metrics = now;
+            write_metrics(metrics_path, tuners, analyzer, metrics_collector);
+        }
+    }
+    
+    std::cerr << "Shutting down..." << std::endl;
+    analyzer.stop_frequency_scan();
+    recorder.stop();
+    tuners.stop();
+    tuners_instance = nullptr;
+    // the last detections and the final device state, then the sender is gone
+    collector.stop();
+    if (!store_path.empty()) analyzer.save_device_store();
+    if (!quiet) print_alerts(analyzer, alert_cursor, new_alerts);
+    // final numbers, and every detection line out before the summary
+    if (!metrics_path.empty()) {
+        write_metrics(metrics_path, tuners, analyzer, metrics_collector);
+    }
+    AsyncLog::instance().flush();
+    
+    if (replay) {
+        // wall time from the first byte to the drained pipeline, what the
+        // analyzer sustains when nothing paces it
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        double samples = (double)tuners.primary().pipeline.get_samples_analyzed();
+        std::cerr << "Replay analyzed " << samples / 1e6 << " MS in " << elapsed << " s, "
+                  << (elapsed > 0.0 ? samples / elapsed / 1e6 : 0.0) << " MS/s" << std::endl;
+        std::cerr << "Devices tracked: " << analyzer.get_device_count() << std::endl;
+    }
+    
+    return 0;
+}
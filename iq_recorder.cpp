@@ -0,0 +1,110 @@
+#include "iq_recorder.h"
+#include "sdr.h"
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+static uint64_t wall_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+IQRecorder::IQRecorder() : sdr(nullptr), running(false), bytes_written(0) {
+}
+
+IQRecorder::~IQRecorder() {
+    stop();
+}
+
+bool IQRecorder::start(SimpleSDR* source_sdr, const std::string& path) {
+    if (running) return true;
+    
+    data_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!data_file) {
+        std::cerr << "Failed to open recording " << path << "!" << std::endl;
+        return false;
+    }
+    sidecar.open(sidecar_path(path), std::ios::trunc);
+    if (!sidecar) {
+        std::cerr << "Failed to open recording sidecar " << sidecar_path(path) << "!" << std::endl;
+        data_file.close();
+        return false;
+    }
+    
+    sdr = source_sdr;
+    sidecar << "format=u8iq" << std::endl
+            << "sample_rate=" << sdr->get_sample_rate() << std::endl
+            << "center_freq=" << sdr->get_center_freq() << std::endl
+            << "gain=" << sdr->get_gain() << std::endl
+            << "start_time_ms=" << wall_time_ms() << std::endl;
+            
+    reader = sdr->create_reader();
+    bytes_written = 0;
+    running = true;
+    worker = std::thread(&IQRecorder::record_loop, this);
+    
+    std::cout << "Recording to " << path << std::endl;
+    return true;
+}
+
+void IQRecorder::stop() {
+    if (!worker.joinable()) return;
+    
+    running = false;
+    worker.join();
+    
+    sidecar << "bytes=" << bytes_written << std::endl
+            << "dropped_bytes=" << reader->get_dropped_bytes() << std::endl
+            << "end_time_ms=" << wall_time_ms() << std::endl;
+    sidecar.close();
+    data_file.close();
+}
+
+void IQRecorder::record_loop() {
+    TuningSegment current;
+    bool have_tuning = false;
+    
+    while (running) {
+        uint64_t pos = reader->position();
+        TuningSegment tuning;
+        if (reader->available() == 0 || !sdr->find_tuning(pos, tuning)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        
+        const uint8_t* data;
+        size_t len = reader->acquire(data, CHUNK_BYTES);
+        if (reader->position() != pos) {
+            // lapped by the capture, the next tune line marks the gap
+            have_tuning = false;
+            continue;
+        }
+        // one tuning per write so every tune line lands on its first byte
+        if (tuning.end_byte != UINT64_MAX) {
+            len = (size_t)std::min<uint64_t>(len, tuning.end_byte - pos);
+        }
+        if (len == 0) continue;
+        
+        if (!have_tuning || tuning.center_freq != current.center_freq ||
+            tuning.sample_rate != current.sample_rate || tuning.start_byte != current.start_byte) {
+            current = tuning;
+            have_tuning = true;
+            uint64_t settle = tuning.start_byte > pos ? tuning.start_byte - pos : 0;
+            sidecar << "tune offset=" << bytes_written << " settle=" << settle
+                    << " center=" << tuning.center_freq << " rate=" << tuning.sample_rate
+                    << " time_ms=" << wall_time_ms() << std::endl;
+        }
+        
+        data_file.write(reinterpret_cast<const char*>(data), len);
+        bytes_written += len;
+        if (!reader->release(len)) {
+            // overwritten while being written out, what reached the file is torn
+            have_tuning = false;
+        }
+        if (!data_file) {
+            std::cerr << "WARNING: recording write failed, stopping." << std::endl;
+            running = false;
+        }
+    }
+    data_file.flush();
+}
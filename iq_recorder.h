@@ -0,0 +1,52 @@
+#ifndef IQ_RECORDER_H
+#define IQ_RECORDER_H
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <string>
+#include <fstream>
+#include "sample_ring.h"
+
+class SimpleSDR;
+
+// records a SimpleSDR's capture stream as raw u8 iq, exactly the bytes that
+// went through the ring. a text sidecar next to it (path + ".meta") holds
+// key=value lines:
+//   format=u8iq, sample_rate, center_freq, gain, start_time_ms at the top
+//   tune offset=<byte> settle=<bytes> center=<hz> rate=<hz> time_ms=<ms>
+//     for the tuning the recording starts under and every one after it
+//   bytes, dropped_bytes, end_time_ms once the recording is stopped
+// the recorder reads like any other consumer and never holds the capture
+// back, bytes lost to a slow disk are counted and followed by a fresh tune
+// line so a replay never runs a block across the gap.
+class IQRecorder {
+private:
+    SimpleSDR* sdr;
+    std::unique_ptr<SampleRingReader> reader;
+    std::ofstream data_file;
+    std::ofstream sidecar;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> bytes_written;
+    
+    static const size_t CHUNK_BYTES = 262144;
+    
+    void record_loop();
+    
+public:
+    IQRecorder();
+    ~IQRecorder();
+    
+    // records from the current capture position on
+    bool start(SimpleSDR* sdr, const std::string& path);
+    void stop();
+    bool is_recording() const { return running; }
+    
+    uint64_t get_bytes_written() const { return bytes_written; }
+    uint64_t get_dropped_bytes() const { return reader ? reader->get_dropped_bytes() : 0; }
+    
+    static std::string sidecar_path(const std::string& path) { return path + ".meta"; }
+};
+
+#endif // IQ_RECORDER_H
@@ -0,0 +1,236 @@
+#include "lora_detector.h"
+#include "fft_plan_cache.h"
+#include "task_pool.h"
+#include <cmath>
+#include <algorithm>
+
+const double LoRaDetector::BANDWIDTHS[LoRaDetector::BANDWIDTH_COUNT] = {125000.0, 250000.0, 500000.0};
+
+LoRaDetector::LoRaDetector() : sample_rate(0), history_end(0), history_count(0) {
+}
+
+LoRaDetector::~LoRaDetector() {
+    cleanup();
+}
+
+bool LoRaDetector::initialize() {
+    if (!work.empty()) return true;
+    
+    for (int sf = MIN_SF; sf <= MAX_SF; sf++) {
+        FFTWork fft;
+        fft.size = 1 << sf;
+        fft.in = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * fft.size);
+        fft.out = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * fft.size);
+        fft.plan = fft.in && fft.out ? FFTPlanCache::instance().get_plan(fft.size, FFTW_FORWARD, fft.in, fft.out) : nullptr;
+        work.push_back(fft);
+        if (!fft.plan) {
+            cleanup();
+            return false;
+        }
+    }
+    
+    history.assign(HISTORY_SAMPLES, std::complex<float>(0.0f, 0.0f));
+    baseband.resize(BANDWIDTH_COUNT);
+    return true;
+}
+
+void LoRaDetector::cleanup() {
+    // plans belong to the plan cache
+    for (auto& fft : work) {
+        if (fft.in) fftwf_free(fft.in);
+        if (fft.out) fftwf_free(fft.out);
+    }
+    work.clear();
+}
+
+void LoRaDetector::reset(double new_sample_rate) {
+    if (new_sample_rate != sample_rate) {
+        sample_rate = new_sample_rate;
+        build_references();
+    }
+    history_end = 0;
+    history_count = 0;
+    examined.clear();
+}
+
+void LoRaDetector::build_references() {
+    references.clear();
+    references.resize(SF_COUNT * BANDWIDTH_COUNT);
+    
+    for (int sf = MIN_SF; sf <= MAX_SF; sf++) {
+        const int n = 1 << sf;
+        for (int b = 0; b < BANDWIDTH_COUNT; b++) {
+            ChirpReference& reference = references[(sf - MIN_SF) * BANDWIDTH_COUNT + b];
+            const double bandwidth = BANDWIDTHS[b];
+            
+            // integrate and dump down to the slowest rate that still covers the
+            // chirp, so at 2.048 MS/s every bandwidth ends up 2.4 % oversampled
+            reference.decimation = std::max(1, (int)(sample_rate / bandwidth));
+            const double rate = sample_rate / reference.decimation;
+            const double symbol_time = n / bandwidth;
+            reference.symbol_samples = symbol_time * rate;
+            
+            // upchirp from -bw/2 to +bw/2 over one symbol, conjugated
+            reference.downchirp.resize(n);
+            for (int i = 0; i < n; i++) {
+                double t = i / rate;
+                double phase = 2.0 * M_PI * (-0.5 * bandwidth * t + 0.5 * bandwidth / symbol_time * t * t);
+                reference.downchirp[i] = std::complex<float>((float)std::cos(phase), (float)-std::sin(phase));
+            }
+        }
+    }
+}
+
+void LoRaDetector::append(const std::vector<std::complex<float>>& iq, uint64_t first_sample) {
+    if (history.empty()) return;
+    if (first_sample != history_end) {
+        history_count = 0;
+    }
+    
+    const size_t mask = HISTORY_SAMPLES - 1;
+    for (size_t i = 0; i < iq.size(); i++) {
+        history[(first_sample + i) & mask] = iq[i];
+    }
+    history_end = first_sample + iq.size();
+    history_count = std::min<uint64_t>((uint64_t)HISTORY_SAMPLES, history_count + iq.size());
+}
+
+bool LoRaDetector::is_candidate(const BurstEvent& burst, const DemodResult& demod) const {
+    if (work.empty() || references.empty()) return false;
+    if (demod.modulation == Modulation::OOK || burst.bandwidth < MIN_BURST_BANDWIDTH) return false;
+    
+    const double shortest = MIN_PREAMBLE_SYMBOLS * (1 << MIN_SF) / BANDWIDTHS[BANDWIDTH_COUNT - 1];
+    const double longest = MIN_PREAMBLE_SYMBOLS * (1 << MAX_SF) / BANDWIDTHS[0];
+    return burst.duration >= shortest && (burst.complete || burst.duration >= longest);
+}
+
+LoRaResult LoRaDetector::detect(const BurstEvent& burst, double center_frequency) {
+    for (const auto& entry : examined) {
+        double start_distance = std::abs((double)entry.start_sample - (double)burst.start_sample) / sample_rate;
+        if (start_distance <= EXAMINED_MATCH_S && std::abs(entry.frequency - burst.frequency) <= EXAMINED_MATCH_HZ) {
+            return entry.result;
+        }
+    }
+    
+    LoRaResult best = {false, 0, 0.0, 0, 0.0, 0.0};
+    
+    // the part of the burst that is still in the history
+    const uint64_t oldest = history_end - history_count;
+    const uint64_t start = std::max(burst.start_sample, oldest);
+    const uint64_t end = std::min(burst.end_sample, history_end);
+    
+    if (end > start + (1 << MIN_SF)) {
+        const size_t mask = HISTORY_SAMPLES - 1;
+        
+        // mix the burst to dc and decimate once per bandwidth, shared by every sf
+        const double step = -2.0 * M_PI * (burst.frequency - center_frequency) / sample_rate;
+        const std::complex<double> rotation(std::cos(step), std::sin(step));
+        segment.resize(end - start);
+        std::complex<double> oscillator(1.0, 0.0);
+        for (uint64_t i = start; i < end; i++) {
+            segment[i - start] = history[i & mask] * std::complex<float>(oscillator);
+            oscillator *= rotation;
+            if (((i - start) & 1023) == 0) oscillator /= std::abs(oscillator);
+        }
+        
+        for (int b = 0; b < BANDWIDTH_COUNT; b++) {
+            const int decimation = references[b].decimation;
+            std::vector<std::complex<float>>& out = baseband[b];
+            out.resize(segment.size() / decimation);
+            for (size_t m = 0; m < out.size(); m++) {
+                std::complex<float> sum(0.0f, 0.0f);
+                for (int k = 0; k < decimation; k++) {
+                    sum += segment[m * decimation + k];
+                }
+                out[m] = sum;
+            }
+        }
+        
+        // every spreading factor has its own fft work, they run side by side
+        // and are compared in sf order so ties always go the same way
+        LoRaResult searches[SF_COUNT];
+        TaskPool::instance().parallel_for(SF_COUNT, [&](size_t i) {
+            searches[i] = search_spreading_factor(MIN_SF + (int)i);
+        });
+        for (const LoRaResult& result : searches) {
+            if (!result.detected) continue;
+            if (!best.detected || result.preamble_symbols > best.preamble_symbols ||
+                (result.preamble_symbols == best.preamble_symbols && result.peak_ratio_db > best.peak_ratio_db)) {
+                best = result;
+            }
+        }
+    }
+    
+    examined.push_back({burst.start_sample, burst.frequency, best});
+    if (examined.size() > EXAMINED_HISTORY) examined.pop_front();
+    return best;
+}
+
+LoRaResult LoRaDetector::search_spreading_factor(int sf) {
+    LoRaResult best = {false, sf, 0.0, 0, 0.0, 0.0};
+    FFTWork& fft = work[sf - MIN_SF];
+    const int n = fft.size;
+    const float min_ratio = (float)std::pow(10.0, MIN_PEAK_RATIO_DB / 10.0);
+    
+    for (int b = 0; b < BANDWIDTH_COUNT; b++) {
+        const ChirpReference& reference = references[(sf - MIN_SF) * BANDWIDTH_COUNT + b];
+        const std::vector<std::complex<float>>& samples = baseband[b];
+        if (samples.size() < (size_t)n) continue;
+        
+        int windows = std::min((int)MAX_WINDOWS, (int)((samples.size() - n) / reference.symbol_samples) + 1);
+        int run = 0;
+        int previous_bin = -1;
+        double run_ratio = 0.0;
+        
+        for (int w = 0; w < windows; w++) {
+            const std::complex<float>* x = &samples[std::lround(w * reference.symbol_samples)];
+            for (int i = 0; i < n; i++) {
+                std::complex<float> v = x[i] * reference.downchirp[i];
+                fft.in[i][0] = v.real();
+                fft.in[i][1] = v.imag();
+            }
+            fftwf_execute_dft(fft.plan, fft.in, fft.out);
+            
+            int peak_bin = 0;
+            float peak = 0.0f;
+            double total = 0.0;
+            for (int i = 0; i < n; i++) {
+                float power = fft.out[i][0] * fft.out[i][0] + fft.out[i][1] * fft.out[i][1];
+                total += power;
+                if (power > peak) {
+                    peak = power;
+                    peak_bin = i;
+                }
+            }
+            float ratio = (float)(peak / std::max(1e-30, (total - peak) / (n - 1)));
+            
+            // a preamble keeps its tone in the same bin, give or take one for
+            // the frequency error drifting across a bin edge
+            int distance = std::abs(peak_bin - previous_bin);
+            distance = std::min(distance, n - distance);
+            if (ratio < min_ratio) {
+                run = 0;
+                previous_bin = -1;
+                continue;
+            }
+            if (previous_bin >= 0 && distance <= 1) {
+                run++;
+                run_ratio += ratio;
+            } else {
+                run = 1;
+                run_ratio = ratio;
+            }
+            previous_bin = peak_bin;
+            
+            if (run > best.preamble_symbols) {
+                best.preamble_symbols = run;
+                best.bandwidth = BANDWIDTHS[b];
+                best.peak_ratio_db = 10.0 * std::log10(run_ratio / run);
+            }
+        }
+    }
+    
+    best.detected = best.preamble_symbols >= MIN_PREAMBLE_SYMBOLS;
+    best.bit_rate = best.detected ? sf * best.bandwidth / (1 << sf) * 4.0 / 5.0 : 0.0;
+    return best;
+}
@@ -0,0 +1,102 @@
+#ifndef LORA_DETECTOR_H
+#define LORA_DETECTOR_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <deque>
+#include <fftw3.h>
+#include "burst_detector.h"
+#include "demodulator.h"
+
+// what the chirp detector found in one burst
+struct LoRaResult {
+    bool detected;
+    int spreading_factor;      // 7 - 12
+    double bandwidth;          // hz, 125, 250 or 500 kHz
+    int preamble_symbols;      // consecutive identical upchirps seen
+    double peak_ratio_db;      // dechirped tone over the mean fft bin
+    double bit_rate;           // at coding rate 4/5, the unit the lora signatures use
+};
+
+// css preamble detector. a lora preamble is a run of identical upchirps:
+// multiplied by the matching downchirp every symbol collapses into one tone,
+// so a 2^sf point fft shows the same sharp bin symbol after symbol. the
+// detector keeps a short full rate history, and for a candidate burst mixes
+// it to baseband, decimates it once per bandwidth and tries every spreading
+// factor against cached reference downchirps, one task pool job per sf.
+class LoRaDetector {
+private:
+    static const int MIN_SF = 7;
+    static const int MAX_SF = 12;
+    static const int SF_COUNT = MAX_SF - MIN_SF + 1;
+    static const int BANDWIDTH_COUNT = 3;
+    static const double BANDWIDTHS[BANDWIDTH_COUNT];
+    static const size_t HISTORY_SAMPLES = 1 << 19;    // 256 ms at 2.048 MS/s, > 4 sf12 symbols
+    static const int MIN_PREAMBLE_SYMBOLS = 4;
+    static const int MAX_WINDOWS = 12;                // preambles are 8 symbols plus sync
+    static constexpr double MIN_PEAK_RATIO_DB = 12.0; // noise alone peaks ~9 dB over the mean at 4096 bins
+    static constexpr double MIN_BURST_BANDWIDTH = 40000.0;
+    static constexpr double EXAMINED_MATCH_S = 1e-3;  // bursts starting this close are one transmission
+    static constexpr double EXAMINED_MATCH_HZ = 250000.0;
+    static const size_t EXAMINED_HISTORY = 16;
+    
+    // downchirp for one sf / bandwidth pair at the decimated rate fs / decimation,
+    // built once per sample rate
+    struct ChirpReference {
+        int decimation;
+        double symbol_samples;                     // at the decimated rate, not a whole number
+        std::vector<std::complex<float>> downchirp; // first 2^sf samples of a symbol
+    };
+    
+    // per sf fft buffers, each sf job owns one
+    struct FFTWork {
+        int size;
+        fftwf_complex* in;
+        fftwf_complex* out;
+        fftwf_plan plan;
+    };
+    
+    struct Examined {
+        uint64_t start_sample;
+        double frequency;
+        LoRaResult result;
+    };
+    
+    double sample_rate;
+    std::vector<ChirpReference> references;        // [sf - MIN_SF][bandwidth]
+    std::vector<FFTWork> work;                     // [sf - MIN_SF]
+    
+    std::vector<std::complex<float>> history;      // ring of the newest full rate samples
+    uint64_t history_end;                          // capture sample one past the newest
+    uint64_t history_count;
+    
+    std::vector<std::complex<float>> segment;
+    std::vector<std::vector<std::complex<float>>> baseband; // [bandwidth], decimated
+    std::deque<Examined> examined;
+    
+    void build_references();
+    void cleanup();
+    LoRaResult search_spreading_factor(int sf);
+    
+public:
+    LoRaDetector();
+    ~LoRaDetector();
+    
+    bool initialize();
+    // rebuilds the reference chirps if the rate changed, clears the history
+    void reset(double new_sample_rate);
+    
+    // full rate samples, contiguous with the previous call
+    void append(const std::vector<std::complex<float>>& iq, uint64_t first_sample);
+    
+    // constant envelope, wide enough, and either over or long enough for an
+    // sf12 preamble so a burst still on air isn't searched every block
+    bool is_candidate(const BurstEvent& burst, const DemodResult& demod) const;
+    
+    // search the burst's samples for a preamble. a burst that was already
+    // examined (or a neighbouring channel's view of it) gets the cached result.
+    LoRaResult detect(const BurstEvent& burst, double center_frequency);
+};
+
+#endif // LORA_DETECTOR_H
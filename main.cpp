@@ -1,18 +1,22 @@
 #include "sdr.h"
 #include "gui.h"
 #include "protocol_analyzer.h"
+#include "tuner_set.h"
+#include "task_pool.h"
 #include <iostream>
+#include <string>
+#include <vector>
 #include <signal.h>
 
 // globals for signal handler cleanup
-SimpleSDR* sdr_instance = nullptr;
+TunerSet* tuners_instance = nullptr;
 SDRGui* gui_instance = nullptr;
 ProtocolAnalyzer* analyzer_instance = nullptr;
 
 void signal_handler(int signal) {
     std::cout << "\nReceived signal " << signal << ", stopping..." << std::endl;
-    if (sdr_instance) {
-        sdr_instance->stop();
+    if (tuners_instance) {
+        tuners_instance->request_stop();
     }
     if (analyzer_instance) {
         analyzer_instance->stop_frequency_scan();
@@ -20,11 +24,44 @@ void signal_handler(int signal) {
 }
 
 int main(int argc, char* argv[]) {
-    SimpleSDR sdr;
     SDRGui gui;
     ProtocolAnalyzer analyzer;
+    TunerSet tuners;
     
-    sdr_instance = &sdr;
+    // -d <index or serial> once per dongle, the first dongle if none is given.
+    // --replay <path> plays a recording in real time instead. a bare number
+    // is the start frequency of the first dongle. --threads <n> sizes the
+    // analysis pool, 0 keeps the work on the pipeline threads. --devices
+    // <path> keeps the device database and the allowlist across restarts,
+    // --signatures <path> adds signature packs and reloads them on change.
+    // --dwell <MHz>=<ms> sets the time per hop of the scan ranges covering
+    // MHz, once per range.
+    std::vector<std::string> device_selectors;
+    std::vector<std::string> dwell_specs;
+    std::string replay_path;
+    std::string store_path;
+    std::string signature_path;
+    uint32_t start_frequency = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-d" && i + 1 < argc) {
+            device_selectors.push_back(argv[++i]);
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (arg == "--signatures" && i + 1 < argc) {
+            signature_path = argv[++i];
+        } else if (arg == "--devices" && i + 1 < argc) {
+            store_path = argv[++i];
+        } else if (arg == "--dwell" && i + 1 < argc) {
+            dwell_specs.push_back(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            TaskPool::configure(std::stoul(argv[++i]));
+        } else {
+            start_frequency = std::stoul(arg);
+        }
+    }
+    
+    tuners_instance = &tuners;
     gui_instance = &gui;
     analyzer_instance = &analyzer;
     
@@ -35,40 +72,56 @@ int main(int argc, char* argv[]) {
     // gui needs to start first
     if (!gui.initialize()) {
         std::cerr << "Failed to initialize GUI!" << std::endl;
+        std::cerr << "Use simple_sdr_headless on machines without a display." << std::endl;
         return 1;
     }
     
     // setup the sdr hardware
-    if (!sdr.initialize()) {
-        std::cerr << "Failed to initialize SDR!" << std::endl;
+    bool opened = replay_path.empty() ? tuners.open(device_selectors) : tuners.open_replay(replay_path, true);
+    if (!opened) {
         return 1;
     }
+    SimpleSDR& sdr = tuners.primary().sdr;
     
     // start protocol detection
     if (!analyzer.initialize()) {
         std::cerr << "Failed to initialize Protocol Analyzer!" << std::endl;
         return 1;
     }
+    if (!signature_path.empty() && !analyzer.load_signature_packs(signature_path, true)) {
+        return 1;
+    }
+    if (!store_path.empty() && !analyzer.open_device_store(store_path)) {
+        return 1;
+    }
     
-    // wire everything together
+    // wire everything together, the gui follows the first dongle
     gui.set_sdr_reference(&sdr);
     gui.set_protocol_analyzer_reference(&analyzer);
-    sdr.set_protocol_analyzer(&analyzer);
-    analyzer.set_sdr_reference(&sdr);
+    gui.set_pipeline_reference(&tuners.primary().pipeline);
+    tuners.connect(analyzer);
+    for (const auto& spec : dwell_specs) {
+        if (!tuners.set_range_dwell(analyzer, spec)) return 1;
+    }
     
     // tune to frequency from command line if given
-    if (argc > 1) {
-        uint32_t freq = std::stoul(argv[1]);
-        sdr.set_frequency(freq);
+    if (start_frequency) {
+        sdr.set_frequency(start_frequency);
     }
     
     std::cout << "Starting GUI mode with Protocol Analysis..." << std::endl;
     std::cout << "Controls: ↑↓ (±100kHz) ←→ (±1MHz) +/- (gain) Q/ESC (quit)" << std::endl;
     std::cout << "Protocol Scanner: S (start/stop scan) P (pause) M (manual control)" << std::endl;
     
+    // capture and analysis run on their own threads from here on, one
+    // capture thread and pipeline per dongle
+    if (!tuners.start()) {
+        return 1;
+    }
+    
     // user controls when to start scanning
     
-    // main loop
+    // main loop, only events and drawing happen here
     while (gui.is_running()) {
         // process keyboard/mouse input
         gui.handle_events();
@@ -80,20 +133,12 @@ int main(int argc, char* argv[]) {
         }
         
         if (gui.should_update_gain()) {
-            sdr.set_gain(gui.get_target_gain());
+            tuners.set_gain(gui.get_target_gain());
             gui.clear_gain_change();
         }
         
-        // grab samples from the radio
-        sdr.read_samples_async();
-        
-        // advance protocol scanning if it's running
-        if (gui.is_protocol_scanning_enabled() && !gui.is_protocol_scanning_paused() && analyzer.is_scanning()) {
-            static int scan_counter = 0;
-            if (++scan_counter % 10 == 0) { // scan update every ~0.16 seconds
-                analyzer.update_scan();
-            }
-        }
+        // the scheduler threads advance the scan, they only need to know if they may
+        tuners.set_paused(!gui.is_protocol_scanning_enabled() || gui.is_protocol_scanning_paused());
         
         // draw the display
         gui.update();
@@ -104,7 +149,9 @@ int main(int argc, char* argv[]) {
     }
     
     std::cout << "Shutting down..." << std::endl;
-    sdr.stop();
+    tuners.stop();
+    tuners_instance = nullptr;
+    if (!store_path.empty()) analyzer.save_device_store();
     
     return 0;
 }
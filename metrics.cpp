@@ -0,0 +1,73 @@
+#include "metrics.h"
+#include <cmath>
+#include <limits>
+
+LatencyHistogram::LatencyHistogram() : total_count(0), total_ns(0), longest_ns(0) {
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    // index is the bit length of the whole microseconds
+    uint64_t us = ns / 1000;
+    int index = 0;
+    while (us && index < BUCKET_COUNT - 1) {
+        us >>= 1;
+        index++;
+    }
+    
+    // single writer, a plain store can't lose an increment
+    buckets[index].store(buckets[index].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    total_ns.store(total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > longest_ns.load(std::memory_order_relaxed)) {
+        longest_ns.store(ns, std::memory_order_relaxed);
+    }
+    total_count.store(total_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile_us(double fraction) const {
+    uint64_t total = count();
+    if (total == 0) return 0.0;
+    
+    uint64_t target = (uint64_t)std::ceil(fraction * total);
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT - 1; i++) {
+        seen += bucket(i);
+        if (seen >= target) return bucket_bound_us(i);
+    }
+    return max_us();
+}
+
+double LatencyHistogram::bucket_bound_us(int index) {
+    if (index >= BUCKET_COUNT - 1) return std::numeric_limits<double>::infinity();
+    return (double)(1ULL << index);
+}
+
+void write_prometheus_header(std::ostream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " " << type << "\n";
+}
+
+void write_prometheus_value(std::ostream& out, const char* name, const std::string& labels, double value) {
+    out << name;
+    if (!labels.empty()) out << "{" << labels << "}";
+    out << " " << value << "\n";
+}
+
+void write_prometheus_histogram(std::ostream& out, const char* name, const std::string& labels,
+                                const LatencyHistogram& histogram) {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    
+    // buckets are cumulative in prometheus, and +Inf must equal _count
+    uint64_t cumulative = 0;
+    for (int i = 0; i < LatencyHistogram::BUCKET_COUNT - 1; i++) {
+        cumulative += histogram.bucket(i);
+        out << name << "_bucket{" << prefix << "le=\"" << LatencyHistogram::bucket_bound_us(i) * 1e-6
+            << "\"} " << cumulative << "\n";
+    }
+    cumulative += histogram.bucket(LatencyHistogram::BUCKET_COUNT - 1);
+    out << name << "_bucket{" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+    write_prometheus_value(out, (std::string(name) + "_sum").c_str(), labels, histogram.sum_seconds());
+    write_prometheus_value(out, (std::string(name) + "_count").c_str(), labels, (double)cumulative);
+}
@@ -0,0 +1,57 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// latency histogram with power of two microsecond buckets, bucket i counts
+// values below 2^i us and the last one everything longer. every histogram
+// has exactly one writer thread (its stage), so record() is relaxed loads
+// and stores with no lock and no read-modify-write. readers on other threads
+// may see a count one sample ahead of the buckets, which is fine for stats.
+class LatencyHistogram {
+public:
+    static const int BUCKET_COUNT = 24;   // the last finite bound is about 4 s
+    
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> total_count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> longest_ns;
+    
+public:
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+    
+    // writer thread only
+    void record(uint64_t ns);
+    void record_since(std::chrono::steady_clock::time_point start) {
+        record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    
+    uint64_t count() const { return total_count.load(std::memory_order_relaxed); }
+    uint64_t bucket(int index) const { return buckets[index].load(std::memory_order_relaxed); }
+    double sum_seconds() const { return total_ns.load(std::memory_order_relaxed) * 1e-9; }
+    double max_us() const { return longest_ns.load(std::memory_order_relaxed) * 1e-3; }
+    // upper bound of the bucket the fraction falls into, 0 when empty
+    double percentile_us(double fraction) const;
+    
+    // exclusive upper bound of a bucket, infinite for the last one
+    static double bucket_bound_us(int index);
+};
+
+// prometheus text exposition format. write the header of a metric family
+// once, then every labelled sample of it. labels are `key="value",...`
+// without the braces, empty for none.
+void write_prometheus_header(std::ostream& out, const char* name, const char* type, const char* help);
+void write_prometheus_value(std::ostream& out, const char* name, const std::string& labels, double value);
+// _bucket, _sum and _count series in seconds
+void write_prometheus_histogram(std::ostream& out, const char* name, const std::string& labels,
+                                const LatencyHistogram& histogram);
+
+#endif // METRICS_H
@@ -0,0 +1,429 @@
+#include "pipeline.h"
+#include "sdr.h"
+#include "sample_ring.h"
+#include "scan_scheduler.h"
+#include "event_capture.h"
+#include "task_pool.h"
+#include <iostream>
+#include <algorithm>
+
+const char* pipeline_stage_name(PipelineStage stage) {
+    switch (stage) {
+        case PipelineStage::CONVERT: return "convert";
+        case PipelineStage::SPECTRUM: return "spectrum";
+        case PipelineStage::CHANNELIZE: return "channelize";
+        case PipelineStage::DETECT: return "detect";
+        case PipelineStage::CLASSIFY: return "classify";
+        case PipelineStage::DATABASE: return "database";
+    }
+    return "unknown";
+}
+
+void PipelineBlock::recycle() {
+    spectrum.reset();
+    bursts.clear();
+    demods.clear();
+    peaks.clear();
+    detections.clear();
+}
+
+// keep retrying while the pipeline runs, a full queue means the next stage is behind
+static bool forward(BoundedQueue<BlockPtr>& queue, BlockPtr& block, const std::atomic<bool>& running) {
+    while (running) {
+        if (queue.push(std::move(block))) return true;
+    }
+    return false;
+}
+
+Pipeline::Pipeline() : sdr_ref(nullptr), analyzer_ref(nullptr), scheduler_ref(nullptr), event_capture_ref(nullptr),
+                       spectrum_queue(QUEUE_DEPTH), channelize_queue(QUEUE_DEPTH), detect_queue(QUEUE_DEPTH),
+                       classify_queue(QUEUE_DEPTH), database_queue(QUEUE_DEPTH), free_blocks(BLOCK_POOL_SIZE),
+                       running(false), input_position(0), blocks_converted(0), blocks_analyzed(0),
+                       samples_analyzed(0), torn_blocks(0), settle_dropped_bytes(0), input_dropped_bytes(0) {
+}
+
+Pipeline::~Pipeline() {
+    stop();
+}
+
+bool Pipeline::start() {
+    if (running) return true;
+    if (!sdr_ref || !analyzer_ref) {
+        std::cerr << "Pipeline needs SDR and analyzer references!" << std::endl;
+        return false;
+    }
+    // sized to match what the analyzer's thresholds were tuned for
+    if (!spectrum_engine) {
+        spectrum_engine.reset(new SpectrumEngine(analyzer_ref->get_detection_fft_size()));
+    }
+    if (!spectrum_engine->initialize()) {
+        std::cerr << "Pipeline spectrum engine setup failed!" << std::endl;
+        return false;
+    }
+    if (!channelizer) {
+        channelizer.reset(new PolyphaseChannelizer(CHANNEL_COUNT));
+    }
+    if (!channelizer->initialize()) {
+        std::cerr << "Pipeline channelizer setup failed!" << std::endl;
+        return false;
+    }
+    if (!lora_detector) {
+        lora_detector.reset(new LoRaDetector());
+    }
+    if (!lora_detector->initialize()) {
+        std::cerr << "Pipeline LoRa detector setup failed!" << std::endl;
+        return false;
+    }
+    burst_detectors.clear();
+    for (int k = 0; k < CHANNEL_COUNT; k++) {
+        burst_detectors.push_back(BurstDetector(k));
+    }
+    // gated, a replay source waits for this stage instead of lapping it
+    input_reader = sdr_ref->create_reader(true);
+    input_position = input_reader->position();
+    if (!sdr_ref->is_capturing() && !sdr_ref->start_capture()) {
+        return false;
+    }
+    
+    spectrum_queue.reset();
+    channelize_queue.reset();
+    detect_queue.reset();
+    classify_queue.reset();
+    database_queue.reset();
+    free_blocks.reset();
+    
+    running = true;
+    workers.emplace_back(&Pipeline::convert_stage, this);
+    workers.emplace_back(&Pipeline::spectrum_stage, this);
+    workers.emplace_back(&Pipeline::channelize_stage, this);
+    workers.emplace_back(&Pipeline::detect_stage, this);
+    workers.emplace_back(&Pipeline::classify_stage, this);
+    workers.emplace_back(&Pipeline::database_stage, this);
+    
+    std::cout << "Pipeline started with " << workers.size() << " stages" << std::endl;
+    return true;
+}
+
+void Pipeline::stop() {
+    if (!running && workers.empty()) return;
+    
+    running = false;
+    spectrum_queue.close();
+    channelize_queue.close();
+    detect_queue.close();
+    classify_queue.close();
+    database_queue.close();
+    free_blocks.close();
+    
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+}
+
+bool Pipeline::is_drained() const {
+    if (!sdr_ref || sdr_ref->is_capturing() || !input_reader) return false;
+    // whatever is left is shorter than a block and never will be converted
+    uint64_t pending = sdr_ref->get_captured_bytes() - input_position;
+    return pending < BLOCK_BYTES && blocks_analyzed == blocks_converted;
+}
+
+size_t Pipeline::get_queue_depth(PipelineStage stage) const {
+    switch (stage) {
+        case PipelineStage::CONVERT:
+            return sdr_ref && input_reader ? (size_t)((sdr_ref->get_captured_bytes() - input_position) / BLOCK_BYTES) : 0;
+        case PipelineStage::SPECTRUM: return spectrum_queue.size();
+        case PipelineStage::CHANNELIZE: return channelize_queue.size();
+        case PipelineStage::DETECT: return detect_queue.size();
+        case PipelineStage::CLASSIFY: return classify_queue.size();
+        case PipelineStage::DATABASE: return database_queue.size();
+    }
+    return 0;
+}
+
+void Pipeline::convert_stage() {
+    SampleRingReader* reader = input_reader.get();
+    std::vector<uint8_t> scratch(BLOCK_BYTES);
+    uint64_t sequence = 0;
+    
+    while (running) {
+        input_position = reader->position();
+        input_dropped_bytes = reader->get_dropped_bytes();
+        if (reader->available() < BLOCK_BYTES) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        
+        // blocks are tagged with the tuning they were recorded under, which
+        // is not necessarily the current one when we are lagging behind
+        TuningSegment tuning;
+        uint64_t pos = reader->position();
+        if (!sdr_ref->find_tuning(pos, tuning)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        if (pos < tuning.start_byte) {
+            // pll settling or samples still in flight from the last tuning
+            settle_dropped_bytes += reader->skip(tuning.start_byte - pos);
+            continue;
+        }
+        if (pos + BLOCK_BYTES > tuning.end_byte) {
+            // tail of a dwell too short for a whole block
+            settle_dropped_bytes += reader->skip(tuning.end_byte - pos);
+            continue;
+        }
+        
+        auto started = std::chrono::steady_clock::now();
+        // a recycled block when there is one, new ones only until the pool has filled
+        BlockPtr block;
+        if (!free_blocks.pop(block, std::chrono::milliseconds(0))) {
+            block.reset(new PipelineBlock());
+        }
+        block->first_sample = pos / 2;
+        block->center_freq = tuning.center_freq;
+        block->sample_rate = tuning.sample_rate;
+        block->capture_time = std::chrono::steady_clock::now();
+        block->noise_floor = 0.0;
+        block->channel_rate = 0;
+        
+        const uint8_t* data;
+        size_t len = reader->acquire(data, BLOCK_BYTES);
+        if (len < BLOCK_BYTES) {
+            // block wraps around the end of the ring, take the copying path
+            len = reader->read(scratch.data(), BLOCK_BYTES);
+            sdr_ref->convert_samples(scratch.data(), len, block->iq);
+        } else {
+            sdr_ref->convert_samples(data, len, block->iq);
+            if (!reader->release(len)) {
+                // producer lapped us while converting
+                torn_blocks++;
+                block->recycle();
+                free_blocks.try_push(std::move(block));
+                continue;
+            }
+        }
+        
+        block->sequence = sequence++;
+        blocks_converted++;
+        stage_latency[(int)PipelineStage::CONVERT].record_since(started);
+        forward(spectrum_queue, block, running);
+    }
+}
+
+void Pipeline::spectrum_stage() {
+    BlockPtr block;
+    while (running) {
+        if (!spectrum_queue.pop(block)) continue;
+        auto started = std::chrono::steady_clock::now();
+        
+        // a frame only the pool holds has been let go by the gui and every block
+        std::shared_ptr<SpectrumFrame> frame;
+        for (const auto& pooled : frame_pool) {
+            if (pooled.use_count() == 1) {
+                frame = pooled;
+                break;
+            }
+        }
+        if (frame) {
+            // the last reader dropped it on another thread, see its reads before we write
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } else {
+            frame.reset(new SpectrumFrame());
+            frame_pool.push_back(frame);
+        }
+        frame->sequence = block->sequence;
+        frame->center_freq = block->center_freq;
+        frame->sample_rate = block->sample_rate;
+        frame->capture_time = block->capture_time;
+        spectrum_engine->compute(block->iq, *frame);
+        
+        // the gui and the detector see the very same frame
+        spectrum_engine->publish(frame);
+        block->spectrum = frame;
+        stage_latency[(int)PipelineStage::SPECTRUM].record_since(started);
+        forward(channelize_queue, block, running);
+    }
+}
+
+void Pipeline::channelize_stage() {
+    BlockPtr block;
+    uint64_t next_sample = 0;
+    uint32_t last_center = 0;
+    
+    // the previous block's channel output is kept so a burst that started
+    // there can still be demodulated as one segment
+    std::vector<std::vector<std::complex<float>>> lookback(CHANNEL_COUNT);
+    
+    // channels and bursts are worked on in the pool, each job gets its own
+    // scratch and the results are merged in channel and burst order
+    TaskPool& task_pool = TaskPool::instance();
+    std::vector<std::vector<BurstEvent>> channel_bursts(CHANNEL_COUNT);
+    std::vector<Demodulator> demodulators;
+    std::vector<std::vector<std::complex<float>>> segments;
+    uint64_t channel_origin = 0;       // capture sample of channel output 0
+    uint64_t channel_position = 0;     // channel outputs before this block
+    
+    while (running) {
+        if (!channelize_queue.pop(block)) continue;
+        auto started = std::chrono::steady_clock::now();
+        
+        // the filterbank carries state across blocks, start over whenever the
+        // stream has a gap (settle, overrun, torn block) or was retuned
+        if (block->first_sample != next_sample || block->center_freq != last_center) {
+            channelizer->reset();
+            
+            // channel output n appears once input first_sample + (n + 1) * M - 1
+            // is in, and shows what entered group_delay samples before that
+            int64_t origin = (int64_t)block->first_sample + CHANNEL_COUNT - 1 - channelizer->get_group_delay();
+            for (int k = 0; k < CHANNEL_COUNT; k++) {
+                BurstStream stream;
+                stream.first_sample = (uint64_t)std::max<int64_t>(0, origin);
+                stream.decimation = CHANNEL_COUNT;
+                stream.sample_rate = (double)block->sample_rate / CHANNEL_COUNT;
+                stream.center_frequency = block->center_freq + channelizer->channel_offset(k, block->sample_rate);
+                burst_detectors[k].reset(stream);
+                lookback[k].clear();
+            }
+            channel_origin = (uint64_t)std::max<int64_t>(0, origin);
+            channel_position = 0;
+            lora_detector->reset(block->sample_rate);
+        }
+        next_sample = block->first_sample + block->iq.size();
+        last_center = block->center_freq;
+        
+        channelizer->process(block->iq, block->channels);
+        block->channel_rate = block->sample_rate / CHANNEL_COUNT;
+        
+        // bursts that ended in this block, then the ones still on air
+        task_pool.parallel_for(CHANNEL_COUNT, [&](size_t k) {
+            const std::vector<std::complex<float>>& channel = block->channels[k];
+            channel_bursts[k].clear();
+            burst_detectors[k].process(channel.data(), channel.size(), channel_bursts[k]);
+        });
+        for (int k = 0; k < CHANNEL_COUNT; k++) {
+            block->bursts.insert(block->bursts.end(), channel_bursts[k].begin(), channel_bursts[k].end());
+        }
+        for (int k = 0; k < CHANNEL_COUNT; k++) {
+            BurstEvent active;
+            if (burst_detectors[k].active_burst(active)) {
+                block->bursts.push_back(active);
+            }
+        }
+        
+        // scratch only grows, once the busiest block so far has been seen
+        // nothing here allocates
+        const size_t burst_count = block->bursts.size();
+        if (demodulators.size() < burst_count) {
+            demodulators.resize(burst_count);
+            segments.resize(burst_count);
+        }
+        block->demods.resize(burst_count);
+        task_pool.parallel_for(burst_count, [&](size_t b) {
+            const BurstEvent& burst = block->bursts[b];
+            const std::vector<std::complex<float>>& previous = lookback[burst.channel];
+            const std::vector<std::complex<float>>& current = block->channels[burst.channel];
+            
+            // burst position in the lookback + current channel samples,
+            // clipped to what is still there
+            const uint64_t window_start = channel_position - previous.size();
+            const uint64_t window_end = channel_position + current.size();
+            uint64_t start = burst.start_sample > channel_origin ? (burst.start_sample - channel_origin) / CHANNEL_COUNT : 0;
+            uint64_t end = burst.end_sample > channel_origin ? (burst.end_sample - channel_origin) / CHANNEL_COUNT : 0;
+            start = std::max(start, window_start);
+            end = std::min(end, window_end);
+            
+            std::vector<std::complex<float>>& segment = segments[b];
+            segment.clear();
+            for (uint64_t i = start; i < end; i++) {
+                segment.push_back(i < channel_position ? previous[i - window_start] : current[i - channel_position]);
+            }
+            block->demods[b] = demodulators[b].demodulate(segment.data(), segment.size(), block->channel_rate);
+        });
+        for (int k = 0; k < CHANNEL_COUNT; k++) {
+            lookback[k] = block->channels[k];
+        }
+        
+        // lora preambles are too long and too wide for the channel samples,
+        // they are searched for in the full rate history
+        lora_detector->append(block->iq, block->first_sample);
+        for (size_t i = 0; i < block->bursts.size(); i++) {
+            if (!lora_detector->is_candidate(block->bursts[i], block->demods[i])) continue;
+            LoRaResult lora = lora_detector->detect(block->bursts[i], block->center_freq);
+            if (lora.detected) {
+                DemodResult& demod = block->demods[i];
+                demod.valid = true;
+                demod.modulation = Modulation::LORA_CSS;
+                demod.symbol_rate = lora.bit_rate;
+                demod.spreading_factor = lora.spreading_factor;
+            }
+        }
+        channel_position += block->channels[0].size();
+        stage_latency[(int)PipelineStage::CHANNELIZE].record_since(started);
+        forward(detect_queue, block, running);
+    }
+}
+
+void Pipeline::detect_stage() {
+    BlockPtr block;
+    while (running) {
+        if (!detect_queue.pop(block)) continue;
+        auto started = std::chrono::steady_clock::now();
+        
+        const std::vector<float>& power_spectrum = block->spectrum->power_db;
+        block->noise_floor = analyzer_ref->estimate_noise_floor(power_spectrum);
+        analyzer_ref->find_signal_peaks(power_spectrum, analyzer_ref->detection_threshold(block->noise_floor),
+                                        block->center_freq, block->sample_rate, block->peaks);
+        stage_latency[(int)PipelineStage::DETECT].record_since(started);
+        forward(classify_queue, block, running);
+    }
+}
+
+void Pipeline::classify_stage() {
+    BlockPtr block;
+    while (running) {
+        if (!classify_queue.pop(block)) continue;
+        auto started = std::chrono::steady_clock::now();
+        
+        analyzer_ref->classify_peaks(block->iq, block->peaks, block->noise_floor,
+                                     block->bursts, block->demods, block->detections);
+        stage_latency[(int)PipelineStage::CLASSIFY].record_since(started);
+        forward(database_queue, block, running);
+    }
+}
+
+void Pipeline::database_stage() {
+    BlockPtr block;
+    std::vector<DeviceAlert> alerts;
+    while (running) {
+        if (!database_queue.pop(block)) continue;
+        auto started = std::chrono::steady_clock::now();
+        
+        analyzer_ref->record_detections(block->detections, event_capture_ref ? &alerts : nullptr);
+        analyzer_ref->cleanup_old_devices();
+        if (event_capture_ref) {
+            // centered on the burst when there was one, else on the block
+            for (size_t i = 0; i < alerts.size(); i++) {
+                uint64_t sample = block->detections[i].signal.burst_start_sample;
+                event_capture_ref->trigger(sample ? sample : block->first_sample, alerts[i]);
+            }
+        }
+        if (scheduler_ref) {
+            for (const auto& detection : block->detections) {
+                scheduler_ref->note_activity(detection.signal.frequency);
+            }
+        }
+        samples_analyzed += block->iq.size();
+        stage_latency[(int)PipelineStage::DATABASE].record_since(started);
+        block_latency.record_since(block->capture_time);
+        blocks_analyzed++;
+        
+        // a full pool means convert is allocating faster than we recycle, let it go
+        block->recycle();
+        free_blocks.try_push(std::move(block));
+    }
+    analyzer_ref->flush_devices();
+}
+
+SpectrumFramePtr Pipeline::get_latest_spectrum() const {
+    return spectrum_engine ? spectrum_engine->get_latest() : SpectrumFramePtr();
+}
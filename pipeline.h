@@ -0,0 +1,160 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include "bounded_queue.h"
+#include "sample_ring.h"
+#include "protocol_analyzer.h"
+#include "spectrum_engine.h"
+#include "channelizer.h"
+#include "burst_detector.h"
+#include "demodulator.h"
+#include "lora_detector.h"
+#include "metrics.h"
+
+class SimpleSDR;
+class SampleRingReader;
+class ScanScheduler;
+class EventCapture;
+
+// one capture block as it travels through the pipeline. every stage fills
+// in its part and hands the block on to the next queue. blocks are recycled
+// by the database stage, the vectors keep their capacity so a steady stream
+// of blocks doesn't allocate.
+struct PipelineBlock {
+    uint64_t sequence;
+    uint64_t first_sample;     // absolute sample index in the capture stream
+    uint32_t center_freq;
+    uint32_t sample_rate;
+    std::chrono::steady_clock::time_point capture_time;
+    
+    std::vector<std::complex<float>> iq;                 // convert
+    SpectrumFramePtr spectrum;                           // spectrum
+    std::vector<std::vector<std::complex<float>>> channels; // channelize, fs / CHANNEL_COUNT each
+    uint32_t channel_rate;                               // channelize
+    std::vector<BurstEvent> bursts;                      // channelize, finished and still on air
+    std::vector<DemodResult> demods;                     // channelize, one per burst
+    double noise_floor;                                  // detect
+    PeakList peaks;                                      // detect
+    std::vector<Detection> detections;                   // classify
+    
+    // back to an empty block, keeping the storage
+    void recycle();
+};
+
+typedef std::unique_ptr<PipelineBlock> BlockPtr;
+
+enum class PipelineStage {
+    CONVERT,
+    SPECTRUM,      // the fft
+    CHANNELIZE,    // filterbank, burst detection, demodulation, lora search
+    DETECT,
+    CLASSIFY,
+    DATABASE
+};
+static const int PIPELINE_STAGE_COUNT = 6;
+const char* pipeline_stage_name(PipelineStage stage);
+
+// capture -> convert -> spectrum -> channelize -> detect -> classify -> device db, each
+// stage on its own worker with bounded queues in between. the gui never
+// touches the pipeline threads, it only reads published spectrum frames.
+class Pipeline {
+private:
+    SimpleSDR* sdr_ref;
+    ProtocolAnalyzer* analyzer_ref;
+    ScanScheduler* scheduler_ref;      // optional, told where activity was seen
+    EventCapture* event_capture_ref;   // optional, dumps the iq around alerts
+    
+    static const size_t BLOCK_BYTES = 65536;        // 16 ms at 2.048 MS/s
+    static const size_t QUEUE_DEPTH = 8;
+    static const int CHANNEL_COUNT = 16;            // 128 kHz channels at 2.048 MS/s
+    static const size_t BLOCK_POOL_SIZE = 64;       // more than the queues hold
+    
+    BoundedQueue<BlockPtr> spectrum_queue;
+    BoundedQueue<BlockPtr> channelize_queue;
+    BoundedQueue<BlockPtr> detect_queue;
+    BoundedQueue<BlockPtr> classify_queue;
+    BoundedQueue<BlockPtr> database_queue;
+    BoundedQueue<BlockPtr> free_blocks;    // analyzed blocks, reused by convert
+    
+    // spectrum frames the spectrum stage reuses once nobody else holds them,
+    // grows to however many are in flight at once
+    std::vector<std::shared_ptr<SpectrumFrame>> frame_pool;
+    
+    // one fft per block, shared by the detector and the gui
+    std::unique_ptr<SpectrumEngine> spectrum_engine;
+    
+    // splits every block into narrow decimated channels for per-channel work
+    std::unique_ptr<PolyphaseChannelizer> channelizer;
+    std::vector<BurstDetector> burst_detectors;      // one per channel, run by the channelize stage
+    std::unique_ptr<LoRaDetector> lora_detector;     // chirp search on wide constant envelope bursts
+    
+    // created before the capture starts so a replay can't get ahead of it
+    std::unique_ptr<SampleRingReader> input_reader;
+    
+    std::vector<std::thread> workers;
+    std::atomic<bool> running;
+    
+    // stage counters
+    std::atomic<uint64_t> input_position;    // every byte before it has been converted or dropped
+    std::atomic<uint64_t> blocks_converted;
+    std::atomic<uint64_t> blocks_analyzed;
+    std::atomic<uint64_t> samples_analyzed;
+    std::atomic<uint64_t> torn_blocks;
+    std::atomic<uint64_t> settle_dropped_bytes;
+    std::atomic<uint64_t> input_dropped_bytes;   // lapped by the capture
+    
+    // time each stage spends on a block, not counting waits on its queues,
+    // and a block's whole trip from convert to the device database. each
+    // has one writer, the stage's thread.
+    LatencyHistogram stage_latency[PIPELINE_STAGE_COUNT];
+    LatencyHistogram block_latency;
+    
+    void convert_stage();
+    void spectrum_stage();
+    void channelize_stage();
+    void detect_stage();
+    void classify_stage();
+    void database_stage();
+    
+public:
+    Pipeline();
+    ~Pipeline();
+    
+    void set_sdr_reference(SimpleSDR* sdr) { sdr_ref = sdr; }
+    void set_protocol_analyzer_reference(ProtocolAnalyzer* analyzer) { analyzer_ref = analyzer; }
+    void set_scan_scheduler_reference(ScanScheduler* scheduler) { scheduler_ref = scheduler; }
+    // before start()
+    void set_event_capture_reference(EventCapture* capture) { event_capture_ref = capture; }
+    
+    bool start();
+    void stop();
+    bool is_running() const { return running; }
+    // the source has ended and every whole block it delivered went through
+    // all stages, how a replay knows it is done
+    bool is_drained() const;
+    
+    // newest spectrum frame, null until the first block has been processed
+    SpectrumFramePtr get_latest_spectrum() const;
+    
+    // statistics
+    uint64_t get_blocks_converted() const { return blocks_converted; }
+    uint64_t get_blocks_analyzed() const { return blocks_analyzed; }
+    uint64_t get_samples_analyzed() const { return samples_analyzed; }
+    uint64_t get_torn_blocks() const { return torn_blocks; }
+    uint64_t get_settle_dropped_bytes() const { return settle_dropped_bytes; }
+    uint64_t get_input_dropped_bytes() const { return input_dropped_bytes; }
+    const LatencyHistogram& get_stage_latency(PipelineStage stage) const { return stage_latency[(int)stage]; }
+    const LatencyHistogram& get_block_latency() const { return block_latency; }
+    // blocks waiting in front of a stage, for convert the capture backlog in blocks
+    size_t get_queue_depth(PipelineStage stage) const;
+};
+
+#endif // PIPELINE_H
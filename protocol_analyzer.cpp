@@ -1,13 +1,28 @@
 #include "protocol_analyzer.h"
 #include "sdr.h"
+#include "async_log.h"
+#include "task_pool.h"
+#include "signature_pack.h"
 #include <iostream>
 #include <cmath>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <cstdio>
+#include <cstring>
 
-ProtocolAnalyzer::ProtocolAnalyzer() : sdr_ref(nullptr), current_scan_frequency(433920000), 
-                                     current_range_index(0), scanning_active(false) {
+ProtocolAnalyzer::ProtocolAnalyzer() : sdr_ref(nullptr), signature_pack_stamp(0),
+                                     watching(false), devices_changed(false), device_epoch(0),
+                                     device_snapshot(std::make_shared<DeviceSnapshot>()), store_saving(false),
+                                     current_scan_frequency(433920000), 
+                                     scanning_active(false), scan_mode(ScanMode::WIDEBAND),
+                                     spectrum_engine(DETECTION_FFT_SIZE), burst_stream() {
+    // Never without an index, classification may run before initialize()
+    {
+        std::lock_guard<std::mutex> lock(signature_mutex);
+        publish_signatures({});
+    }
+    
     // Initialize frequency scan ranges (Hz)
     scan_ranges = {
         {433050000, 434790000},  // 433 MHz ISM band (ITU Region 1)
@@ -20,7 +35,9 @@ ProtocolAnalyzer::ProtocolAnalyzer() : sdr_ref(nullptr), current_scan_frequency(
 }
 
 ProtocolAnalyzer::~ProtocolAnalyzer() {
+    stop_signature_watch();
     stop_frequency_scan();
+    if (store_saver.joinable()) store_saver.join();
 }
 
 bool ProtocolAnalyzer::initialize() {
@@ -29,179 +46,333 @@ bool ProtocolAnalyzer::initialize() {
     // Load protocol signatures
     load_protocol_signatures();
     
-    std::cout << "Loaded " << protocol_signatures.size() << " protocol signatures" << std::endl;
+    // Plan the detection fft (measured on first launch, then loaded from wisdom)
+    if (!spectrum_engine.initialize()) {
+        std::cerr << "FFT setup failed!" << std::endl;
+        return false;
+    }
+    
+    std::cout << "Loaded " << get_signature_index()->size() << " protocol signatures" << std::endl;
     std::cout << "Configured " << scan_ranges.size() << " frequency ranges" << std::endl;
     
     return true;
 }
 
 void ProtocolAnalyzer::load_protocol_signatures() {
-    protocol_signatures.clear();
+    std::vector<ProtocolSignature> signatures;
     
     // 433 MHz ISM Band Protocols
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::ISM_433_OOK,
         "433MHz OOK",
         "On-Off Keying protocols at 433MHz - garage doors, weather stations, sensors",
         433050000, 434790000,
         25000,  // 25 kHz typical bandwidth
-        "OOK",
+        Modulation::OOK,
         100, 10000,  // 100 bps to 10 kbps
         true,  // Burst mode
         {"Weather stations", "Garage door remotes", "Wireless doorbells", "Security sensors"},
-        "Often unencrypted, vulnerable to replay attacks"
+        "Often unencrypted, vulnerable to replay attacks",
+        ""  // no security flag
     });
     
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::ISM_433_FSK,
         "433MHz FSK",
         "Frequency Shift Keying protocols at 433MHz - more robust than OOK",
         433050000, 434790000,
         50000,  // 50 kHz typical bandwidth
-        "FSK",
+        Modulation::FSK,
         1000, 50000,  // 1 kbps to 50 kbps
         true,
         {"Smart meters", "Industrial sensors", "Remote controls"},
-        "Better resistance to interference, may have encryption"
+        "Better resistance to interference, may have encryption",
+        ""
     });
     
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::WEATHER_STATION,
         "Weather Station",
         "Wireless weather station protocols (Acurite, Oregon Scientific, etc.)",
         433800000, 434000000,
         10000,  // 10 kHz bandwidth
-        "OOK",
+        Modulation::OOK,
         1000, 5000,  // 1-5 kbps
         true,
         {"Acurite sensors", "Oregon Scientific", "Ambient Weather", "La Crosse"},
-        "Usually unencrypted sensor data, privacy concerns"
+        "Usually unencrypted sensor data, privacy concerns",
+        "INFO: Unencrypted sensor data"
     });
     
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::GARAGE_DOOR,
         "Garage Door Remote",
         "Garage door opener remote controls",
         433920000, 433920000,  // Often exactly 433.92 MHz
         20000,  // 20 kHz bandwidth
-        "OOK",
+        Modulation::OOK,
         500, 2000,  // 500 bps to 2 kbps
         true,
         {"Chamberlain", "LiftMaster", "Genie", "Craftsman"},
-        "Critical security risk - often fixed codes, vulnerable to replay"
+        "Critical security risk - often fixed codes, vulnerable to replay",
+        "CRITICAL: Garage door remote - replay attack risk"
     });
     
     // 868 MHz European ISM Band
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::ISM_868_OOK,
         "868MHz OOK (EU)",
         "European ISM band On-Off Keying protocols",
         868000000, 868600000,
         25000,
-        "OOK",
+        Modulation::OOK,
         100, 10000,
         true,
         {"European weather stations", "Home automation", "Security systems"},
-        "European equivalent of 433MHz protocols"
+        "European equivalent of 433MHz protocols",
+        ""
     });
     
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::ZIGBEE_868,
         "Zigbee 868MHz",
         "Zigbee mesh networking protocol - European band",
         868000000, 868600000,
         600000,  // 600 kHz channel bandwidth
-        "OQPSK",
+        Modulation::OQPSK,
         20000, 20000,  // 20 kbps fixed
         false,  // Continuous/mesh
         {"Smart home devices", "Industrial automation", "Smart lighting"},
-        "AES-128 encryption available but not always enabled"
+        "AES-128 encryption available but not always enabled",
+        ""
     });
     
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::LORA_868,
         "LoRa 868MHz",
         "Long Range IoT protocol - European band",
         863000000, 870000000,
         125000,  // 125 kHz typical
-        "LoRa CSS",
+        Modulation::LORA_CSS,
         250, 5500,  // 250 bps to 5.5 kbps (SF12 to SF7)
         true,
         {"IoT sensors", "Smart city", "Agricultural monitoring", "Asset tracking"},
-        "Application-layer encryption varies by implementation"
+        "Application-layer encryption varies by implementation",
+        ""
     });
     
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::WIRELESS_MBUS,
         "Wireless M-Bus",
         "Wireless meter reading protocol (European standard)",
         868950000, 869525000,
         50000,  // 50 kHz
-        "FSK",
+        Modulation::FSK,
         32768, 100000,  // 32.768 kbps to 100 kbps
         true,
         {"Smart water meters", "Gas meters", "Heat meters", "Electricity meters"},
-        "Contains sensitive consumption data, encryption varies"
+        "Contains sensitive consumption data, encryption varies",
+        ""
     });
     
     // 915 MHz American ISM Band
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::ISM_915_OOK,
         "915MHz OOK (US)",
         "American ISM band On-Off Keying protocols",
         902000000, 928000000,
         25000,
-        "OOK",
+        Modulation::OOK,
         100, 10000,
         true,
         {"US weather stations", "Sensors", "Remote controls"},
-        "American equivalent of 433MHz protocols"
+        "American equivalent of 433MHz protocols",
+        ""
     });
     
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::ZIGBEE_915,
         "Zigbee 915MHz",
         "Zigbee mesh networking protocol - American band",
         902000000, 928000000,
         2000000,  // 2 MHz channel bandwidth
-        "OQPSK",
+        Modulation::OQPSK,
         40000, 40000,  // 40 kbps fixed
         false,
         {"Smart home devices", "Industrial sensors", "Medical devices"},
-        "AES-128 encryption capability, implementation varies"
+        "AES-128 encryption capability, implementation varies",
+        ""
     });
     
-    protocol_signatures.push_back({
+    signatures.push_back({
         ProtocolType::LORA_915,
         "LoRa 915MHz",
         "Long Range IoT protocol - American band",
         902000000, 928000000,
         125000,  // 125 kHz typical
-        "LoRa CSS",
+        Modulation::LORA_CSS,
         980, 21900,  // Different data rates for US band
         true,
         {"IoT networks", "Smart agriculture", "Industrial monitoring"},
-        "LoRaWAN security depends on proper key management"
+        "LoRaWAN security depends on proper key management",
+        ""
     });
     
+    std::lock_guard<std::mutex> lock(signature_mutex);
+    builtin_signatures = signatures;
+    publish_signatures(std::move(signatures));
+}
+
+void ProtocolAnalyzer::add_custom_signature(const ProtocolSignature& signature) {
+    std::lock_guard<std::mutex> lock(signature_mutex);
+    std::vector<ProtocolSignature> signatures = get_signature_index()->get_signatures();
+    signatures.push_back(signature);
+    if (publish_signatures(std::move(signatures))) {
+        custom_signatures.push_back(signature);
+    }
+}
+
+bool ProtocolAnalyzer::publish_signatures(std::vector<ProtocolSignature> signatures) {
+    std::shared_ptr<SignatureIndex> index = std::make_shared<SignatureIndex>();
+    if (!index->build(std::move(signatures))) return false;
+    std::atomic_store(&signature_index, SignatureIndexPtr(std::move(index)));
+    return true;
+}
+
+bool ProtocolAnalyzer::merge_signature_packs(std::vector<ProtocolSignature>& signatures, uint64_t& stamp) {
+    std::vector<std::string> files;
+    if (!list_signature_packs(signature_pack_path, files)) return false;
+    stamp = signature_packs_stamp(files);
+    
+    signatures = builtin_signatures;
+    for (const auto& file : files) {
+        SignaturePack pack;
+        if (!load_signature_pack(file, pack)) return false;
+        merge_signature_pack(signatures, pack);
+    }
+    signatures.insert(signatures.end(), custom_signatures.begin(), custom_signatures.end());
+    return true;
+}
+
+bool ProtocolAnalyzer::load_signature_packs(const std::string& path, bool watch) {
+    {
+        std::lock_guard<std::mutex> lock(signature_mutex);
+        signature_pack_path = path;
+    }
+    if (!reload_signature_packs()) return false;
+    
+    if (watch && !signature_watcher.joinable()) {
+        watching = true;
+        signature_watcher = std::thread(&ProtocolAnalyzer::watch_signature_packs, this);
+    }
+    return true;
+}
+
+bool ProtocolAnalyzer::reload_signature_packs() {
+    std::lock_guard<std::mutex> lock(signature_mutex);
+    if (signature_pack_path.empty()) return false;
+    
+    // Parsed and compiled off to the side, classification keeps using the
+    // current index until the swap
+    std::vector<ProtocolSignature> signatures;
+    uint64_t stamp = 0;
+    bool loaded = merge_signature_packs(signatures, stamp) && publish_signatures(std::move(signatures));
+    signature_pack_stamp = stamp;
+    if (!loaded) {
+        std::cerr << "Keeping the " << get_signature_index()->size() << " signatures in use" << std::endl;
+        return false;
+    }
+    log_printf("Loaded %zu protocol signatures with packs from %s", get_signature_index()->size(),
+               signature_pack_path.c_str());
+    return true;
+}
+
+void ProtocolAnalyzer::watch_signature_packs() {
+    std::unique_lock<std::mutex> lock(watch_mutex);
+    while (watching) {
+        watch_wake.wait_for(lock, std::chrono::milliseconds(SIGNATURE_WATCH_MS));
+        if (!watching) break;
+        
+        // Recomputed every time so packs added to or removed from a directory count too
+        uint64_t stamp;
+        {
+            std::lock_guard<std::mutex> signature_lock(signature_mutex);
+            std::vector<std::string> files;
+            if (!list_signature_packs(signature_pack_path, files)) continue;
+            stamp = signature_packs_stamp(files);
+            if (stamp == signature_pack_stamp) continue;
+        }
+        reload_signature_packs();
+    }
+}
+
+void ProtocolAnalyzer::stop_signature_watch() {
+    if (!signature_watcher.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(watch_mutex);
+        watching = false;
+    }
+    watch_wake.notify_all();
+    signature_watcher.join();
+}
+
+void ProtocolAnalyzer::set_sdr_reference(SimpleSDR* sdr) {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    sdr_ref = sdr;
+    scan_tuners.clear();
+    if (sdr) {
+        scan_tuners.push_back({sdr, {}, 0, 0});
+    }
+}
+
+size_t ProtocolAnalyzer::add_tuner(SimpleSDR* sdr) {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    if (!sdr_ref) sdr_ref = sdr;
+    scan_tuners.push_back({sdr, {}, 0, 0});
+    return scan_tuners.size() - 1;
+}
+
+size_t ProtocolAnalyzer::get_tuner_count() const {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    return scan_tuners.size();
 }
 
 void ProtocolAnalyzer::start_frequency_scan() {
-    if (!sdr_ref) {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    if (scan_tuners.empty()) {
         std::cerr << "SDR reference not set!" << std::endl;
         return;
     }
     
+    // Plan for the slowest tuner so no hop leaves a gap on any of them
+    uint32_t sample_rate = scan_tuners[0].sdr->get_sample_rate();
+    for (const auto& tuner : scan_tuners) {
+        sample_rate = std::min(sample_rate, tuner.sdr->get_sample_rate());
+    }
+    plan_scan_hops(sample_rate);
+    if (scan_plan.empty()) {
+        std::cerr << "No scan ranges configured!" << std::endl;
+        return;
+    }
+    
     scanning_active = true;
-    current_range_index = 0;
-    current_scan_frequency = scan_ranges[0].first;
     
     std::cout << "Starting frequency scan..." << std::endl;
-    std::cout << "Scan range 1: " << (scan_ranges[0].first / 1e6) << " - " 
-              << (scan_ranges[0].second / 1e6) << " MHz (Fast Mode: 250kHz steps)" << std::endl;
+    if (scan_mode == ScanMode::WIDEBAND) {
+        std::cout << "Wideband mode: " << scan_plan.size() << " hops across " << scan_ranges.size()
+                  << " ranges" << std::endl;
+    } else {
+        std::cout << "Narrow mode: " << scan_plan.size() << " hops of " << (NARROW_SCAN_STEP / 1e3)
+                  << " kHz" << std::endl;
+    }
     
-    // Set initial frequency
-    sdr_ref->set_frequency(current_scan_frequency);
+    // Split the plan across the tuners and set their initial frequencies
+    assign_scan_hops();
+    for (size_t tuner = 0; tuner < scan_tuners.size(); tuner++) {
+        if (!scan_tuners[tuner].hops.empty()) {
+            tune_to_hop(tuner, 0);
+        }
+    }
 }
 
 void ProtocolAnalyzer::stop_frequency_scan() {
@@ -209,304 +380,775 @@ void ProtocolAnalyzer::stop_frequency_scan() {
     std::cout << "Frequency scan stopped" << std::endl;
 }
 
-void ProtocolAnalyzer::update_scan() {
-    if (!scanning_active || !sdr_ref) return;
+void ProtocolAnalyzer::update_scan(size_t tuner) {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    if (!scanning_active || tuner >= scan_tuners.size() || scan_tuners[tuner].hops.empty()) return;
+    
+    size_t next = scan_tuners[tuner].position + 1;
+    if (next >= scan_tuners[tuner].hops.size()) {
+        // Completed this tuner's share, restart from beginning
+        next = 0;
+        log_printf("Tuner %zu completed scan cycle, restarting...", tuner);
+    }
+    
+    tune_to_hop(tuner, next);
+}
+
+void ProtocolAnalyzer::set_scan_mode(ScanMode mode) {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    if (mode == scan_mode) return;
+    scan_mode = mode;
+    
+    // replan and let every tuner carry on from the start of the range it was in
+    if (scanning_active && !scan_tuners.empty()) {
+        std::vector<size_t> ranges;
+        uint32_t sample_rate = scan_tuners[0].sdr->get_sample_rate();
+        for (const auto& tuner : scan_tuners) {
+            ranges.push_back(tuner.current_range);
+            sample_rate = std::min(sample_rate, tuner.sdr->get_sample_rate());
+        }
+        plan_scan_hops(sample_rate);
+        assign_scan_hops();
+        
+        for (size_t tuner = 0; tuner < scan_tuners.size(); tuner++) {
+            const std::vector<size_t>& hops = scan_tuners[tuner].hops;
+            if (hops.empty()) continue;
+            size_t position = 0;
+            for (size_t i = 0; i < hops.size(); i++) {
+                if (scan_plan[hops[i]].range_index == ranges[tuner]) {
+                    position = i;
+                    break;
+                }
+            }
+            tune_to_hop(tuner, position);
+        }
+    }
+}
+
+size_t ProtocolAnalyzer::get_scan_hop_count() const {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    return scan_plan.size();
+}
+
+size_t ProtocolAnalyzer::get_current_range_index(size_t tuner) const {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    return tuner < scan_tuners.size() ? scan_tuners[tuner].current_range : 0;
+}
+
+void ProtocolAnalyzer::plan_scan_hops(uint32_t sample_rate) {
+    scan_plan.clear();
     
-    // step frequency by 250 khz
-    const uint32_t step_size = 250000;
-    current_scan_frequency += step_size;
+    // hops are spaced evenly so neighbouring captures meet at the edge of the
+    // usable band instead of leaving the last hop mostly outside the range
+    const double usable_bandwidth = sample_rate * USABLE_BANDWIDTH_FRACTION;
     
-    // check if we've reached the end of current range
-    if (current_scan_frequency > scan_ranges[current_range_index].second) {
-        current_range_index++;
+    for (size_t range = 0; range < scan_ranges.size(); range++) {
+        uint32_t range_start = scan_ranges[range].first;
+        uint32_t range_end = scan_ranges[range].second;
         
-        if (current_range_index >= scan_ranges.size()) {
-            // Completed all ranges, restart from beginning
-            current_range_index = 0;
-            std::cout << "Completed scan cycle, restarting..." << std::endl;
+        if (scan_mode == ScanMode::NARROW || usable_bandwidth <= 0) {
+            for (uint32_t freq = range_start; freq <= range_end; freq += NARROW_SCAN_STEP) {
+                scan_plan.push_back({freq, range});
+            }
+            continue;
         }
         
-        current_scan_frequency = scan_ranges[current_range_index].first;
-        std::cout << "Scanning range " << (current_range_index + 1) << ": " 
-                  << (scan_ranges[current_range_index].first / 1e6) << " - " 
-                  << (scan_ranges[current_range_index].second / 1e6) << " MHz" << std::endl;
+        double width = (double)range_end - range_start;
+        size_t hops = std::max<size_t>(1, (size_t)std::ceil(width / usable_bandwidth));
+        double spacing = width / hops;
+        for (size_t i = 0; i < hops; i++) {
+            scan_plan.push_back({(uint32_t)(range_start + spacing * (i + 0.5)), range});
+        }
+    }
+}
+
+void ProtocolAnalyzer::assign_scan_hops() {
+    // Hops in frequency order, cut into one contiguous run per tuner. Runs
+    // differ by at most one hop, so each dongle covers a compact part of the
+    // spectrum and all of them finish a cycle at about the same time.
+    std::vector<size_t> order(scan_plan.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return scan_plan[a].center_freq < scan_plan[b].center_freq;
+    });
+    
+    const size_t tuner_count = scan_tuners.size();
+    size_t next = 0;
+    for (size_t tuner = 0; tuner < tuner_count; tuner++) {
+        size_t share = order.size() / tuner_count + (tuner < order.size() % tuner_count ? 1 : 0);
+        scan_tuners[tuner].hops.assign(order.begin() + next, order.begin() + next + share);
+        scan_tuners[tuner].position = 0;
+        next += share;
+        
+        if (tuner_count > 1 && share > 0) {
+            std::cout << "Tuner " << tuner << ": " << share << " hops, "
+                      << (scan_plan[scan_tuners[tuner].hops.front()].center_freq / 1e6) << " - "
+                      << (scan_plan[scan_tuners[tuner].hops.back()].center_freq / 1e6) << " MHz" << std::endl;
+        }
+    }
+}
+
+void ProtocolAnalyzer::tune_to_hop(size_t tuner, size_t position) {
+    ScanTuner& scan_tuner = scan_tuners[tuner];
+    if (scan_tuner.hops.empty()) return;
+    // A replan can shrink the plan under a position taken before it, switching
+    // from narrow to wideband leaves far fewer hops. Start the slice over then.
+    if (position >= scan_tuner.hops.size()) position = 0;
+    const ScanHop& hop = scan_plan[scan_tuner.hops[position]];
+    
+    if (position == 0 || hop.range_index != scan_tuner.current_range) {
+        log_printf("Tuner %zu scanning range %zu: %g - %g MHz", tuner, hop.range_index + 1,
+                   scan_ranges[hop.range_index].first / 1e6, scan_ranges[hop.range_index].second / 1e6);
+    }
+    
+    scan_tuner.position = position;
+    scan_tuner.current_range = hop.range_index;
+    if (tuner == 0) {
+        current_scan_frequency = hop.center_freq;
     }
     
     // Set new frequency
-    sdr_ref->set_frequency(current_scan_frequency);
+    scan_tuner.sdr->set_frequency(hop.center_freq);
 }
 
 bool ProtocolAnalyzer::detect_signals(const std::vector<std::complex<float>>& iq_data) {
     if (iq_data.empty()) return false;
     
     // Compute power spectrum
-    power_spectrum = compute_power_spectrum(iq_data);
+    detection_frame.center_freq = sdr_ref ? sdr_ref->get_center_freq() : current_scan_frequency.load();
+    detection_frame.sample_rate = sdr_ref ? sdr_ref->get_sample_rate() : 2048000;
+    detection_frame.capture_time = std::chrono::steady_clock::now();
+    if (!spectrum_engine.compute(iq_data, detection_frame)) return false;
+    
+    const std::vector<float>& power_spectrum = detection_frame.power_db;
+    
+    // Track bursts across calls, restart if we were retuned meanwhile
+    BurstStream stream;
+    stream.first_sample = 0;
+    stream.decimation = 1;
+    stream.sample_rate = detection_frame.sample_rate;
+    stream.center_frequency = detection_frame.center_freq;
+    if (stream.center_frequency != burst_stream.center_frequency || stream.sample_rate != burst_stream.sample_rate) {
+        burst_stream = stream;
+        burst_detector.reset(stream);
+    }
+    detection_bursts.clear();
+    burst_detector.process(iq_data.data(), iq_data.size(), detection_bursts);
+    BurstEvent active;
+    if (burst_detector.active_burst(active)) {
+        detection_bursts.push_back(active);
+    }
     
     // Estimate noise floor
     double noise_floor = estimate_noise_floor(power_spectrum);
     
-    // Find signal peaks above threshold (lower threshold for faster detection)
-    double threshold = noise_floor + 6.0; // 6 dB above noise floor (was 10 dB)
-    auto peaks = find_signal_peaks(power_spectrum, threshold);
+    // Find signal peaks above threshold
+    find_signal_peaks(power_spectrum, detection_threshold(noise_floor),
+                      detection_frame.center_freq, detection_frame.sample_rate, detection_peaks);
     
-    bool signals_detected = false;
+    // Analyze and classify each detected peak
+    // The synchronous path has no channelizer output to demodulate from
+    static const std::vector<DemodResult> no_demods;
+    classify_peaks(iq_data, detection_peaks, noise_floor, detection_bursts, no_demods, detection_list);
     
-    // Analyze each detected peak
-    for (const auto& peak : peaks) {
-        double peak_frequency = peak.first;
-        double peak_power = peak.second;
+    // Update device database
+    record_detections(detection_list);
+    
+    return !detection_list.empty();
+}
+
+void ProtocolAnalyzer::classify_peaks(const std::vector<std::complex<float>>& iq_data,
+                                      const PeakList& peaks, double noise_floor,
+                                      const std::vector<BurstEvent>& bursts,
+                                      const std::vector<DemodResult>& demods,
+                                      std::vector<Detection>& detections) {
+    // every peak is analyzed on its own, the slots keep them in peak order.
+    // one index for the whole block, a reload can't free it in between
+    SignatureIndexPtr signatures = get_signature_index();
+    detections.resize(peaks.size());
+    auto classify_peak = [&](size_t index) {
+        double peak_frequency = peaks[index].first;
+        double peak_power = peaks[index].second;
         
         // Analyze signal characteristics
-        SignalCharacteristics signal = analyze_signal(iq_data, peak_frequency, peak_power);
+        // demods, when given, line up with bursts
+        int burst = find_burst(bursts, peak_frequency);
+        const BurstEvent* burst_event = burst >= 0 ? &bursts[burst] : nullptr;
+        const DemodResult* demod = burst >= 0 && (size_t)burst < demods.size() ? &demods[burst] : nullptr;
+        SignalCharacteristics signal = analyze_signal(iq_data, peak_frequency, peak_power, noise_floor,
+                                                      burst_event, demod);
         
-        // Classify protocol
-        ProtocolType protocol = classify_protocol(signal);
-        
-        if (protocol != ProtocolType::UNKNOWN) {
-            std::cout << "Detected: " << get_protocol_name(protocol) 
-                      << " at " << (signal.frequency / 1e6) << " MHz, "
-                      << std::fixed << std::setprecision(1) << signal.power_db << " dB" << std::endl;
-            
-            // Update device database
-            update_device_database(signal, protocol);
-            signals_detected = true;
+        // Classify protocol, the signature's id identifies it from here on
+        const ProtocolSignature* signature = classify_protocol(*signatures, signal);
+        detections[index] = {signal, signature ? signature->type : ProtocolType::UNKNOWN,
+                             signature ? signature_id(signature->name) : 0};
+    };
+    
+    // a few peaks aren't worth waking the pool for
+    if (peaks.size() >= PARALLEL_MIN_PEAKS) {
+        TaskPool::instance().parallel_for(peaks.size(), classify_peak);
+    } else {
+        for (size_t i = 0; i < peaks.size(); i++) classify_peak(i);
+    }
+    
+    detections.erase(std::remove_if(detections.begin(), detections.end(),
+                                    [](const Detection& detection) { return detection.protocol == ProtocolType::UNKNOWN; }),
+                     detections.end());
+}
+
+void ProtocolAnalyzer::record_detections(const std::vector<Detection>& detections,
+                                         std::vector<DeviceAlert>* alerts) {
+    static const std::string unknown_name = "Unknown Protocol";
+    SignatureIndexPtr index = get_signature_index();
+    if (alerts) alerts->resize(detections.size());
+    for (size_t i = 0; i < detections.size(); i++) {
+        const Detection& detection = detections[i];
+        const ProtocolSignature* signature = find_signature(*index, detection.signature, detection.protocol);
+        const std::string& protocol_name = signature ? signature->name : unknown_name;
+        if (detection_sinks.empty()) {
+            char line[MAX_DETECTION_LINE];
+            format_detection_text(detection, protocol_name, line, sizeof(line));
+            AsyncLog::instance().write(line);
+        }
+        for (DetectionSink* sink : detection_sinks) {
+            sink->emit(detection, protocol_name);
         }
+                  
+        update_device_database(detection, signature, alerts ? &(*alerts)[i] : nullptr);
     }
     
-    return signals_detected;
+    if (!detections.empty()) {
+        std::lock_guard<std::mutex> lock(device_mutex);
+        publish_devices(false);
+    }
 }
 
 SignalCharacteristics ProtocolAnalyzer::analyze_signal(const std::vector<std::complex<float>>& iq_data,
-                                                     double peak_frequency, double peak_power) {
+                                                     double peak_frequency, double peak_power,
+                                                     double noise_floor, const BurstEvent* burst,
+                                                     const DemodResult* demod) {
     SignalCharacteristics signal;
     
     signal.frequency = peak_frequency;
     signal.power_db = peak_power;
     signal.detection_time = std::chrono::steady_clock::now();
     
-    // Estimate bandwidth (simple method - find -3dB points)
-    signal.bandwidth = 25000; // Default 25 kHz, should be calculated properly
+    // Bandwidth from the burst's instantaneous frequency spread if we caught one
+    signal.bandwidth = burst && burst->bandwidth > 0 ? burst->bandwidth : 25000; // Default 25 kHz
     
     // Estimate SNR
-    double noise_floor = estimate_noise_floor(power_spectrum);
     signal.snr_db = peak_power - noise_floor;
     
-    // Simple modulation detection (would need more sophisticated analysis)
-    if (signal.snr_db > 20) {
-        signal.modulation = "Strong signal - likely FSK/PSK";
-    } else if (signal.snr_db > 10) {
-        signal.modulation = "Medium signal - likely OOK/ASK";
+    // Modulation and symbol rate from the demodulator, left empty / 0 when it
+    // couldn't tell so classification falls back on frequency and bandwidth
+    if (demod && demod->valid) {
+        signal.modulation = demod->modulation;
+        signal.symbol_rate = demod->symbol_rate;
     } else {
-        signal.modulation = "Weak signal - unknown modulation";
+        signal.modulation = Modulation::UNKNOWN;
+        signal.symbol_rate = 0;
     }
     
-    // Estimate symbol rate (placeholder - needs proper analysis)
-    signal.symbol_rate = 1000; // 1 kbps default
-    
-    // Burst detection (simplified)
-    signal.is_burst = true;
-    signal.burst_duration = 0.1; // 100ms default
+    // Timing from the burst detector, a peak without a burst edge is continuous
+    signal.is_burst = burst != nullptr;
+    signal.burst_duration = burst ? burst->duration : 0.0;
+    signal.burst_start_sample = burst ? burst->start_sample : 0;
     
     return signal;
 }
 
-ProtocolType ProtocolAnalyzer::classify_protocol(const SignalCharacteristics& signal) {
-    // Check each protocol signature
-    for (const auto& signature : protocol_signatures) {
-        if (is_frequency_in_range(signal.frequency, signature.frequency_min, signature.frequency_max)) {
-            // Additional checks could be added here for modulation, bandwidth, etc.
-            return signature.type;
+int ProtocolAnalyzer::find_burst(const std::vector<BurstEvent>& bursts, double frequency) const {
+    int best = -1;
+    double best_distance = BURST_MATCH_HZ;
+    for (size_t i = 0; i < bursts.size(); i++) {
+        double distance = std::abs(bursts[i].frequency - frequency);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = (int)i;
+        }
+    }
+    return best;
+}
+
+const ProtocolSignature* ProtocolAnalyzer::classify_protocol(const SignatureIndex& index,
+                                                             const SignalCharacteristics& signal) {
+    // Every signature covering the frequency, in load order
+    const auto& candidates = index.find_candidates(signal.frequency);
+    
+    const ProtocolSignature* best = nullptr;
+    double best_score = 0.0;
+    for (const ProtocolSignature* candidate : candidates) {
+        double score = score_signature(signal, *candidate);
+        if (!best || score > best_score) {
+            best = candidate;
+            best_score = score;
         }
     }
     
-    return ProtocolType::UNKNOWN;
+    return best;
+}
+
+double ProtocolAnalyzer::score_signature(const SignalCharacteristics& signal, const ProtocolSignature& signature) {
+    // Covering the frequency is worth a point on its own, every measured
+    // property then counts for or against the signature
+    double score = 1.0;
+    
+    if (signal.modulation != Modulation::UNKNOWN) {
+        score += matches_modulation(signal, signature) ? 2.0 : -1.0;
+    }
+    
+    if (signal.symbol_rate > 0) {
+        bool in_range = signal.symbol_rate >= signature.symbol_rate_min * (1.0 - SYMBOL_RATE_SLACK) &&
+                        signal.symbol_rate <= signature.symbol_rate_max * (1.0 + SYMBOL_RATE_SLACK);
+        score += in_range ? 1.0 : -1.0;
+    }
+    
+    if (signal.bandwidth >= 0.5 * signature.bandwidth_typical &&
+        signal.bandwidth <= 2.0 * signature.bandwidth_typical) {
+        score += 1.0;
+    }
+    
+    if (signal.is_burst == signature.is_burst_mode) {
+        score += 0.5;
+    }
+    
+    return score;
 }
 
-void ProtocolAnalyzer::update_device_database(const SignalCharacteristics& signal, ProtocolType protocol) {
-    // Generate device ID based on signal characteristics
-    std::string device_id = generate_device_id(signal, protocol);
+bool ProtocolAnalyzer::matches_modulation(const SignalCharacteristics& signal, const ProtocolSignature& signature) {
+    switch (signature.modulation) {
+        case Modulation::OOK: return matches_ook_characteristics(signal);
+        case Modulation::FSK: return matches_fsk_characteristics(signal);
+        case Modulation::LORA_CSS: return matches_lora_characteristics(signal);
+        case Modulation::OQPSK: return matches_zigbee_characteristics(signal);
+        default: return signal.modulation == signature.modulation;
+    }
+}
+
+bool ProtocolAnalyzer::matches_ook_characteristics(const SignalCharacteristics& signal) {
+    return signal.modulation == Modulation::OOK;
+}
+
+bool ProtocolAnalyzer::matches_fsk_characteristics(const SignalCharacteristics& signal) {
+    return signal.modulation == Modulation::FSK;
+}
+
+bool ProtocolAnalyzer::matches_lora_characteristics(const SignalCharacteristics& signal) {
+    // Only set when the chirp detector saw a preamble
+    return signal.modulation == Modulation::LORA_CSS;
+}
+
+bool ProtocolAnalyzer::matches_zigbee_characteristics(const SignalCharacteristics& signal) {
+    // Constant envelope and wider than any of the narrowband ism signals
+    return signal.modulation != Modulation::OOK && signal.bandwidth >= 200000;
+}
+
+void ProtocolAnalyzer::update_device_database(const Detection& detection, const ProtocolSignature* signature,
+                                              DeviceAlert* alert) {
+    // Devices are keyed by the signature they were first seen as, the
+    // readable id is only formatted when someone looks at it
+    const SignalCharacteristics& signal = detection.signal;
+    DeviceKey device_key = make_device_key(detection.signature, signal.frequency);
+    
+    std::lock_guard<std::mutex> lock(device_mutex);
     
-    // Check if device already exists
-    DetectedDevice* existing_device = find_device_by_signal(signal);
+    // Check if device already exists. One that drifted away from where it
+    // was first seen and is back there has the same key, it isn't new either.
+    DeviceHandle existing = device_db.find_by_frequency(signal.frequency);
+    if (!device_db.get(existing)) existing = device_db.find_by_key(device_key);
+    DetectedDevice* existing_device = device_db.get(existing);
     
+    const DetectedDevice* device = existing_device;
     if (existing_device) {
         // Update existing device
         existing_device->last_seen = std::chrono::steady_clock::now();
         existing_device->packet_count++;
-        existing_device->signal = signal; // Update signal characteristics
+        device_db.update_signal(existing, signal); // Update signal characteristics
+        devices_changed = true;
+        
+        // Raised once, a device stays suspicious until it is authorized
+        if (!existing_device->is_suspicious && is_suspicious_activity(*existing_device)) {
+            existing_device->is_suspicious = true;
+            raise_suspicious_alert(*existing_device);
+            if (device_store.is_open()) device_store.append_device(to_stored(*existing_device));
+        }
     } else {
         // Add new device
         DetectedDevice new_device;
-        new_device.protocol = protocol;
+        new_device.protocol = detection.protocol;
         new_device.signal = signal;
-        new_device.device_id = device_id;
-        new_device.device_type = get_protocol_name(protocol);
-        new_device.is_authorized = false; // Default to unauthorized
+        new_device.device_key = device_key;
+        new_device.device_type = signature ? signature->name : "Unknown Protocol";
+        new_device.is_authorized = authorized_keys.count(device_key) > 0; // Default to unauthorized
         new_device.first_seen = std::chrono::steady_clock::now();
         new_device.last_seen = new_device.first_seen;
         new_device.packet_count = 1;
+        new_device.is_suspicious = false;
         
-        // Add security flags for suspicious protocols
-        if (protocol == ProtocolType::GARAGE_DOOR) {
-            new_device.security_flags.push_back("CRITICAL: Garage door remote - replay attack risk");
-        }
-        if (protocol == ProtocolType::WEATHER_STATION) {
-            new_device.security_flags.push_back("INFO: Unencrypted sensor data");
+        // The signature's flag, for protocols with a known weakness
+        if (signature && !signature->security_flag.empty()) {
+            new_device.security_flags.push_back(signature->security_flag);
         }
         
-        detected_devices.push_back(new_device);
+        device = device_db.get(device_db.insert(new_device));
+        devices_changed = true;
+        if (device_store.is_open()) device_store.append_device(to_stored(*device));
         
-        std::cout << "New device detected: " << device_id << " (" << get_protocol_name(protocol) << ")" << std::endl;
+        std::string device_id = format_device_id(device_key);
+        log_printf("New device detected: %s (%s)", device_id.c_str(), device->device_type.c_str());
+        raise_new_device_alerts(*device, device_id);
     }
-}
-
-std::vector<float> ProtocolAnalyzer::compute_power_spectrum(const std::vector<std::complex<float>>& iq_data) {
-    std::vector<float> power_spectrum;
-    
-    if (iq_data.size() < DETECTION_FFT_SIZE) {
-        return power_spectrum;
-    }
-    
-    // Simple power calculation - in a real implementation, you'd use FFT
-    power_spectrum.reserve(DETECTION_FFT_SIZE);
     
-    for (size_t i = 0; i < DETECTION_FFT_SIZE && i < iq_data.size(); i++) {
-        float power = std::norm(iq_data[i]); // |I|^2 + |Q|^2
-        float power_db = 10.0f * std::log10(power + 1e-10f);
-        power_spectrum.push_back(power_db);
+    // Flags are more specific than the authorization state, report them first.
+    // A device keeps the flags of the signature it was first seen as.
+    if (alert && device) {
+        alert->device_key = device->device_key;
+        const char* reason = "";
+        if (!device->security_flags.empty()) {
+            reason = device->security_flags.front().c_str();
+        } else if (!device->is_authorized) {
+            reason = "unauthorized device";
+        }
+        snprintf(alert->reason, sizeof(alert->reason), "%s", reason);
     }
-    
-    return power_spectrum;
 }
 
 double ProtocolAnalyzer::estimate_noise_floor(const std::vector<float>& power_spectrum) {
     if (power_spectrum.empty()) return NOISE_FLOOR_DB;
     
-    // Simple noise floor estimation - use median or percentile
-    std::vector<float> sorted_power = power_spectrum;
-    std::sort(sorted_power.begin(), sorted_power.end());
-    
-    // Use 25th percentile as noise floor estimate
-    size_t index = sorted_power.size() / 4;
-    return sorted_power[index];
+    // Use 25th percentile as noise floor estimate, selecting it in place of a
+    // full sort. the scratch buffer keeps its capacity between blocks, one per
+    // thread since every dongle's pipeline has its own detect stage.
+    static thread_local std::vector<float> noise_floor_estimate;
+    noise_floor_estimate.assign(power_spectrum.begin(), power_spectrum.end());
+    size_t index = noise_floor_estimate.size() / 4;
+    std::nth_element(noise_floor_estimate.begin(), noise_floor_estimate.begin() + index, noise_floor_estimate.end());
+    return noise_floor_estimate[index];
 }
 
-std::vector<std::pair<double, double>> ProtocolAnalyzer::find_signal_peaks(
-    const std::vector<float>& power_spectrum, double threshold_db) {
+void ProtocolAnalyzer::find_signal_peaks(const std::vector<float>& power_spectrum, double threshold_db,
+                                         double center_freq, double sample_rate, PeakList& peaks) {
+    peaks.clear();
+    if (power_spectrum.size() < 3) return;
     
-    std::vector<std::pair<double, double>> peaks;
+    // every bin inside the usable band, the edges are the tuner's filter
+    // rolloff and only show attenuated or aliased copies
+    size_t guard = (size_t)(power_spectrum.size() * (1.0 - USABLE_BANDWIDTH_FRACTION) / 2);
+    size_t first_bin = std::max<size_t>(1, guard);
+    size_t last_bin = power_spectrum.size() - std::max<size_t>(1, guard);
     
-    for (size_t i = 1; i < power_spectrum.size() - 1; i++) {
+    for (size_t i = first_bin; i < last_bin; i++) {
         if (power_spectrum[i] > threshold_db &&
             power_spectrum[i] > power_spectrum[i-1] &&
             power_spectrum[i] > power_spectrum[i+1]) {
             
-            double frequency = frequency_from_fft_bin(i, DETECTION_FFT_SIZE, 2048000); // Assume 2.048 MHz sample rate
-            peaks.push_back({frequency, power_spectrum[i]});
+            double frequency = frequency_from_fft_bin(i, power_spectrum.size(), sample_rate, center_freq);
+            if (peaks.push_back({frequency, power_spectrum[i]})) continue;
+            
+            // Full, a stronger peak takes the place of the weakest one
+            auto weakest = std::min_element(peaks.begin(), peaks.end(),
+                [](const std::pair<double, double>& a, const std::pair<double, double>& b) {
+                    return a.second < b.second;
+                });
+            if (weakest->second < power_spectrum[i]) {
+                *weakest = {frequency, power_spectrum[i]};
+            }
         }
     }
-    
-    return peaks;
 }
 
-std::string ProtocolAnalyzer::get_protocol_name(ProtocolType type) const {
-    for (const auto& sig : protocol_signatures) {
-        if (sig.type == type) {
-            return sig.name;
-        }
-    }
-    return "Unknown Protocol";
+const ProtocolSignature* ProtocolAnalyzer::find_signature(const SignatureIndex& index, uint32_t id, ProtocolType type) {
+    const ProtocolSignature* signature = index.find_by_id(id);
+    return signature ? signature : index.find_by_type(type);
 }
 
-std::string ProtocolAnalyzer::get_protocol_description(ProtocolType type) const {
-    for (const auto& sig : protocol_signatures) {
-        if (sig.type == type) {
-            return sig.description;
-        }
-    }
-    return "Unknown protocol type";
+std::vector<DetectedDevice> ProtocolAnalyzer::get_detected_devices() const {
+    return get_device_snapshot()->devices;
+}
+
+size_t ProtocolAnalyzer::get_device_count() const {
+    return get_device_snapshot()->devices.size();
 }
 
 std::vector<DetectedDevice> ProtocolAnalyzer::get_unauthorized_devices() const {
     std::vector<DetectedDevice> unauthorized;
-    for (const auto& device : detected_devices) {
+    visit_devices([&unauthorized](const DetectedDevice& device) {
         if (!device.is_authorized) {
             unauthorized.push_back(device);
         }
-    }
+        return true;
+    });
     return unauthorized;
 }
 
 std::vector<std::string> ProtocolAnalyzer::get_security_alerts() const {
-    std::vector<std::string> alerts;
+    std::vector<SecurityAlert> active;
+    alert_engine.get_active(active);
     
-    for (const auto& device : detected_devices) {
-        if (!device.is_authorized) {
-            std::ostringstream alert;
-            alert << "UNAUTHORIZED DEVICE: " << device.device_id 
-                  << " (" << get_protocol_name(device.protocol) << ") "
-                  << "at " << std::fixed << std::setprecision(3) 
-                  << (device.signal.frequency / 1e6) << " MHz";
-            alerts.push_back(alert.str());
-        }
-        
-        // Add protocol-specific security flags
-        for (const auto& flag : device.security_flags) {
-            alerts.push_back(device.device_id + ": " + flag);
-        }
+    std::vector<std::string> alerts;
+    alerts.reserve(active.size());
+    for (const auto& alert : active) {
+        alerts.push_back(alert.text);
     }
-    
     return alerts;
 }
 
+bool ProtocolAnalyzer::is_suspicious_activity(const DetectedDevice& device) const {
+    // Remotes and sensors send a burst now and then. An unauthorized device
+    // that keeps transmitting is squatting on the channel, a jammer or a
+    // replay rig waiting for its moment.
+    if (device.is_authorized || device.packet_count < SUSPICIOUS_MIN_DETECTIONS) return false;
+    double seconds = std::chrono::duration<double>(device.last_seen - device.first_seen).count();
+    return seconds > 0.0 && device.packet_count / seconds >= SUSPICIOUS_DETECTIONS_PER_S;
+}
+
+void ProtocolAnalyzer::raise_new_device_alerts(const DetectedDevice& device, const std::string& device_id) {
+    // Formatted once here, readers only ever copy the finished text
+    char text[256];
+    if (!device.is_authorized) {
+        snprintf(text, sizeof(text), "UNAUTHORIZED DEVICE: %s (%s) at %.3f MHz", device_id.c_str(),
+                 device.device_type.c_str(), device.signal.frequency / 1e6);
+        alert_engine.raise(AlertKind::UNAUTHORIZED_DEVICE, AlertSeverity::WARNING, device.device_key, text);
+    }
+    for (const auto& flag : device.security_flags) {
+        snprintf(text, sizeof(text), "%s: %s", device_id.c_str(), flag.c_str());
+        alert_engine.raise(AlertKind::SECURITY_FLAG, flag_severity(flag), device.device_key, text);
+    }
+}
+
+void ProtocolAnalyzer::raise_suspicious_alert(const DetectedDevice& device) {
+    double seconds = std::chrono::duration<double>(device.last_seen - device.first_seen).count();
+    char text[256];
+    snprintf(text, sizeof(text), "SUSPICIOUS: %s transmitting constantly, %d detections in %.0f s",
+             format_device_id(device.device_key).c_str(), device.packet_count, seconds);
+    alert_engine.raise(AlertKind::SUSPICIOUS_ACTIVITY, AlertSeverity::CRITICAL, device.device_key, text);
+}
+
 // Helper function implementations
-std::string ProtocolAnalyzer::generate_device_id(const SignalCharacteristics& signal, ProtocolType protocol) {
-    std::ostringstream id;
-    id << get_protocol_name(protocol) << "_" 
-       << std::fixed << std::setprecision(3) << (signal.frequency / 1e6) << "MHz_" 
-       << std::hex << std::hash<double>{}(signal.frequency);
-    return id.str();
+std::string ProtocolAnalyzer::format_device_id(DeviceKey key) const {
+    char frequency[32];
+    snprintf(frequency, sizeof(frequency), "_%.6fMHz", device_key_frequency(key) / 1e6);
+    SignatureIndexPtr index = get_signature_index();
+    const ProtocolSignature* signature = index->find_by_id(device_key_signature(key));
+    return (signature ? signature->name : std::string("Unknown Protocol")) + frequency;
+}
+
+AlertSeverity ProtocolAnalyzer::flag_severity(const std::string& flag) {
+    // Flags lead with their severity
+    if (flag.compare(0, 9, "CRITICAL:") == 0) return AlertSeverity::CRITICAL;
+    if (flag.compare(0, 5, "INFO:") == 0) return AlertSeverity::INFO;
+    return AlertSeverity::WARNING;
+}
+
+double ProtocolAnalyzer::frequency_from_fft_bin(int bin, int fft_size, double sample_rate, double center_freq) {
+    // bins are fft-shifted, so the middle bin sits on the tuned frequency
+    return center_freq + ((bin - fft_size / 2) * sample_rate) / fft_size;
 }
 
-bool ProtocolAnalyzer::is_frequency_in_range(double frequency, double min_freq, double max_freq) {
-    return frequency >= min_freq && frequency <= max_freq;
+void ProtocolAnalyzer::mark_device_authorized(DeviceKey device_key) {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    DetectedDevice* device = device_db.get(device_db.find_by_key(device_key));
+    if (device) {
+        device->is_authorized = true;
+        device->is_suspicious = false;
+        authorized_keys.insert(device_key);
+        if (device_store.is_open()) device_store.append_authorized(device_key, true);
+        devices_changed = true;
+        publish_devices(true);
+        // Its flags still stand, being known doesn't fix the protocol
+        alert_engine.resolve(device_key, AlertKind::UNAUTHORIZED_DEVICE);
+        alert_engine.resolve(device_key, AlertKind::SUSPICIOUS_ACTIVITY);
+        std::cout << "Device " << format_device_id(device_key) << " marked as authorized" << std::endl;
+    }
 }
 
-double ProtocolAnalyzer::frequency_from_fft_bin(int bin, int fft_size, double sample_rate) {
-    return (bin * sample_rate) / fft_size;
+void ProtocolAnalyzer::remove_device(DeviceKey device_key) {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if (device_db.remove(device_db.find_by_key(device_key))) {
+        devices_changed = true;
+        publish_devices(true);
+        alert_engine.resolve_device(device_key);
+    }
+    // Removing is forgetting, the device comes back as unknown
+    if (authorized_keys.erase(device_key) && device_store.is_open()) {
+        device_store.append_authorized(device_key, false);
+    }
+    if (device_store.is_open()) device_store.append_remove(device_key);
 }
 
-DetectedDevice* ProtocolAnalyzer::find_device_by_signal(const SignalCharacteristics& signal) {
-    const double freq_tolerance = 50000; // 50 kHz tolerance
+void ProtocolAnalyzer::cleanup_old_devices() {
+    auto cutoff = std::chrono::steady_clock::now() - std::chrono::seconds(DEVICE_EXPIRY_S);
     
-    for (auto& device : detected_devices) {
-        if (std::abs(device.signal.frequency - signal.frequency) < freq_tolerance) {
-            return &device;
+    // A few slots per call, so expiry never holds up the writers for a full pass
+    std::lock_guard<std::mutex> lock(device_mutex);
+    expired_keys.clear();
+    if (device_db.expire_step(cutoff, EXPIRY_SLOTS_PER_STEP, &expired_keys) > 0) {
+        devices_changed = true;
+        for (DeviceKey key : expired_keys) {
+            alert_engine.resolve_device(key);
+            if (device_store.is_open()) device_store.append_remove(key);
+        }
+    }
+    // Only the copy happens here, the snapshot is written on store_saver
+    // so no writer waits for the disk
+    if (!store_saving && device_store.is_open() &&
+        (device_store.get_journal_entries() >= STORE_COMPACT_ENTRIES ||
+         std::chrono::steady_clock::now() - last_store_save >= std::chrono::seconds(STORE_SAVE_INTERVAL_S))) {
+        std::vector<StoredDevice> devices;
+        std::vector<DeviceKey> authorized;
+        if (begin_store_save(devices, authorized)) {
+            if (store_saver.joinable()) store_saver.join();   // finished, store_saving was clear
+            store_saving = true;
+            store_saver = std::thread([this](std::vector<StoredDevice> saved_devices,
+                                             std::vector<DeviceKey> saved_authorized) {
+                device_store.finish_compact(saved_devices, saved_authorized);
+                store_saving = false;
+            }, std::move(devices), std::move(authorized));
         }
     }
-    return nullptr;
+    // Also where changes held back by the interval go out once detections stop
+    publish_devices(false);
 }
 
-void ProtocolAnalyzer::mark_device_authorized(const std::string& device_id) {
-    for (auto& device : detected_devices) {
-        if (device.device_id == device_id) {
-            device.is_authorized = true;
-            std::cout << "Device " << device_id << " marked as authorized" << std::endl;
-            return;
-        }
+void ProtocolAnalyzer::flush_devices() {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    publish_devices(true);
+}
+
+bool ProtocolAnalyzer::open_device_store(const std::string& path) {
+    auto started = std::chrono::steady_clock::now();
+    StoredState state;
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if (!device_store.open(path, state)) return false;
+    
+    authorized_keys.clear();
+    authorized_keys.insert(state.authorized.begin(), state.authorized.end());
+    device_db.clear();
+    SignatureIndexPtr index = get_signature_index();
+    for (const StoredDevice& stored : state.devices) {
+        device_db.insert(from_stored(stored, *index, state.last_alive_ms));
+    }
+    devices_changed = true;
+    publish_devices(true);
+    last_store_save = std::chrono::steady_clock::now();
+    
+    double elapsed_ms = std::chrono::duration<double, std::milli>(last_store_save - started).count();
+    std::cout << "Loaded " << state.devices.size() << " devices and " << authorized_keys.size()
+              << " authorized keys from " << path << " in " << elapsed_ms << " ms" << std::endl;
+    return true;
+}
+
+bool ProtocolAnalyzer::save_device_store() {
+    // A save in the background finishes first, the store runs one at a time
+    std::vector<StoredDevice> devices;
+    std::vector<DeviceKey> authorized;
+    {
+        std::lock_guard<std::mutex> lock(device_mutex);
+        if (store_saver.joinable()) store_saver.join();
+        if (!device_store.is_open() || !begin_store_save(devices, authorized)) return false;
     }
+    return device_store.finish_compact(devices, authorized);
 }
 
-void ProtocolAnalyzer::cleanup_old_devices() {
+bool ProtocolAnalyzer::begin_store_save(std::vector<StoredDevice>& devices, std::vector<DeviceKey>& authorized) {
+    // Changes after the copy go to the journal under the store's next generation
+    devices.reserve(device_db.size());
+    device_db.for_each([&devices](const DetectedDevice& device) {
+        devices.push_back(to_stored(device));
+        return true;
+    });
+    authorized.assign(authorized_keys.begin(), authorized_keys.end());
+    last_store_save = std::chrono::steady_clock::now();
+    return device_store.begin_compact();
+}
+
+StoredDevice ProtocolAnalyzer::to_stored(const DetectedDevice& device) {
+    // Steady time to wall time through the current offset between the two
+    int64_t now_ms = DeviceStore::wall_time_ms();
     auto now = std::chrono::steady_clock::now();
-    const auto timeout = std::chrono::minutes(10); // Remove devices not seen for 10 minutes
+    auto wall_ms = [now_ms, now](std::chrono::steady_clock::time_point time) {
+        return now_ms - std::chrono::duration_cast<std::chrono::milliseconds>(now - time).count();
+    };
     
-    detected_devices.erase(
-        std::remove_if(detected_devices.begin(), detected_devices.end(),
-            [now, timeout](const DetectedDevice& device) {
-                return (now - device.last_seen) > timeout;
-            }
-        ),
-        detected_devices.end()
-    );
+    StoredDevice stored;
+    memset(&stored, 0, sizeof(stored));
+    stored.device_key = device.device_key;
+    stored.first_seen_ms = wall_ms(device.first_seen);
+    stored.last_seen_ms = wall_ms(device.last_seen);
+    stored.frequency = device.signal.frequency;
+    stored.bandwidth = device.signal.bandwidth;
+    stored.power_db = device.signal.power_db;
+    stored.snr_db = device.signal.snr_db;
+    stored.symbol_rate = device.signal.symbol_rate;
+    stored.burst_duration = device.signal.burst_duration;
+    stored.packet_count = (uint32_t)device.packet_count;
+    stored.protocol = (uint8_t)device.protocol;
+    stored.modulation = (uint8_t)device.signal.modulation;
+    stored.is_authorized = device.is_authorized ? 1 : 0;
+    stored.flags = (device.signal.is_burst ? STORED_BURST : 0) | (device.is_suspicious ? STORED_SUSPICIOUS : 0);
+    return stored;
+}
+
+DetectedDevice ProtocolAnalyzer::from_stored(const StoredDevice& stored, const SignatureIndex& index,
+                                             int64_t last_alive_ms) const {
+    auto now = std::chrono::steady_clock::now();
+    auto steady_time = [now, last_alive_ms](int64_t ms) {
+        return now - std::chrono::milliseconds(std::max<int64_t>(0, last_alive_ms - ms));
+    };
+    
+    DetectedDevice device;
+    device.protocol = (ProtocolType)stored.protocol;
+    device.device_key = stored.device_key;
+    // A device whose signature was dropped from the packs is named after its type
+    const ProtocolSignature* signature = find_signature(index, device_key_signature(stored.device_key), device.protocol);
+    device.device_type = signature ? signature->name : "Unknown Protocol";
+    device.is_authorized = stored.is_authorized || authorized_keys.count(stored.device_key) > 0;
+    device.is_suspicious = (stored.flags & STORED_SUSPICIOUS) != 0;
+    device.first_seen = steady_time(stored.first_seen_ms);
+    device.last_seen = steady_time(stored.last_seen_ms);
+    device.packet_count = (int)stored.packet_count;
+    
+    device.signal.frequency = stored.frequency;
+    device.signal.bandwidth = stored.bandwidth;
+    device.signal.power_db = stored.power_db;
+    device.signal.snr_db = stored.snr_db;
+    device.signal.modulation = (Modulation)stored.modulation;
+    device.signal.symbol_rate = stored.symbol_rate;
+    device.signal.is_burst = (stored.flags & STORED_BURST) != 0;
+    device.signal.burst_duration = stored.burst_duration;
+    device.signal.burst_start_sample = 0;   // the capture it counted in is gone
+    device.signal.detection_time = device.last_seen;
+    
+    if (signature && !signature->security_flag.empty()) {
+        device.security_flags.push_back(signature->security_flag);
+    }
+    return device;
+}
+
+void ProtocolAnalyzer::publish_devices(bool force) {
+    if (!devices_changed) return;
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now - last_publish < std::chrono::milliseconds(SNAPSHOT_INTERVAL_MS)) return;
+    
+    // A pooled snapshot only the pool holds has been let go by every reader
+    std::shared_ptr<DeviceSnapshot> snapshot;
+    for (const auto& pooled : snapshot_pool) {
+        if (pooled.use_count() == 1) {
+            snapshot = pooled;
+            break;
+        }
+    }
+    if (snapshot) {
+        // The last reader dropped it on another thread, see its reads before we write
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } else {
+        snapshot = std::make_shared<DeviceSnapshot>();
+        if (snapshot_pool.size() < SNAPSHOT_POOL_SIZE) snapshot_pool.push_back(snapshot);
+    }
+    
+    snapshot->epoch = ++device_epoch;
+    device_db.copy_to(snapshot->devices);
+    std::atomic_store(&device_snapshot, DeviceSnapshotPtr(snapshot));
+    devices_changed = false;
+    last_publish = now;
 }
@@ -5,67 +5,31 @@
 #include <complex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <chrono>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <memory>
+#include "protocol_types.h"
+#include "device_database.h"
+#include "signature_index.h"
+#include "spectrum_engine.h"
+#include "burst_detector.h"
+#include "demodulator.h"
+#include "detection_sink.h"
+#include "alert_engine.h"
+#include "device_store.h"
 
 // forward declaration
 class SimpleSDR;
 
-enum class ProtocolType {
-    UNKNOWN = 0,
-    ISM_433_OOK,           // 433mhz on-off keying (garage doors, weather stations)
-    ISM_433_FSK,           // 433mhz frequency shift keying
-    ISM_915_OOK,           // 915mhz on-off keying (us ism band)
-    ISM_868_OOK,           // 868mhz on-off keying (eu ism band)
-    ZIGBEE_915,            // zigbee 915mhz (us)
-    ZIGBEE_868,            // zigbee 868mhz (eu)
-    LORA_433,              // lora 433mhz
-    LORA_868,              // lora 868mhz (eu)
-    LORA_915,              // lora 915mhz (us)
-    WIRELESS_MBUS,         // wireless m-bus (meter reading)
-    TPMS,                  // tire pressure monitoring system
-    WEATHER_STATION,       // weather station protocols
-    GARAGE_DOOR,           // garage door remotes
-    SECURITY_SENSOR        // home security sensors
-};
-
-struct SignalCharacteristics {
-    double frequency;           // center frequency in hz
-    double bandwidth;           // signal bandwidth in hz
-    double power_db;           // signal power in db
-    double snr_db;             // signal-to-noise ratio in db
-    std::string modulation;    // modulation type (ook, fsk, psk, lora)
-    double symbol_rate;        // symbol rate in symbols/second
-    bool is_burst;             // is this a burst transmission?
-    double burst_duration;     // duration of burst in seconds
-    std::chrono::steady_clock::time_point detection_time;
-};
-
-struct ProtocolSignature {
-    ProtocolType type;
-    std::string name;
-    std::string description;
-    double frequency_min;      // minimum frequency in hz
-    double frequency_max;      // maximum frequency in hz
-    double bandwidth_typical;  // typical bandwidth in hz
-    std::string modulation;    // expected modulation
-    double symbol_rate_min;    // minimum symbol rate
-    double symbol_rate_max;    // maximum symbol rate
-    bool is_burst_mode;        // typically burst or continuous
-    std::vector<std::string> common_devices; // common device types
-    std::string security_notes; // security implications
-};
-
-struct DetectedDevice {
-    ProtocolType protocol;
-    SignalCharacteristics signal;
-    std::string device_id;     // unique identifier if available
-    std::string manufacturer;  // detected manufacturer
-    std::string device_type;   // type of device
-    bool is_authorized;        // whether device is known/authorized
-    std::chrono::steady_clock::time_point first_seen;
-    std::chrono::steady_clock::time_point last_seen;
-    int packet_count;          // number of packets detected
-    std::vector<std::string> security_flags; // security concerns
+// narrow steps the tuner in fixed 250 khz increments, wideband plans hops from
+// the usable sample rate so every capture covers as much of a range as it can
+enum class ScanMode {
+    NARROW,
+    WIDEBAND
 };
 
 class ProtocolAnalyzer {
@@ -76,24 +40,108 @@ private:
     static const int DETECTION_FFT_SIZE = 2048;
     static constexpr double SIGNAL_THRESHOLD_DB = -60.0;  // minimum signal level
     static constexpr double NOISE_FLOOR_DB = -90.0;       // typical noise floor
+    static constexpr double DETECTION_MARGIN_DB = 6.0;    // peak threshold above noise floor
+    static constexpr double BURST_MATCH_HZ = 50000.0;     // peak to burst frequency tolerance
+    static constexpr double SYMBOL_RATE_SLACK = 0.2;      // measured rate may sit this far outside a signature
+    static constexpr double USABLE_BANDWIDTH_FRACTION = 0.8; // rest of fs is lost to the tuner's filter rolloff
+    static const uint32_t NARROW_SCAN_STEP = 250000;
+    static const size_t PARALLEL_MIN_PEAKS = 8;           // fewer peaks are classified on the calling thread
     
     // frequency scan ranges
     std::vector<std::pair<uint32_t, uint32_t>> scan_ranges;
     
-    // protocol signatures database
-    std::vector<ProtocolSignature> protocol_signatures;
+    // protocol signatures, indexed by frequency and type. readers take the
+    // current index with one atomic load and hold it while they use pointers
+    // into it, a reload builds a new one off to the side and swaps it in. a
+    // replaced index is freed when its last reader lets go.
+    static const int SIGNATURE_WATCH_MS = 2000;
+    SignatureIndexPtr signature_index;                   // only through std::atomic_load / atomic_store
+    std::vector<ProtocolSignature> builtin_signatures;
+    std::vector<ProtocolSignature> custom_signatures;
+    std::string signature_pack_path;                     // empty without packs
+    uint64_t signature_pack_stamp;
+    std::mutex signature_mutex;                          // everything above but the pointer
+    std::thread signature_watcher;
+    std::mutex watch_mutex;
+    std::condition_variable watch_wake;
+    bool watching;
+    
+    // detected devices. device_mutex only serializes the writers (every
+    // tuner's database stage, authorize and remove), readers get the last
+    // published snapshot and never wait for them. a stream of detections is
+    // published at most every SNAPSHOT_INTERVAL_MS, pooled snapshots nobody
+    // holds anymore are refilled instead of allocated.
+    static const int SNAPSHOT_INTERVAL_MS = 100;
+    static const size_t SNAPSHOT_POOL_SIZE = 4;
+    static const int DEVICE_EXPIRY_S = 600;              // devices not seen for this long are dropped
+    static const size_t EXPIRY_SLOTS_PER_STEP = 32;      // database slots looked at per block
+    DeviceDatabase device_db;
+    mutable std::mutex device_mutex;
+    bool devices_changed;                                // since the last publish, under device_mutex
+    uint64_t device_epoch;
+    std::chrono::steady_clock::time_point last_publish;
+    std::vector<std::shared_ptr<DeviceSnapshot>> snapshot_pool;
+    DeviceSnapshotPtr device_snapshot;                   // only through std::atomic_load / atomic_store
+    std::vector<DeviceKey> expired_keys;                 // cleanup scratch, under device_mutex
+    
+    // alerts are raised by the writers as device state changes
+    static const int SUSPICIOUS_MIN_DETECTIONS = 100;
+    static constexpr double SUSPICIOUS_DETECTIONS_PER_S = 10.0;
+    AlertEngine alert_engine;
+    
+    // persistence, every change goes to the store's journal as it happens and
+    // the whole database is snapshotted every STORE_SAVE_INTERVAL_S or once
+    // the journal holds STORE_COMPACT_ENTRIES. the allowlist outlives the
+    // devices on it, an expired device is authorized again when it returns.
+    // the writers only copy the database for a snapshot, store_saver writes it.
+    static const int STORE_SAVE_INTERVAL_S = 300;
+    static const size_t STORE_COMPACT_ENTRIES = 4096;
+    DeviceStore device_store;
+    std::unordered_set<DeviceKey> authorized_keys;       // under device_mutex
+    std::chrono::steady_clock::time_point last_store_save;
+    std::thread store_saver;                             // started and joined under device_mutex
+    std::atomic<bool> store_saving;
     
-    // detected devices
-    std::vector<DetectedDevice> detected_devices;
+    // analysis state. the scan is advanced by the scan scheduler threads while
+    // the gui starts, stops and reads it, scan_mutex covers the plan and the
+    // tuners. current_scan_frequency mirrors the first tuner for the gui.
+    std::atomic<uint32_t> current_scan_frequency;
+    std::atomic<bool> scanning_active;
+    mutable std::mutex scan_mutex;
     
-    // analysis state
-    uint32_t current_scan_frequency;
-    size_t current_range_index;
-    bool scanning_active;
+    // tuner centers for one pass over every scan range, rebuilt when a scan
+    // starts or the mode changes
+    struct ScanHop {
+        uint32_t center_freq;
+        size_t range_index;
+    };
+    ScanMode scan_mode;
+    std::vector<ScanHop> scan_plan;
     
-    // signal processing buffers
-    std::vector<float> power_spectrum;
-    std::vector<float> noise_floor_estimate;
+    // one scan cursor per dongle. each walks its own contiguous slice of the
+    // plan, sorted by frequency, so n dongles finish a cycle n times faster.
+    struct ScanTuner {
+        SimpleSDR* sdr;
+        std::vector<size_t> hops;      // indices into scan_plan
+        size_t position;               // into hops
+        size_t current_range;
+    };
+    std::vector<ScanTuner> scan_tuners;
+    
+    // extra outputs for every detection, attached before the pipelines start.
+    // without any the detections are logged to the console.
+    std::vector<DetectionSink*> detection_sinks;
+    
+    // signal processing buffers, only used by the single threaded
+    // detect_signals() path. the pipeline brings its own spectrum engine
+    // and runs burst detection per channel.
+    SpectrumEngine spectrum_engine;
+    SpectrumFrame detection_frame;
+    BurstDetector burst_detector;          // full rate
+    BurstStream burst_stream;
+    std::vector<BurstEvent> detection_bursts;
+    PeakList detection_peaks;
+    std::vector<Detection> detection_list;
     
 public:
     ProtocolAnalyzer();
@@ -101,48 +149,114 @@ public:
     
     // initialization
     bool initialize();
-    void set_sdr_reference(SimpleSDR* sdr) { sdr_ref = sdr; }
+    // the first sdr also serves detect_signals(), more tuners split the scan
+    void set_sdr_reference(SimpleSDR* sdr);
+    size_t add_tuner(SimpleSDR* sdr);
+    size_t get_tuner_count() const;
     
     // protocol signature database
     void load_protocol_signatures();
+    // kept across pack reloads, after the packs
     void add_custom_signature(const ProtocolSignature& signature);
+    // signature packs from a file or a directory of .sig files, merged over
+    // the built in signatures after initialize(). with watch they are
+    // reloaded whenever they change, a pack that fails to load keeps the
+    // signatures as they were.
+    bool load_signature_packs(const std::string& path, bool watch);
+    bool reload_signature_packs();
+    void stop_signature_watch();
     
     // frequency scanning
     void start_frequency_scan();
     void stop_frequency_scan();
     bool is_scanning() const { return scanning_active; }
-    void update_scan(); // call this every once and a while to advance scan
+    void update_scan(size_t tuner = 0); // call this every once and a while to advance scan
+    void set_scan_mode(ScanMode mode);
+    ScanMode get_scan_mode() const { return scan_mode; }
+    size_t get_scan_hop_count() const;
+    size_t get_current_range_index(size_t tuner = 0) const;
+    size_t get_scan_range_count() const { return scan_ranges.size(); }
+    // fixed when the analyzer is built, start and end in hz
+    const std::vector<std::pair<uint32_t, uint32_t>>& get_scan_ranges() const { return scan_ranges; }
     
-    // signal detection and analysis
+    // signal detection and analysis, runs every stage below on the caller thread
     bool detect_signals(const std::vector<std::complex<float>>& iq_data);
+    
+    // individual pipeline stages, each can run on its own worker thread.
+    // spectra come from a SpectrumEngine and are fft-shifted (bin 0 = -fs/2).
+    int get_detection_fft_size() const { return DETECTION_FFT_SIZE; }
+    double estimate_noise_floor(const std::vector<float>& power_spectrum);
+    // peaks is overwritten, the strongest PeakList::capacity() peaks are kept
+    void find_signal_peaks(const std::vector<float>& power_spectrum, double threshold_db,
+                           double center_freq, double sample_rate, PeakList& peaks);
+    double detection_threshold(double noise_floor) const { return noise_floor + DETECTION_MARGIN_DB; }
+    // detections is overwritten, pass the same vector every block to keep its capacity
+    void classify_peaks(const std::vector<std::complex<float>>& iq_data, const PeakList& peaks,
+                        double noise_floor, const std::vector<BurstEvent>& bursts,
+                        const std::vector<DemodResult>& demods, std::vector<Detection>& detections);
+    // alerts, when given, gets one entry per detection
+    void record_detections(const std::vector<Detection>& detections, std::vector<DeviceAlert>* alerts = nullptr);
+    // not owned, must outlive the pipelines
+    void add_detection_sink(DetectionSink* sink) { detection_sinks.push_back(sink); }
+    
+    // burst may be null when nothing was seen switching on or off near the peak,
+    // demod is null when the burst's samples weren't demodulated
     SignalCharacteristics analyze_signal(const std::vector<std::complex<float>>& iq_data, 
-                                       double peak_frequency, double peak_power);
-    ProtocolType classify_protocol(const SignalCharacteristics& signal);
+                                       double peak_frequency, double peak_power, double noise_floor,
+                                       const BurstEvent* burst, const DemodResult* demod);
+    // best scoring signature of index covering the frequency, ties go to
+    // load order. null if none covers it, else points into index.
+    const ProtocolSignature* classify_protocol(const SignatureIndex& index, const SignalCharacteristics& signal);
+    // the signatures as last published, lock free and never null
+    SignatureIndexPtr get_signature_index() const { return std::atomic_load(&signature_index); }
+    
+    // device management. signature names the device and gives its flag,
+    // as found by find_signature for the detection, null if none is loaded.
+    // it is copied from, the caller keeps its index alive for the call.
+    void update_device_database(const Detection& detection, const ProtocolSignature* signature,
+                                DeviceAlert* alert = nullptr);
+    // the devices as last published, lock free and never null
+    DeviceSnapshotPtr get_device_snapshot() const { return std::atomic_load(&device_snapshot); }
+    std::vector<DetectedDevice> get_detected_devices() const; // full copy, avoid per frame
+    size_t get_device_count() const;
+    void mark_device_authorized(DeviceKey device_key);
+    void remove_device(DeviceKey device_key);
+    // signature name and the frequency the device was first seen on
+    std::string format_device_id(DeviceKey device_key) const;
     
-    // device management
-    void update_device_database(const SignalCharacteristics& signal, ProtocolType protocol);
-    std::vector<DetectedDevice> get_detected_devices() const { return detected_devices; }
-    void mark_device_authorized(const std::string& device_id);
-    void remove_device(const std::string& device_id);
+    // walk the published devices without copying them. fn gets a
+    // const DetectedDevice& and returns false to stop.
+    template <typename Fn>
+    void visit_devices(Fn fn) const {
+        DeviceSnapshotPtr snapshot = get_device_snapshot();
+        for (const auto& device : snapshot->devices) {
+            if (!fn(device)) return;
+        }
+    }
+    // one incremental expiry step, the database stages call it every block
+    void cleanup_old_devices();
+    // publish whatever is still held back, when a pipeline stops
+    void flush_devices();
+    // load the devices and the allowlist from path and keep them there from
+    // now on. call before the pipelines start, a missing file is an empty store.
+    bool open_device_store(const std::string& path);
+    // snapshot everything into the store now, at shutdown
+    bool save_device_store();
     
     // security analysis
     std::vector<DetectedDevice> get_unauthorized_devices() const;
+    // the active alerts' text, most important first
     std::vector<std::string> get_security_alerts() const;
+    AlertEngine& get_alert_engine() { return alert_engine; }
+    const AlertEngine& get_alert_engine() const { return alert_engine; }
+    // unauthorized and transmitting far more often than a remote or sensor would
     bool is_suspicious_activity(const DetectedDevice& device) const;
     
     // information retrieval
-    std::vector<ProtocolSignature> get_protocol_signatures() const { return protocol_signatures; }
-    std::string get_protocol_name(ProtocolType type) const;
-    std::string get_protocol_description(ProtocolType type) const;
+    std::vector<ProtocolSignature> get_protocol_signatures() const { return get_signature_index()->get_signatures(); }
     uint32_t get_current_frequency() const { return current_scan_frequency; }
     
 private:
-    // signal processing helpers
-    std::vector<float> compute_power_spectrum(const std::vector<std::complex<float>>& iq_data);
-    double estimate_noise_floor(const std::vector<float>& power_spectrum);
-    std::vector<std::pair<double, double>> find_signal_peaks(const std::vector<float>& power_spectrum, 
-                                                          double threshold_db);
-    
     // protocol classification helpers
     bool matches_ook_characteristics(const SignalCharacteristics& signal);
     bool matches_fsk_characteristics(const SignalCharacteristics& signal);
@@ -150,13 +264,35 @@ private:
     bool matches_zigbee_characteristics(const SignalCharacteristics& signal);
     
     // utility functions
-    std::string generate_device_id(const SignalCharacteristics& signal, ProtocolType protocol);
-    bool is_frequency_in_range(double frequency, double min_freq, double max_freq);
-    double frequency_from_fft_bin(int bin, int fft_size, double sample_rate);
+    // the signature of index with that id, else its first one of type for a
+    // signature no longer loaded. null if neither is.
+    static const ProtocolSignature* find_signature(const SignatureIndex& index, uint32_t id, ProtocolType type);
+    static AlertSeverity flag_severity(const std::string& flag);
+    double frequency_from_fft_bin(int bin, int fft_size, double sample_rate, double center_freq);
+    void plan_scan_hops(uint32_t sample_rate);
+    // index of the burst nearest to frequency, -1 if none is within BURST_MATCH_HZ
+    int find_burst(const std::vector<BurstEvent>& bursts, double frequency) const;
+    bool matches_modulation(const SignalCharacteristics& signal, const ProtocolSignature& signature);
+    double score_signature(const SignalCharacteristics& signal, const ProtocolSignature& signature);
+    void assign_scan_hops();
+    void tune_to_hop(size_t tuner, size_t position);
     
-    // database helpers
-    DetectedDevice* find_device_by_signal(const SignalCharacteristics& signal);
-    void cleanup_old_devices(); // remove devices not seen recently
+    // database helpers, called with device_mutex held. unless forced a
+    // publish waits for SNAPSHOT_INTERVAL_MS since the last one.
+    void publish_devices(bool force);
+    void raise_new_device_alerts(const DetectedDevice& device, const std::string& device_id);
+    void raise_suspicious_alert(const DetectedDevice& device);
+    // compiles and swaps in a new index, called with signature_mutex held.
+    // false, keeping the current one, if two signature ids collide.
+    bool publish_signatures(std::vector<ProtocolSignature> signatures);
+    bool merge_signature_packs(std::vector<ProtocolSignature>& signatures, uint64_t& stamp);
+    void watch_signature_packs();
+    // copies the database for the store and starts its compaction, called
+    // with device_mutex held
+    bool begin_store_save(std::vector<StoredDevice>& devices, std::vector<DeviceKey>& authorized);
+    static StoredDevice to_stored(const DetectedDevice& device);
+    // times in the store are shifted so the time the previous run was down doesn't count
+    DetectedDevice from_stored(const StoredDevice& stored, const SignatureIndex& index, int64_t last_alive_ms) const;
 };
 
 #endif // PROTOCOL_ANALYZER_H
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef PROTOCOL_TYPES_H
+#define PROTOCOL_TYPES_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include "fixed_vector.h"
+
+enum class ProtocolType {
+    UNKNOWN = 0,
+    ISM_433_OOK,           // 433mhz on-off keying (garage doors, weather stations)
+    ISM_433_FSK,           // 433mhz frequency shift keying
+    ISM_915_OOK,           // 915mhz on-off keying (us ism band)
+    ISM_868_OOK,           // 868mhz on-off keying (eu ism band)
+    ZIGBEE_915,            // zigbee 915mhz (us)
+    ZIGBEE_868,            // zigbee 868mhz (eu)
+    LORA_433,              // lora 433mhz
+    LORA_868,              // lora 868mhz (eu)
+    LORA_915,              // lora 915mhz (us)
+    WIRELESS_MBUS,         // wireless m-bus (meter reading)
+    TPMS,                  // tire pressure monitoring system
+    WEATHER_STATION,       // weather station protocols
+    GARAGE_DOOR,           // garage door remotes
+    SECURITY_SENSOR        // home security sensors
+};
+
+// what the demodulator decided and what a signature expects. unknown means
+// undecided and never conflicts with a signature.
+enum class Modulation : uint8_t {
+    UNKNOWN = 0,
+    OOK,
+    FSK,
+    LORA_CSS,
+    OQPSK
+};
+
+// display name, empty for unknown
+inline const char* modulation_name(Modulation modulation) {
+    switch (modulation) {
+        case Modulation::OOK: return "OOK";
+        case Modulation::FSK: return "FSK";
+        case Modulation::LORA_CSS: return "LoRa CSS";
+        case Modulation::OQPSK: return "OQPSK";
+        default: return "";
+    }
+}
+
+// a signature is identified by its name, packs replace signatures by name
+// too. the id is a 24 bit fnv-1a hash of it, the same on every run and after
+// every reload, SignatureIndex refuses a set in which two ids collide.
+inline uint32_t signature_id(const std::string& name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return (hash >> 24) ^ (hash & 0xffffff);
+}
+
+// devices are keyed by the signature and the hz they were first seen on, the
+// readable id is only formatted for display (ProtocolAnalyzer::format_device_id)
+typedef uint64_t DeviceKey;
+
+inline DeviceKey make_device_key(uint32_t signature, double frequency) {
+    return ((DeviceKey)(signature & 0xffffff) << 40) | ((DeviceKey)(frequency + 0.5) & 0xffffffffffULL);
+}
+inline uint32_t device_key_signature(DeviceKey key) { return (uint32_t)(key >> 40); }
+inline uint64_t device_key_frequency(DeviceKey key) { return key & 0xffffffffffULL; }
+
+// spectrum peaks of one block as (frequency hz, power db). the strongest
+// MAX_SIGNAL_PEAKS are kept, more than that is noise crossing the threshold.
+static const size_t MAX_SIGNAL_PEAKS = 64;
+typedef FixedVector<std::pair<double, double>, MAX_SIGNAL_PEAKS> PeakList;
+
+struct SignalCharacteristics {
+    double frequency;           // center frequency in hz
+    double bandwidth;           // signal bandwidth in hz
+    double power_db;           // signal power in db
+    double snr_db;             // signal-to-noise ratio in db
+    Modulation modulation;     // unknown unless the demodulator could tell
+    double symbol_rate;        // symbol rate in symbols/second
+    bool is_burst;             // is this a burst transmission?
+    double burst_duration;     // duration of burst in seconds
+    uint64_t burst_start_sample; // capture sample index where the burst began, 0 if unknown
+    std::chrono::steady_clock::time_point detection_time;
+};
+
+struct ProtocolSignature {
+    ProtocolType type;
+    std::string name;
+    std::string description;
+    double frequency_min;      // minimum frequency in hz
+    double frequency_max;      // maximum frequency in hz
+    double bandwidth_typical;  // typical bandwidth in hz
+    Modulation modulation;     // expected modulation
+    double symbol_rate_min;    // minimum symbol rate
+    double symbol_rate_max;    // maximum symbol rate
+    bool is_burst_mode;        // typically burst or continuous
+    std::vector<std::string> common_devices; // common device types
+    std::string security_notes; // security implications
+    std::string security_flag;  // alert for every device of it, leads with CRITICAL:, WARNING: or INFO:, empty if none
+};
+
+// one classified peak, handed from the classify stage to the device database.
+// the signature travels as its id, the index may be reloaded in between.
+struct Detection {
+    SignalCharacteristics signal;
+    ProtocolType protocol;
+    uint32_t signature;        // signature_id() of the matched signature
+};
+
+// why a detection's device deserves a closer look, reason is empty if it doesn't
+static const size_t MAX_ALERT_REASON = 128;
+struct DeviceAlert {
+    DeviceKey device_key;
+    char reason[MAX_ALERT_REASON];  // the first security flag or that the device is unauthorized
+};
+
+struct DetectedDevice {
+    ProtocolType protocol;
+    SignalCharacteristics signal;
+    DeviceKey device_key;      // unique identifier
+    std::string manufacturer;  // detected manufacturer
+    std::string device_type;   // type of device
+    bool is_authorized;        // whether device is known/authorized
+    std::chrono::steady_clock::time_point first_seen;
+    std::chrono::steady_clock::time_point last_seen;
+    int packet_count;          // number of packets detected
+    bool is_suspicious;        // is_suspicious_activity() has alerted on it
+    std::vector<std::string> security_flags; // security concerns
+};
+
+#endif // PROTOCOL_TYPES_H
@@ -0,0 +1,154 @@
+#include "replay_source.h"
+#include "iq_recorder.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// a fast replay keeps the gate readers at most this far behind, the rest
+// of the ring is headroom so they are never lapped
+static const size_t BACKLOG_DIVISOR = 2;
+
+ReplaySource::ReplaySource(bool realtime) : fd(-1), mapped(nullptr), mapped_len(0), recorded_gain(0),
+                                            realtime(realtime), cancelled(false) {
+}
+
+ReplaySource::~ReplaySource() {
+    if (mapped) {
+        munmap(const_cast<uint8_t*>(mapped), mapped_len);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool ReplaySource::load_sidecar(const std::string& path) {
+    std::ifstream file(IQRecorder::sidecar_path(path));
+    if (!file) {
+        std::cerr << "No sidecar " << IQRecorder::sidecar_path(path) << " for recording!" << std::endl;
+        return false;
+    }
+    
+    uint32_t header_rate = 0;
+    uint32_t header_freq = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string field;
+        bool tune_line = line.compare(0, 5, "tune ") == 0;
+        RecordedTuning tuning = {0, 0, 0, 0};
+        while (fields >> field) {
+            size_t eq = field.find('=');
+            if (eq == std::string::npos) continue;
+            std::string key = field.substr(0, eq);
+            uint64_t value = std::strtoull(field.c_str() + eq + 1, nullptr, 10);
+            if (tune_line) {
+                if (key == "offset") tuning.offset = value;
+                else if (key == "settle") tuning.settle_bytes = value;
+                else if (key == "center") tuning.center_freq = (uint32_t)value;
+                else if (key == "rate") tuning.sample_rate = (uint32_t)value;
+            } else if (key == "format" && field.substr(eq + 1) != "u8iq") {
+                std::cerr << "Unsupported recording format " << field.substr(eq + 1) << "!" << std::endl;
+                return false;
+            } else if (key == "sample_rate") {
+                header_rate = (uint32_t)value;
+            } else if (key == "center_freq") {
+                header_freq = (uint32_t)value;
+            } else if (key == "gain") {
+                recorded_gain = (int)std::strtol(field.c_str() + eq + 1, nullptr, 10);
+            }
+        }
+        if (tune_line && tuning.sample_rate > 0) {
+            tunings.push_back(tuning);
+        }
+    }
+    
+    // a sidecar cut short before the first tune line still has its header
+    if (tunings.empty() && header_rate > 0) {
+        RecordedTuning tuning = {0, 0, header_freq, header_rate};
+        tunings.push_back(tuning);
+    }
+    if (tunings.empty()) {
+        std::cerr << "Recording sidecar has no tuning!" << std::endl;
+        return false;
+    }
+    std::stable_sort(tunings.begin(), tunings.end(),
+                     [](const RecordedTuning& a, const RecordedTuning& b) { return a.offset < b.offset; });
+    tunings.front().offset = 0;
+    return true;
+}
+
+bool ReplaySource::open(const std::string& path) {
+    if (!load_sidecar(path)) return false;
+    
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open recording " << path << "!" << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < 2) {
+        std::cerr << "Recording " << path << " is empty!" << std::endl;
+        return false;
+    }
+    mapped_len = (size_t)info.st_size & ~size_t(1);
+    
+    void* map = mmap(nullptr, mapped_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Failed to map recording " << path << "!" << std::endl;
+        mapped_len = 0;
+        return false;
+    }
+    // read once front to back, let the kernel read ahead and drop behind us
+    madvise(map, mapped_len, MADV_SEQUENTIAL);
+    mapped = static_cast<const uint8_t*>(map);
+    return true;
+}
+
+bool ReplaySource::run(SourceListener& listener) {
+    if (!mapped) return false;
+    
+    auto start = std::chrono::steady_clock::now();
+    double paced_seconds = 0.0;
+    uint32_t rate = tunings.front().sample_rate;
+    size_t next_tuning = 0;
+    uint64_t offset = 0;
+    size_t backlog_limit = listener.buffer_capacity() / BACKLOG_DIVISOR;
+    
+    while (!cancelled && offset < mapped_len) {
+        // recorded retunes are replayed on the byte they happened at
+        while (next_tuning < tunings.size() && tunings[next_tuning].offset <= offset) {
+            const RecordedTuning& tuning = tunings[next_tuning++];
+            rate = tuning.sample_rate;
+            listener.source_retuned(tuning.center_freq, tuning.sample_rate, tuning.settle_bytes);
+        }
+        uint64_t end = next_tuning < tunings.size() ? std::min<uint64_t>(tunings[next_tuning].offset, mapped_len)
+                                                     : mapped_len;
+        uint32_t len = (uint32_t)std::min<uint64_t>(end - offset, (uint64_t)MAX_BUFFER_LEN) & ~uint32_t(1);
+        if (len == 0) {
+            offset = end;
+            continue;
+        }
+        
+        if (realtime) {
+            paced_seconds += len / (2.0 * rate);
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(paced_seconds)));
+        } else {
+            while (!cancelled && listener.reader_backlog() + len > backlog_limit) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+        
+        listener.deliver(mapped + offset, len);
+        offset += len;
+    }
+    return true;
+}
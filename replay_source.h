@@ -0,0 +1,51 @@
+#ifndef REPLAY_SOURCE_H
+#define REPLAY_SOURCE_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "sample_source.h"
+
+// a tuning line from a recording's sidecar, offsets are file bytes
+struct RecordedTuning {
+    uint64_t offset;           // first byte recorded under this tuning
+    uint64_t settle_bytes;     // unusable bytes from offset on
+    uint32_t center_freq;
+    uint32_t sample_rate;
+};
+
+// plays an IQRecorder file back through SimpleSDR. the file is mmapped and
+// each buffer goes from the page cache straight into the capture ring, the
+// one copy the usb path makes too. realtime paces at the recorded rate,
+// otherwise the replay runs as fast as the gate readers consume it.
+class ReplaySource : public SampleSource {
+private:
+    int fd;
+    const uint8_t* mapped;
+    size_t mapped_len;
+    std::vector<RecordedTuning> tunings;
+    int recorded_gain;
+    bool realtime;
+    std::atomic<bool> cancelled;
+    
+    bool load_sidecar(const std::string& path);
+    
+public:
+    explicit ReplaySource(bool realtime);
+    ~ReplaySource();
+    
+    bool open(const std::string& path);
+    
+    bool run(SourceListener& listener) override;
+    void cancel() override { cancelled = true; }
+    bool is_live() const override { return false; }
+    
+    // tuning at the start of the recording
+    uint32_t get_center_freq() const { return tunings.front().center_freq; }
+    uint32_t get_sample_rate() const { return tunings.front().sample_rate; }
+    int get_gain() const { return recorded_gain; }
+    size_t get_tuning_count() const { return tunings.size(); }
+    uint64_t get_length() const { return mapped_len; }
+};
+
+#endif // REPLAY_SOURCE_H
@@ -0,0 +1,72 @@
+#include "rtlsdr_source.h"
+#include <iostream>
+
+RtlSdrSource::RtlSdrSource() : device(nullptr), listener(nullptr), reading(false) {
+}
+
+RtlSdrSource::~RtlSdrSource() {
+    if (device) {
+        rtlsdr_close(device);
+    }
+}
+
+bool RtlSdrSource::open(int index) {
+    int result = rtlsdr_open(&device, index);
+    if (result < 0) {
+        std::cerr << "Failed to open RTL-SDR device " << index << "!" << std::endl;
+        device = nullptr;
+        return false;
+    }
+    rtlsdr_set_tuner_gain_mode(device, 1);
+    return true;
+}
+
+void RtlSdrSource::capture_callback(unsigned char* buf, uint32_t len, void* ctx) {
+    RtlSdrSource* self = static_cast<RtlSdrSource*>(ctx);
+    // runs on the libusb thread, must never block
+    self->listener->deliver(buf, len);
+}
+
+bool RtlSdrSource::run(SourceListener& target) {
+    if (!device) return false;
+    listener = &target;
+    reading = true;
+    // blocks until rtlsdr_cancel_async is called
+    int result = rtlsdr_read_async(device, capture_callback, this, USB_BUFFER_COUNT, USB_BUFFER_LEN);
+    reading = false;
+    return result >= 0;
+}
+
+void RtlSdrSource::cancel() {
+    if (device && reading) {
+        rtlsdr_cancel_async(device);
+    }
+}
+
+void RtlSdrSource::reset_buffer() {
+    if (device) rtlsdr_reset_buffer(device);
+}
+
+void RtlSdrSource::set_center_freq(uint32_t freq) {
+    if (device) rtlsdr_set_center_freq(device, freq);
+}
+
+void RtlSdrSource::set_sample_rate(uint32_t rate) {
+    if (device) rtlsdr_set_sample_rate(device, rate);
+}
+
+void RtlSdrSource::set_gain(int gain) {
+    if (device) rtlsdr_set_tuner_gain(device, gain);
+}
+
+uint32_t RtlSdrSource::get_device_sample_rate() const {
+    return device ? rtlsdr_get_sample_rate(device) : 0;
+}
+
+uint32_t RtlSdrSource::get_device_center_freq() const {
+    return device ? rtlsdr_get_center_freq(device) : 0;
+}
+
+int RtlSdrSource::get_device_gain() const {
+    return device ? rtlsdr_get_tuner_gain(device) : 0;
+}
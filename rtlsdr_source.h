@@ -0,0 +1,43 @@
+#ifndef RTLSDR_SOURCE_H
+#define RTLSDR_SOURCE_H
+
+#include <atomic>
+#include <rtl-sdr.h>
+#include "sample_source.h"
+
+// a dongle read with rtlsdr_read_async, every usb buffer goes straight to
+// the listener from the libusb thread
+class RtlSdrSource : public SampleSource {
+private:
+    rtlsdr_dev_t* device;
+    SourceListener* listener;
+    std::atomic<bool> reading;
+    
+    static void capture_callback(unsigned char* buf, uint32_t len, void* ctx);
+    
+public:
+    static const uint32_t USB_BUFFER_COUNT = 32;
+    static const uint32_t USB_BUFFER_LEN = MAX_BUFFER_LEN; // 8 ms at 2.048 MS/s
+    
+    RtlSdrSource();
+    ~RtlSdrSource();
+    
+    // manual gain mode, rate/frequency/gain are set by the owner afterwards
+    bool open(int index);
+    
+    // what the hardware actually ended up with
+    uint32_t get_device_sample_rate() const;
+    uint32_t get_device_center_freq() const;
+    int get_device_gain() const;
+    
+    bool run(SourceListener& listener) override;
+    void cancel() override;
+    void reset_buffer() override;
+    
+    bool is_live() const override { return true; }
+    void set_center_freq(uint32_t freq) override;
+    void set_sample_rate(uint32_t rate) override;
+    void set_gain(int gain) override;
+};
+
+#endif // RTLSDR_SOURCE_H
@@ -0,0 +1,225 @@
+#include "sample_convert.h"
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERT_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CONVERT_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+static const float CONVERT_OFFSET = 127.5f;
+static const float CONVERT_SCALE = 1.0f / 127.5f;
+
+// complex<float> is guaranteed to be laid out as float[2], so every kernel
+// just maps each input byte to one output float in order
+static void convert_scalar(const uint8_t* in, size_t n_samples, std::complex<float>* out) {
+    float* dst = reinterpret_cast<float*>(out);
+    size_t n = n_samples * 2;
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (in[i] - CONVERT_OFFSET) * CONVERT_SCALE;
+    }
+}
+
+struct ConvertTable {
+    float values[256];
+    ConvertTable() {
+        for (int i = 0; i < 256; i++) {
+            values[i] = (i - CONVERT_OFFSET) * CONVERT_SCALE;
+        }
+    }
+};
+
+static void convert_lut(const uint8_t* in, size_t n_samples, std::complex<float>* out) {
+    static const ConvertTable table;
+    float* dst = reinterpret_cast<float*>(out);
+    size_t n = n_samples * 2;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        dst[i] = table.values[in[i]];
+        dst[i + 1] = table.values[in[i + 1]];
+        dst[i + 2] = table.values[in[i + 2]];
+        dst[i + 3] = table.values[in[i + 3]];
+    }
+    for (; i < n; i++) {
+        dst[i] = table.values[in[i]];
+    }
+}
+
+#ifdef CONVERT_HAVE_X86
+static void convert_sse2(const uint8_t* in, size_t n_samples, std::complex<float>* out) {
+    float* dst = reinterpret_cast<float*>(out);
+    size_t n = n_samples * 2;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 offset = _mm_set1_ps(CONVERT_OFFSET);
+    const __m128 scale = _mm_set1_ps(CONVERT_SCALE);
+    
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo16 = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi16 = _mm_unpackhi_epi8(bytes, zero);
+        
+        __m128 f0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo16, zero));
+        __m128 f1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo16, zero));
+        __m128 f2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi16, zero));
+        __m128 f3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi16, zero));
+        
+        _mm_storeu_ps(dst + i,      _mm_mul_ps(_mm_sub_ps(f0, offset), scale));
+        _mm_storeu_ps(dst + i + 4,  _mm_mul_ps(_mm_sub_ps(f1, offset), scale));
+        _mm_storeu_ps(dst + i + 8,  _mm_mul_ps(_mm_sub_ps(f2, offset), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_sub_ps(f3, offset), scale));
+    }
+    for (; i < n; i++) {
+        dst[i] = (in[i] - CONVERT_OFFSET) * CONVERT_SCALE;
+    }
+}
+
+// compiled for avx2 regardless of -march, only called after a cpuid check
+__attribute__((target("avx2")))
+static void convert_avx2(const uint8_t* in, size_t n_samples, std::complex<float>* out) {
+    float* dst = reinterpret_cast<float*>(out);
+    size_t n = n_samples * 2;
+    const __m256 offset = _mm256_set1_ps(CONVERT_OFFSET);
+    const __m256 scale = _mm256_set1_ps(CONVERT_SCALE);
+    
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m128i bytes_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i bytes_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16));
+        
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes_lo));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes_lo, 8)));
+        __m256 f2 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes_hi));
+        __m256 f3 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes_hi, 8)));
+        
+        _mm256_storeu_ps(dst + i,      _mm256_mul_ps(_mm256_sub_ps(f0, offset), scale));
+        _mm256_storeu_ps(dst + i + 8,  _mm256_mul_ps(_mm256_sub_ps(f1, offset), scale));
+        _mm256_storeu_ps(dst + i + 16, _mm256_mul_ps(_mm256_sub_ps(f2, offset), scale));
+        _mm256_storeu_ps(dst + i + 24, _mm256_mul_ps(_mm256_sub_ps(f3, offset), scale));
+    }
+    for (; i < n; i++) {
+        dst[i] = (in[i] - CONVERT_OFFSET) * CONVERT_SCALE;
+    }
+}
+#endif
+
+#ifdef CONVERT_HAVE_NEON
+static void convert_neon(const uint8_t* in, size_t n_samples, std::complex<float>* out) {
+    float* dst = reinterpret_cast<float*>(out);
+    size_t n = n_samples * 2;
+    const float32x4_t offset = vdupq_n_f32(CONVERT_OFFSET);
+    const float32x4_t scale = vdupq_n_f32(CONVERT_SCALE);
+    
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t bytes = vld1q_u8(in + i);
+        uint16x8_t lo16 = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t hi16 = vmovl_u8(vget_high_u8(bytes));
+        
+        float32x4_t f0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo16)));
+        float32x4_t f1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo16)));
+        float32x4_t f2 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi16)));
+        float32x4_t f3 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi16)));
+        
+        vst1q_f32(dst + i,      vmulq_f32(vsubq_f32(f0, offset), scale));
+        vst1q_f32(dst + i + 4,  vmulq_f32(vsubq_f32(f1, offset), scale));
+        vst1q_f32(dst + i + 8,  vmulq_f32(vsubq_f32(f2, offset), scale));
+        vst1q_f32(dst + i + 12, vmulq_f32(vsubq_f32(f3, offset), scale));
+    }
+    for (; i < n; i++) {
+        dst[i] = (in[i] - CONVERT_OFFSET) * CONVERT_SCALE;
+    }
+}
+#endif
+
+bool is_convert_path_supported(ConvertPath path) {
+    switch (path) {
+        case ConvertPath::SCALAR:
+        case ConvertPath::LUT:
+            return true;
+#ifdef CONVERT_HAVE_X86
+        case ConvertPath::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case ConvertPath::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+#ifdef CONVERT_HAVE_NEON
+        case ConvertPath::NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+ConvertFunction get_convert_function(ConvertPath path) {
+    if (!is_convert_path_supported(path)) return nullptr;
+    
+    switch (path) {
+        case ConvertPath::SCALAR: return convert_scalar;
+        case ConvertPath::LUT:    return convert_lut;
+#ifdef CONVERT_HAVE_X86
+        case ConvertPath::SSE2:   return convert_sse2;
+        case ConvertPath::AVX2:   return convert_avx2;
+#endif
+#ifdef CONVERT_HAVE_NEON
+        case ConvertPath::NEON:   return convert_neon;
+#endif
+        default:                  return nullptr;
+    }
+}
+
+const char* get_convert_path_name(ConvertPath path) {
+    switch (path) {
+        case ConvertPath::SCALAR: return "scalar";
+        case ConvertPath::LUT:    return "lut";
+        case ConvertPath::SSE2:   return "sse2";
+        case ConvertPath::AVX2:   return "avx2";
+        case ConvertPath::NEON:   return "neon";
+    }
+    return "unknown";
+}
+
+static ConvertPath detect_best_path() {
+    const ConvertPath preferred[] = {ConvertPath::AVX2, ConvertPath::NEON, ConvertPath::SSE2};
+    for (ConvertPath path : preferred) {
+        if (is_convert_path_supported(path)) return path;
+    }
+    // table lookups beat the float subtract/multiply on old in-order cores
+    return ConvertPath::LUT;
+}
+
+struct ActiveConvert {
+    std::atomic<int> path;
+    std::atomic<ConvertFunction> function;
+    ActiveConvert() {
+        ConvertPath best = detect_best_path();
+        path = (int)best;
+        function = get_convert_function(best);
+    }
+};
+
+static ActiveConvert& active_convert() {
+    static ActiveConvert active;
+    return active;
+}
+
+ConvertPath get_active_convert_path() {
+    return (ConvertPath)active_convert().path.load(std::memory_order_relaxed);
+}
+
+void set_active_convert_path(ConvertPath path) {
+    ConvertFunction function = get_convert_function(path);
+    if (function) {
+        active_convert().function.store(function, std::memory_order_relaxed);
+        active_convert().path.store((int)path, std::memory_order_relaxed);
+    }
+}
+
+void convert_iq_u8(const uint8_t* in, size_t n_samples, std::complex<float>* out) {
+    active_convert().function.load(std::memory_order_relaxed)(in, n_samples, out);
+}
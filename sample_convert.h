@@ -0,0 +1,30 @@
+#ifndef SAMPLE_CONVERT_H
+#define SAMPLE_CONVERT_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+// u8 iq (rtl-sdr native format, 127.5 = zero) to complex<float> in [-1, 1].
+// several implementations exist, the fastest one the cpu supports is picked
+// at runtime the first time convert_iq_u8() is called.
+enum class ConvertPath {
+    SCALAR = 0,
+    LUT,        // 256 entry table, good on cpus without usable simd
+    SSE2,
+    AVX2,
+    NEON
+};
+
+// n_samples complex samples are read from 2 * n_samples input bytes
+typedef void (*ConvertFunction)(const uint8_t* in, size_t n_samples, std::complex<float>* out);
+
+void convert_iq_u8(const uint8_t* in, size_t n_samples, std::complex<float>* out);
+
+ConvertPath get_active_convert_path();
+void set_active_convert_path(ConvertPath path); // ignored if unsupported
+bool is_convert_path_supported(ConvertPath path);
+ConvertFunction get_convert_function(ConvertPath path);
+const char* get_convert_path_name(ConvertPath path);
+
+#endif // SAMPLE_CONVERT_H
@@ -0,0 +1,160 @@
+#include "sample_ring.h"
+#include <algorithm>
+#include <cstring>
+
+static size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+SampleRing::SampleRing(size_t capacity_bytes, size_t max_write_bytes)
+    : storage(round_up_pow2(std::max(capacity_bytes, max_write_bytes * 4))),
+      max_write_len(max_write_bytes), write_pos(0), write_count(0), overrun_events(0) {
+    mask = storage.size() - 1;
+}
+
+void SampleRing::write(const uint8_t* data, size_t len) {
+    uint64_t pos = write_pos.load(std::memory_order_relaxed);
+    
+    // clamp oversized writes to the newest bytes, we can't hold more anyway
+    if (len > max_write_len) {
+        data += len - max_write_len;
+        len = max_write_len;
+    }
+    
+    size_t offset = pos & mask;
+    size_t first = std::min(len, storage.size() - offset);
+    memcpy(&storage[offset], data, first);
+    if (first < len) {
+        memcpy(&storage[0], data + first, len - first);
+    }
+    
+    write_pos.store(pos + len, std::memory_order_release);
+    write_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool SampleRing::is_overwritten(uint64_t pos) const {
+    // the producer may be in the middle of writing up to max_write_len bytes
+    // past the published position, so treat that region as unsafe too
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t w = write_pos.load(std::memory_order_acquire);
+    return w + max_write_len > pos + storage.size();
+}
+
+void SampleRing::add_gate(const SampleRingReader* reader) {
+    std::lock_guard<std::mutex> lock(gate_mutex);
+    gates.push_back(reader);
+}
+
+void SampleRing::remove_gate(const SampleRingReader* reader) {
+    std::lock_guard<std::mutex> lock(gate_mutex);
+    gates.erase(std::remove(gates.begin(), gates.end(), reader), gates.end());
+}
+
+uint64_t SampleRing::gate_backlog() const {
+    std::lock_guard<std::mutex> lock(gate_mutex);
+    uint64_t w = write_pos.load(std::memory_order_relaxed);
+    uint64_t backlog = 0;
+    for (const SampleRingReader* reader : gates) {
+        backlog = std::max(backlog, w - reader->published_pos.load(std::memory_order_acquire));
+    }
+    return backlog;
+}
+
+SampleRingReader::SampleRingReader(SampleRing* ring, bool gate)
+    : ring(ring), read_pos(ring->write_position()), published_pos(read_pos), overruns(0),
+      dropped_bytes(0), gate(gate) {
+    if (gate) ring->add_gate(this);
+}
+
+SampleRingReader::~SampleRingReader() {
+    if (gate) ring->remove_gate(this);
+}
+
+void SampleRingReader::handle_overrun(uint64_t write_pos) {
+    // skip ahead and leave half the ring as backlog so we don't get lapped
+    // again immediately. keep the cursor on an i/q pair boundary.
+    uint64_t new_pos = write_pos - ring->capacity() / 2;
+    new_pos &= ~uint64_t(1);
+    
+    dropped_bytes += new_pos - read_pos;
+    read_pos = new_pos;
+    publish();
+    overruns++;
+    ring->overrun_events.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t SampleRingReader::available() const {
+    return ring->write_position() - read_pos;
+}
+
+size_t SampleRingReader::acquire(const uint8_t*& data, size_t max_len) {
+    uint64_t w = ring->write_position();
+    if (ring->is_overwritten(read_pos)) {
+        handle_overrun(w);
+    }
+    
+    uint64_t pending = w - read_pos;
+    if (pending == 0) return 0;
+    
+    size_t offset = read_pos & ring->mask;
+    size_t len = (size_t)std::min<uint64_t>(pending, max_len);
+    len = std::min(len, ring->capacity() - offset); // contiguous part only
+    
+    data = &ring->storage[offset];
+    return len;
+}
+
+bool SampleRingReader::release(size_t len) {
+    bool intact = !ring->is_overwritten(read_pos);
+    read_pos += len;
+    publish();
+    if (!intact) {
+        overruns++;
+        dropped_bytes += len;
+        ring->overrun_events.fetch_add(1, std::memory_order_relaxed);
+    }
+    return intact;
+}
+
+size_t SampleRingReader::read(uint8_t* dst, size_t len) {
+    size_t copied = 0;
+    while (copied < len) {
+        const uint8_t* src;
+        size_t chunk = acquire(src, len - copied);
+        if (chunk == 0) break;
+        memcpy(dst + copied, src, chunk);
+        if (!release(chunk)) {
+            // torn copy, throw away what we have and start over from here
+            dropped_bytes += copied;
+            copied = 0;
+            continue;
+        }
+        copied += chunk;
+    }
+    return copied;
+}
+
+void SampleRingReader::seek_to_latest(size_t len) {
+    uint64_t w = ring->write_position();
+    uint64_t keep = std::min<uint64_t>(len, ring->capacity() / 2);
+    read_pos = (w - std::min(keep, w)) & ~uint64_t(1);
+    publish();
+}
+
+uint64_t SampleRingReader::seek(uint64_t pos) {
+    uint64_t w = ring->write_position();
+    uint64_t headroom = ring->max_write_len + ring->capacity() / 8;
+    uint64_t oldest = w + headroom > ring->capacity() ? w + headroom - ring->capacity() : 0;
+    read_pos = std::min(std::max(pos, oldest), w) & ~uint64_t(1);
+    publish();
+    return read_pos;
+}
+
+uint64_t SampleRingReader::skip(uint64_t len) {
+    uint64_t skipped = std::min(len, available()) & ~uint64_t(1);
+    read_pos += skipped;
+    publish();
+    return skipped;
+}
@@ -0,0 +1,102 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+
+class SampleRingReader;
+
+// single producer / multi consumer byte ring for raw u8 iq samples.
+// the producer (capture thread) never waits on readers; every reader keeps
+// its own cursor and detects when it has been lapped by the producer.
+// a producer that can wait (file replay) uses gate_backlog() to stay
+// behind the readers created as gates.
+class SampleRing {
+private:
+    std::vector<uint8_t> storage;
+    size_t mask;
+    size_t max_write_len;      // largest single write, used to detect torn reads
+    
+    std::atomic<uint64_t> write_pos;      // total bytes ever written
+    std::atomic<uint64_t> write_count;    // number of producer writes
+    std::atomic<uint64_t> overrun_events; // summed over all readers
+    
+    mutable std::mutex gate_mutex;
+    std::vector<const SampleRingReader*> gates;
+    
+    void add_gate(const SampleRingReader* reader);
+    void remove_gate(const SampleRingReader* reader);
+    
+public:
+    // capacity is rounded up to a power of two
+    SampleRing(size_t capacity_bytes, size_t max_write_bytes);
+    
+    // producer side, capture thread only
+    void write(const uint8_t* data, size_t len);
+    
+    uint64_t write_position() const { return write_pos.load(std::memory_order_acquire); }
+    uint64_t get_write_count() const { return write_count.load(std::memory_order_relaxed); }
+    uint64_t get_overrun_count() const { return overrun_events.load(std::memory_order_relaxed); }
+    size_t capacity() const { return storage.size(); }
+    
+    // true if bytes starting at pos may have been overwritten by the producer
+    bool is_overwritten(uint64_t pos) const;
+    
+    // bytes the slowest gate reader has not consumed yet, 0 without gates
+    uint64_t gate_backlog() const;
+    
+    friend class SampleRingReader;
+};
+
+// one consumer cursor. readers are independent and may run on any thread,
+// but a single reader must only be used from one thread at a time.
+class SampleRingReader {
+private:
+    SampleRing* ring;
+    uint64_t read_pos;
+    std::atomic<uint64_t> published_pos;  // read_pos for other threads
+    uint64_t overruns;
+    uint64_t dropped_bytes;
+    bool gate;
+    
+    void handle_overrun(uint64_t write_pos);
+    void publish() { published_pos.store(read_pos, std::memory_order_release); }
+    
+    friend class SampleRing;
+    
+public:
+    // a gate reader holds back producers that check gate_backlog()
+    explicit SampleRingReader(SampleRing* ring, bool gate = false);
+    ~SampleRingReader();
+    SampleRingReader(const SampleRingReader&) = delete;
+    SampleRingReader& operator=(const SampleRingReader&) = delete;
+    
+    // zero-copy access: points data at up to max_len contiguous bytes and
+    // returns how many are available (0 if none). call release() when done.
+    size_t acquire(const uint8_t*& data, size_t max_len);
+    // advance past len acquired bytes. returns false if the producer
+    // overwrote them while they were being processed (result is garbage).
+    bool release(size_t len);
+    
+    // copying read, returns number of bytes copied
+    size_t read(uint8_t* dst, size_t len);
+    
+    // jump so that only the newest len bytes are pending
+    void seek_to_latest(size_t len = 0);
+    // jump to an absolute position, clamped to what the ring still holds
+    // (with some headroom so the producer doesn't lap us right away) and to
+    // what has been written. returns the position actually reached.
+    uint64_t seek(uint64_t pos);
+    // discard up to len pending bytes without reading them, returns how many
+    uint64_t skip(uint64_t len);
+    
+    uint64_t available() const;
+    uint64_t position() const { return read_pos; }
+    uint64_t get_overrun_count() const { return overruns; }
+    uint64_t get_dropped_bytes() const { return dropped_bytes; }
+};
+
+#endif // SAMPLE_RING_H
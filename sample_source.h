@@ -0,0 +1,44 @@
+#ifndef SAMPLE_SOURCE_H
+#define SAMPLE_SOURCE_H
+
+#include <cstdint>
+#include <cstddef>
+
+// what a source reports back to SimpleSDR while it runs on the capture thread
+class SourceListener {
+public:
+    virtual ~SourceListener() {}
+    // raw u8 iq, len is a whole number of i/q pairs
+    virtual void deliver(const uint8_t* data, uint32_t len) = 0;
+    // a retune that is part of the input itself (a recorded scan). samples
+    // delivered after this call belong to the new tuning, the first
+    // settle_bytes of them are unusable.
+    virtual void source_retuned(uint32_t center_freq, uint32_t sample_rate, uint64_t settle_bytes) = 0;
+    // bytes the slowest flow controlled reader has not consumed yet
+    virtual uint64_t reader_backlog() const = 0;
+    virtual size_t buffer_capacity() const = 0;
+};
+
+// where SimpleSDR's samples come from: a dongle or a recording. run() blocks
+// on SimpleSDR's capture thread and hands every buffer to the listener.
+class SampleSource {
+public:
+    // largest buffer handed to deliver(), the ring is sized around it
+    static const uint32_t MAX_BUFFER_LEN = 32768;
+    
+    virtual ~SampleSource() {}
+    
+    // until cancel() or the end of the input, false on a read error
+    virtual bool run(SourceListener& listener) = 0;
+    // async signal safe
+    virtual void cancel() = 0;
+    virtual void reset_buffer() {}
+    
+    // a source that is not live ignores tuning, its tuning is in the input
+    virtual bool is_live() const = 0;
+    virtual void set_center_freq(uint32_t freq) { (void)freq; }
+    virtual void set_sample_rate(uint32_t rate) { (void)rate; }
+    virtual void set_gain(int gain) { (void)gain; }
+};
+
+#endif // SAMPLE_SOURCE_H
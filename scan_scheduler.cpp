@@ -0,0 +1,128 @@
+#include "scan_scheduler.h"
+#include "sdr.h"
+#include "protocol_analyzer.h"
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+ScanScheduler::ScanScheduler() : sdr_ref(nullptr), analyzer_ref(nullptr), tuner_index(0), next_revisit(0),
+                                 running(false), paused(true), hops_completed(0), revisits_completed(0) {
+}
+
+ScanScheduler::~ScanScheduler() {
+    stop();
+}
+
+bool ScanScheduler::start() {
+    if (running) return true;
+    if (!sdr_ref || !analyzer_ref) {
+        std::cerr << "Scan scheduler needs SDR and analyzer references!" << std::endl;
+        return false;
+    }
+    
+    running = true;
+    worker = std::thread(&ScanScheduler::scheduler_loop, this);
+    return true;
+}
+
+void ScanScheduler::stop() {
+    running = false;
+    if (worker.joinable()) worker.join();
+}
+
+void ScanScheduler::set_range_dwell(size_t range, int dwell_ms) {
+    std::lock_guard<std::mutex> lock(schedule_mutex);
+    if (range >= range_dwell_ms.size()) {
+        range_dwell_ms.resize(range + 1, (int)DEFAULT_DWELL_MS);
+    }
+    range_dwell_ms[range] = std::max(1, dwell_ms);
+}
+
+int ScanScheduler::dwell_for_range(size_t range) {
+    std::lock_guard<std::mutex> lock(schedule_mutex);
+    return range < range_dwell_ms.size() ? range_dwell_ms[range] : (int)DEFAULT_DWELL_MS;
+}
+
+void ScanScheduler::note_activity(double frequency) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(schedule_mutex);
+    
+    for (auto& channel : hot_channels) {
+        if (std::abs(channel.frequency - frequency) < HOT_CHANNEL_MERGE_HZ) {
+            channel.last_activity = now;
+            channel.hits++;
+            return;
+        }
+    }
+    
+    HotChannel channel = {frequency, now, 1};
+    if (hot_channels.size() < MAX_HOT_CHANNELS) {
+        hot_channels.push_back(channel);
+    } else {
+        // full, take the place of the channel that has been quiet longest
+        auto stalest = std::min_element(hot_channels.begin(), hot_channels.end(),
+            [](const HotChannel& a, const HotChannel& b) { return a.last_activity < b.last_activity; });
+        *stalest = channel;
+    }
+}
+
+bool ScanScheduler::pick_revisit(double& frequency) {
+    auto cutoff = std::chrono::steady_clock::now() - std::chrono::seconds(HOT_CHANNEL_TIMEOUT_S);
+    std::lock_guard<std::mutex> lock(schedule_mutex);
+    
+    hot_channels.erase(
+        std::remove_if(hot_channels.begin(), hot_channels.end(),
+            [cutoff](const HotChannel& channel) { return channel.last_activity < cutoff; }),
+        hot_channels.end());
+    if (hot_channels.empty()) return false;
+    
+    // round robin so one chatty sensor doesn't get every revisit
+    frequency = hot_channels[next_revisit++ % hot_channels.size()].frequency;
+    return true;
+}
+
+bool ScanScheduler::scan_active() const {
+    return running && !paused && analyzer_ref->is_scanning();
+}
+
+bool ScanScheduler::dwell(int dwell_ms) {
+    // wait for settling, then for dwell_ms worth of samples on top
+    while (scan_active()) {
+        uint64_t settle = sdr_ref->get_settle_position();
+        if (settle != UINT64_MAX) {
+            uint64_t dwell_bytes = (uint64_t)sdr_ref->get_sample_rate() * 2 * dwell_ms / 1000;
+            if (sdr_ref->get_captured_bytes() >= settle + dwell_bytes) return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return false;
+}
+
+void ScanScheduler::scheduler_loop() {
+    int hops_since_revisit = 0;
+    
+    while (running) {
+        if (!scan_active()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        
+        // dwell on the hop we're tuned to, resumes here after a pause
+        if (!dwell(dwell_for_range(analyzer_ref->get_current_range_index(tuner_index)))) continue;
+        hops_completed++;
+        
+        double hot_frequency;
+        if (++hops_since_revisit >= REVISIT_EVERY_HOPS && pick_revisit(hot_frequency)) {
+            hops_since_revisit = 0;
+            
+            // park the channel a quarter of the band off center, clear of the dc spike
+            uint32_t center = (uint32_t)(hot_frequency + sdr_ref->get_sample_rate() / 4);
+            sdr_ref->set_frequency(center);
+            if (dwell(DEFAULT_DWELL_MS)) revisits_completed++;
+        }
+        
+        if (scan_active()) {
+            analyzer_ref->update_scan(tuner_index);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+class SimpleSDR;
+class ProtocolAnalyzer;
+
+// advances the analyzer's scan plan on its own thread. dwell is counted in
+// captured samples after the retune has settled, so it doesn't depend on the
+// gui frame rate, and channels with recent detections get extra visits.
+class ScanScheduler {
+private:
+    SimpleSDR* sdr_ref;
+    ProtocolAnalyzer* analyzer_ref;
+    size_t tuner_index;        // which of the analyzer's tuners sdr_ref is
+    
+    static const int DEFAULT_DWELL_MS = 100;
+    static const int REVISIT_EVERY_HOPS = 4;       // plan hops between hot channel visits
+    static const int HOT_CHANNEL_TIMEOUT_S = 30;   // forget channels quiet for this long
+    static const size_t MAX_HOT_CHANNELS = 8;
+    static constexpr double HOT_CHANNEL_MERGE_HZ = 50000;
+    
+    struct HotChannel {
+        double frequency;
+        std::chrono::steady_clock::time_point last_activity;
+        uint32_t hits;
+    };
+    
+    // per range dwell and the hot list, set from other threads
+    std::mutex schedule_mutex;
+    std::vector<int> range_dwell_ms;
+    std::vector<HotChannel> hot_channels;
+    size_t next_revisit;
+    
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<bool> paused;
+    
+    std::atomic<uint64_t> hops_completed;
+    std::atomic<uint64_t> revisits_completed;
+    
+    void scheduler_loop();
+    bool scan_active() const;
+    bool dwell(int dwell_ms);     // false if the scan was paused or stopped meanwhile
+    int dwell_for_range(size_t range);
+    bool pick_revisit(double& frequency);
+    
+public:
+    ScanScheduler();
+    ~ScanScheduler();
+    
+    void set_sdr_reference(SimpleSDR* sdr) { sdr_ref = sdr; }
+    void set_protocol_analyzer_reference(ProtocolAnalyzer* analyzer) { analyzer_ref = analyzer; }
+    void set_tuner_index(size_t tuner) { tuner_index = tuner; }
+    
+    bool start();
+    void stop();
+    void set_paused(bool pause) { paused = pause; }
+    bool is_paused() const { return paused; }
+    
+    // dwell per scan range, index matches the analyzer's scan ranges
+    void set_range_dwell(size_t range, int dwell_ms);
+    
+    // a detection was made at frequency, safe to call from any thread
+    void note_activity(double frequency);
+    
+    // statistics
+    uint64_t get_hops_completed() const { return hops_completed; }
+    uint64_t get_revisits_completed() const { return revisits_completed; }
+};
+
+#endif // SCAN_SCHEDULER_H
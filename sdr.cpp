@@ -1,22 +1,30 @@
 #include "sdr.h"
 #include "protocol_analyzer.h"
+#include "sample_convert.h"
+#include "rtlsdr_source.h"
+#include "replay_source.h"
+#include "async_log.h"
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 #include <unistd.h>
 
-SimpleSDR::SimpleSDR() : device(nullptr), sample_rate(2048000), 
-                        center_freq(100000000), gain(0), running(false), protocol_analyzer(nullptr) {
+SimpleSDR::SimpleSDR() : device_index(-1), sample_rate(2048000), 
+                        center_freq(100000000), gain(0), running(false), capturing(false),
+                        protocol_analyzer(nullptr) {
     iq_buffer.reserve(131072);
+    analysis_buffer.reserve(DISPLAY_BLOCK_LEN / 2);
+    read_buffer.resize(DISPLAY_BLOCK_LEN);
+    sample_ring.reset(new SampleRing(RING_CAPACITY, SampleSource::MAX_BUFFER_LEN));
 }
 
 SimpleSDR::~SimpleSDR() {
-    if (device) {
-        rtlsdr_close(device);
-    }
+    stop_capture();
 }
 
-bool SimpleSDR::initialize() {
+bool SimpleSDR::initialize(int index) {
     int device_count = rtlsdr_get_device_count();
     if (device_count == 0) {
         std::cerr << "No RTL-SDR devices found!" << std::endl;
@@ -28,33 +36,149 @@ bool SimpleSDR::initialize() {
         std::cout << "  " << i << ": " << rtlsdr_get_device_name(i) << std::endl;
     }
     
-    int result = rtlsdr_open(&device, 0);
-    if (result < 0) {
-        std::cerr << "Failed to open RTL-SDR device!" << std::endl;
+    if (index < 0 || index >= device_count) {
+        std::cerr << "No RTL-SDR device " << index << "!" << std::endl;
         return false;
     }
     
-    rtlsdr_set_sample_rate(device, sample_rate);
-    rtlsdr_set_center_freq(device, center_freq);
-    rtlsdr_set_tuner_gain_mode(device, 1);
-    rtlsdr_set_tuner_gain(device, gain);
-    rtlsdr_reset_buffer(device);
+    RtlSdrSource* dongle = new RtlSdrSource();
+    source.reset(dongle);
+    if (!dongle->open(index)) {
+        source.reset();
+        return false;
+    }
+    
+    char manufacturer[256] = {0}, product[256] = {0}, serial[256] = {0};
+    rtlsdr_get_device_usb_strings(index, manufacturer, product, serial);
+    device_index = index;
+    device_serial = serial;
+    
+    dongle->set_sample_rate(sample_rate);
+    retune(center_freq, sample_rate);
+    dongle->set_gain(gain);
+    dongle->reset_buffer();
     
-    std::cout << "RTL-SDR initialized:" << std::endl;
-    std::cout << "  Sample rate: " << rtlsdr_get_sample_rate(device) << " Hz" << std::endl;
-    std::cout << "  Center frequency: " << rtlsdr_get_center_freq(device) << " Hz" << std::endl;
-    std::cout << "  Tuner gain: " << rtlsdr_get_tuner_gain(device) << " dB" << std::endl;
+    std::cout << "RTL-SDR " << device_index << " initialized:" << std::endl;
+    std::cout << "  Serial: " << (device_serial.empty() ? "(none)" : device_serial) << std::endl;
+    std::cout << "  Sample rate: " << dongle->get_device_sample_rate() << " Hz" << std::endl;
+    std::cout << "  Center frequency: " << dongle->get_device_center_freq() << " Hz" << std::endl;
+    std::cout << "  Tuner gain: " << dongle->get_device_gain() << " dB" << std::endl;
     
     return true;
 }
 
-void SimpleSDR::convert_samples(uint8_t* buffer, uint32_t len) {
-    iq_buffer.clear();
-    for (uint32_t i = 0; i < len; i += 2) {
-        float I = (buffer[i] - 127.5f) / 127.5f;
-        float Q = (buffer[i + 1] - 127.5f) / 127.5f;
-        iq_buffer.emplace_back(I, Q);
+bool SimpleSDR::open_replay(const std::string& path, bool realtime) {
+    std::unique_ptr<ReplaySource> replay(new ReplaySource(realtime));
+    if (!replay->open(path)) {
+        return false;
     }
+    
+    // the recording retunes the ring itself once it runs
+    sample_rate = replay->get_sample_rate();
+    center_freq = replay->get_center_freq();
+    gain = replay->get_gain();
+    device_serial = path;
+    
+    std::cout << "Replaying " << path << (realtime ? " in real time:" : " as fast as possible:") << std::endl;
+    std::cout << "  Samples: " << replay->get_length() / 2 << std::endl;
+    std::cout << "  Tunings: " << replay->get_tuning_count() << std::endl;
+    std::cout << "  Center frequency: " << center_freq << " Hz" << std::endl;
+    
+    source = std::move(replay);
+    return true;
+}
+
+int SimpleSDR::find_device(const std::string& selector) {
+    // serials take precedence, a plain number is an index otherwise
+    int index = rtlsdr_get_index_by_serial(selector.c_str());
+    if (index >= 0) return index;
+    
+    if (selector.empty() || selector.find_first_not_of("0123456789") != std::string::npos) return -1;
+    // strtol saturates rather than throwing on a selector too long for an int
+    errno = 0;
+    long number = std::strtol(selector.c_str(), nullptr, 10);
+    if (errno == ERANGE || number >= (long)rtlsdr_get_device_count()) return -1;
+    return (int)number;
+}
+
+void SimpleSDR::convert_samples(const uint8_t* buffer, uint32_t len) {
+    convert_samples(buffer, len, iq_buffer);
+}
+
+void SimpleSDR::convert_samples(const uint8_t* buffer, uint32_t len, std::vector<std::complex<float>>& out) {
+    // only reallocates if the block size changed, the simd kernel does the rest
+    out.resize(len / 2);
+    convert_samples(buffer, len, out.data());
+}
+
+void SimpleSDR::convert_samples(const uint8_t* buffer, uint32_t len, std::complex<float>* out) {
+    convert_iq_u8(buffer, len / 2, out);
+}
+
+void SimpleSDR::deliver(const uint8_t* data, uint32_t len) {
+    // runs on the libusb thread for a dongle, must never block
+    sample_ring->write(data, len);
+}
+
+void SimpleSDR::source_retuned(uint32_t freq, uint32_t rate, uint64_t settle_bytes) {
+    std::lock_guard<std::mutex> lock(tune_mutex);
+    uint64_t pos = sample_ring->write_position();
+    push_tuning(freq, rate, pos, pos + settle_bytes);
+    center_freq = freq;
+    sample_rate = rate;
+}
+
+void SimpleSDR::capture_loop() {
+    // blocks until the source is cancelled or runs out
+    if (!source->run(*this)) {
+        std::cerr << "WARNING: async read failed." << std::endl;
+    }
+    capturing = false;
+}
+
+bool SimpleSDR::set_history_seconds(double seconds) {
+    if (capture_thread.joinable()) {
+        std::cerr << "Capture history can't change while capturing!" << std::endl;
+        return false;
+    }
+    size_t capacity = (size_t)(seconds * sample_rate * 2);
+    if (seconds <= 0.0 || capacity < RING_CAPACITY / 16) {
+        std::cerr << "Capture history of " << seconds << " s is too short!" << std::endl;
+        return false;
+    }
+    sample_ring.reset(new SampleRing(capacity, SampleSource::MAX_BUFFER_LEN));
+    return true;
+}
+
+bool SimpleSDR::start_capture() {
+    if (!source) {
+        std::cerr << "Device not initialized!" << std::endl;
+        return false;
+    }
+    if (capture_thread.joinable()) return true;
+    
+    source->reset_buffer();
+    
+    display_reader = create_reader();
+    analysis_reader = create_reader();
+    
+    capturing = true;
+    capture_thread = std::thread(&SimpleSDR::capture_loop, this);
+    return true;
+}
+
+void SimpleSDR::stop_capture() {
+    if (source && capturing) {
+        source->cancel();
+    }
+    if (capture_thread.joinable()) {
+        capture_thread.join();
+    }
+    capturing = false;
+}
+
+std::unique_ptr<SampleRingReader> SimpleSDR::create_reader(bool gate) {
+    return std::unique_ptr<SampleRingReader>(new SampleRingReader(sample_ring.get(), gate));
 }
 
 void SimpleSDR::analyze_samples() {
@@ -78,81 +202,150 @@ void SimpleSDR::analyze_samples() {
     
     float avg_power_db = 10.0f * std::log10(avg_power + 1e-10f);
     
-    std::cout << "Samples: " << iq_buffer.size() 
-              << ", Max: " << max_magnitude 
-              << ", Avg: " << avg_magnitude
-              << ", Power: " << avg_power_db << " dB" << std::endl;
+    log_printf("Samples: %zu, Max: %g, Avg: %g, Power: %g dB", iq_buffer.size(),
+               max_magnitude, avg_magnitude, avg_power_db);
 }
 
 void SimpleSDR::run() {
-    if (!device) {
+    if (!source) {
         std::cerr << "Device not initialized!" << std::endl;
         return;
     }
     
+    if (!start_capture()) return;
+    
     running = true;
-    uint8_t buffer[131072];
-    int n_read;
+    std::vector<uint8_t> buffer(131072);
     
     std::cout << "Starting capture... Press Ctrl+C to stop" << std::endl;
     
-    while (running) {
-        int result = rtlsdr_read_sync(device, buffer, sizeof(buffer), &n_read);
-        if (result < 0) {
-            std::cerr << "WARNING: sync read failed." << std::endl;
-            break;
-        }
+    while (running && capturing) {
+        // only the newest block is analyzed, the rest is dropped on purpose
+        display_reader->seek_to_latest(buffer.size());
+        size_t n_read = display_reader->read(buffer.data(), buffer.size());
         
-        convert_samples(buffer, n_read);
-        analyze_samples();
+        if (n_read > 0) {
+            convert_samples(buffer.data(), n_read);
+            analyze_samples();
+        }
         
         usleep(100000);
     }
+    
+    stop_capture();
 }
 
 void SimpleSDR::stop() {
     running = false;
+    // safe to call from a signal handler, the capture thread is joined later
+    if (source && capturing) {
+        source->cancel();
+    }
 }
 
 void SimpleSDR::set_frequency(uint32_t freq) {
-    center_freq = freq;
-    if (device) {
-        rtlsdr_set_center_freq(device, center_freq);
-        std::cout << "Frequency set to: " << freq << " Hz" << std::endl;
+    if (is_replay()) return;
+    retune(freq, sample_rate);
+    if (source) {
+        log_printf("Frequency set to: %u Hz", freq);
     }
 }
 
 void SimpleSDR::set_sample_rate(uint32_t rate) {
+    if (is_replay()) return;
+    retune(center_freq, rate);
+}
+
+void SimpleSDR::retune(uint32_t freq, uint32_t rate) {
+    std::lock_guard<std::mutex> lock(tune_mutex);
+    
+    // end the current segment before the hardware changes, the new one stays
+    // unusable until the tuner calls have returned and the pll has settled
+    push_tuning(freq, rate, sample_ring->write_position(), UINT64_MAX);
+    
+    bool rate_changed = rate != sample_rate;
+    center_freq = freq;
     sample_rate = rate;
-    if (device) {
-        rtlsdr_set_sample_rate(device, sample_rate);
+    if (source) {
+        if (rate_changed) source->set_sample_rate(rate);
+        source->set_center_freq(freq);
+    }
+    
+    uint64_t settle_bytes = (uint64_t)rate * 2 * SETTLE_TIME_MS / 1000 + 2 * RtlSdrSource::USB_BUFFER_LEN;
+    tuning_history.back().settle_byte = sample_ring->write_position() + settle_bytes;
+}
+
+void SimpleSDR::push_tuning(uint32_t freq, uint32_t rate, uint64_t retune_byte, uint64_t settle_byte) {
+    TuningRecord record;
+    record.center_freq = freq;
+    record.sample_rate = rate;
+    record.retune_byte = retune_byte;
+    record.settle_byte = settle_byte;
+    tuning_history.push_back(record);
+    if (tuning_history.size() > TUNING_HISTORY) {
+        tuning_history.pop_front();
     }
 }
 
+bool SimpleSDR::find_tuning(uint64_t pos, TuningSegment& segment) const {
+    std::lock_guard<std::mutex> lock(tune_mutex);
+    if (tuning_history.empty()) return false;
+    
+    // newest first, readers are almost always in the current or previous tuning
+    size_t i = tuning_history.size() - 1;
+    while (i > 0 && tuning_history[i].retune_byte > pos) {
+        i--;
+    }
+    
+    const TuningRecord& record = tuning_history[i];
+    segment.center_freq = record.center_freq;
+    segment.sample_rate = record.sample_rate;
+    segment.start_byte = record.settle_byte;
+    segment.end_byte = i + 1 < tuning_history.size() ? tuning_history[i + 1].retune_byte : UINT64_MAX;
+    return true;
+}
+
+uint64_t SimpleSDR::get_settle_position() const {
+    std::lock_guard<std::mutex> lock(tune_mutex);
+    return tuning_history.empty() ? 0 : tuning_history.back().settle_byte;
+}
+
 void SimpleSDR::set_gain(int new_gain) {
     gain = new_gain;
-    if (device) {
-        rtlsdr_set_tuner_gain(device, gain);
+    if (source) {
+        source->set_gain(gain);
     }
 }
 
 bool SimpleSDR::read_samples_async() {
-    if (!device) return false;
+    if (!source) return false;
+    if (!capturing && !start_capture()) return false;
     
-    uint8_t buffer[8192]; // smaller buffer for gui
-    int n_read;
+    // run protocol analysis on everything captured since the last call
+    if (protocol_analyzer) {
+        while (analysis_reader->available() >= DISPLAY_BLOCK_LEN) {
+            const uint8_t* data;
+            size_t len = analysis_reader->acquire(data, DISPLAY_BLOCK_LEN);
+            if (len < DISPLAY_BLOCK_LEN) {
+                // block wraps around the end of the ring, take the copying path
+                len = analysis_reader->read(read_buffer.data(), DISPLAY_BLOCK_LEN);
+                convert_samples(read_buffer.data(), len, analysis_buffer);
+            } else {
+                convert_samples(data, len, analysis_buffer);
+                if (!analysis_reader->release(len)) continue; // overwritten mid-convert
+            }
+            protocol_analyzer->detect_signals(analysis_buffer);
+        }
+    }
     
-    int result = rtlsdr_read_sync(device, buffer, sizeof(buffer), &n_read);
-    if (result < 0) {
+    // the display only ever needs the newest block
+    display_reader->seek_to_latest(DISPLAY_BLOCK_LEN);
+    size_t n_read = display_reader->read(read_buffer.data(), DISPLAY_BLOCK_LEN);
+    if (n_read == 0) {
         return false;
     }
     
-    convert_samples(buffer, n_read);
-    
-    // run protocol analysis if analyzer is connected
-    if (protocol_analyzer && !iq_buffer.empty()) {
-        protocol_analyzer->detect_signals(iq_buffer);
-    }
+    convert_samples(read_buffer.data(), n_read);
     
     return true;
 }
\ No newline at end of file
@@ -4,34 +4,129 @@
 #include <vector>
 #include <complex>
 #include <cstdint>
-#include <rtl-sdr.h>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <string>
+#include "sample_ring.h"
+#include "sample_source.h"
 
 // forward declaration
 class ProtocolAnalyzer;
 
-class SimpleSDR {
-private:
-    rtlsdr_dev_t* device;
-    uint32_t sample_rate;
+// one stretch of the capture stream recorded with the same tuning. positions
+// are ring byte offsets, samples before start_byte are pll settling or were
+// still in flight from the previous tuning and should be thrown away.
+struct TuningSegment {
     uint32_t center_freq;
+    uint32_t sample_rate;
+    uint64_t start_byte;       // first settled byte, UINT64_MAX while retuning
+    uint64_t end_byte;         // next retune, UINT64_MAX for the current tuning
+};
+
+class SimpleSDR : private SourceListener {
+private:
+    // a dongle or a recording, run on the capture thread
+    std::unique_ptr<SampleSource> source;
+    int device_index;
+    std::string device_serial;
+    std::atomic<uint32_t> sample_rate;
+    std::atomic<uint32_t> center_freq;    // read by pipeline threads
     int gain;
-    bool running;
+    std::atomic<bool> running;
+    
+    // async capture, the source runs on its own thread and pushes every
+    // buffer into the ring. consumers read at their own pace.
+    static const size_t RING_CAPACITY = 16 * 1024 * 1024; // ~4 s at 2.048 MS/s, the default
+    std::unique_ptr<SampleRing> sample_ring;
+    std::thread capture_thread;
+    std::atomic<bool> capturing;
+    
+    // every retune is logged against the ring position so consumers that lag
+    // behind the capture still tag their samples with the right frequency.
+    // settling covers the pll lock plus the usb transfers already queued.
+    static const uint32_t SETTLE_TIME_MS = 5;
+    static const size_t TUNING_HISTORY = 64;
+    struct TuningRecord {
+        uint32_t center_freq;
+        uint32_t sample_rate;
+        uint64_t retune_byte;  // write position when the retune was issued
+        uint64_t settle_byte;
+    };
+    std::deque<TuningRecord> tuning_history;
+    mutable std::mutex tune_mutex;     // also serializes source tuning calls
+    
+    void retune(uint32_t freq, uint32_t rate);
+    void push_tuning(uint32_t freq, uint32_t rate, uint64_t retune_byte, uint64_t settle_byte);
+    
+    // gui reads the newest block, the analyzer drains everything
+    static const size_t DISPLAY_BLOCK_LEN = 16384;
+    std::unique_ptr<SampleRingReader> display_reader;
+    std::unique_ptr<SampleRingReader> analysis_reader;
+    std::vector<uint8_t> read_buffer;
     
     std::vector<std::complex<float>> iq_buffer;
+    std::vector<std::complex<float>> analysis_buffer;
     ProtocolAnalyzer* protocol_analyzer;
     
+    void capture_loop();
+    
+    // SourceListener, called from the capture thread
+    void deliver(const uint8_t* data, uint32_t len) override;
+    void source_retuned(uint32_t freq, uint32_t rate, uint64_t settle_bytes) override;
+    uint64_t reader_backlog() const override { return sample_ring->gate_backlog(); }
+    size_t buffer_capacity() const override { return sample_ring->capacity(); }
+    
 public:
     SimpleSDR();
     ~SimpleSDR();
     
-    bool initialize();
-    void convert_samples(uint8_t* buffer, uint32_t len);
+    // opens the dongle at index, find_device() looks serials up
+    bool initialize(int index = 0);
+    // index of the dongle whose serial or index is selector, -1 if there is none
+    static int find_device(const std::string& selector);
+    // plays an IQRecorder file instead of a dongle, paced in real time or as
+    // fast as the gate readers keep up. tuning comes from the recording.
+    bool open_replay(const std::string& path, bool realtime);
+    bool is_replay() const { return source && !source->is_live(); }
+    void convert_samples(const uint8_t* buffer, uint32_t len);
+    static void convert_samples(const uint8_t* buffer, uint32_t len, std::vector<std::complex<float>>& out);
+    // out must hold len / 2 samples
+    static void convert_samples(const uint8_t* buffer, uint32_t len, std::complex<float>* out);
     void analyze_samples();
     void run();
     void stop();
     void set_frequency(uint32_t freq);
     
+    // how far back the ring reaches, rounded up to a power of two bytes.
+    // only before the capture starts and before any reader is created.
+    bool set_history_seconds(double seconds);
+    
+    // capture thread control
+    bool start_capture();
+    void stop_capture();
+    bool is_capturing() const { return capturing; }
+    
+    // new reader positioned at the current write position, caller owns it.
+    // a replay never gets ahead of gate readers, live capture ignores gates.
+    std::unique_ptr<SampleRingReader> create_reader(bool gate = false);
+    
+    // tuning in effect at ring position pos, false before the first tuning
+    bool find_tuning(uint64_t pos, TuningSegment& segment) const;
+    // ring position where the current tuning becomes usable
+    uint64_t get_settle_position() const;
+    
+    // capture statistics
+    size_t get_history_bytes() const { return sample_ring->capacity(); }
+    uint64_t get_captured_bytes() const { return sample_ring ? sample_ring->write_position() : 0; }
+    uint64_t get_overrun_count() const { return sample_ring ? sample_ring->get_overrun_count() : 0; }
+    uint64_t get_analysis_dropped_bytes() const { return analysis_reader ? analysis_reader->get_dropped_bytes() : 0; }
+    
     // getters for gui
+    int get_device_index() const { return device_index; }
+    const std::string& get_device_serial() const { return device_serial; }
     uint32_t get_sample_rate() const { return sample_rate; }
     uint32_t get_center_freq() const { return center_freq; }
     int get_gain() const { return gain; }
@@ -42,7 +137,7 @@ public:
     void set_sample_rate(uint32_t rate);
     void set_gain(int new_gain);
     
-    // non-blocking sample read for gui
+    // non-blocking sample read for gui, drains the capture ring
     bool read_samples_async();
     
     // protocol analysis stuff
@@ -0,0 +1,105 @@
+#include "signature_index.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+static const std::vector<const ProtocolSignature*> no_candidates;
+
+// one past the highest ProtocolType value
+static const size_t PROTOCOL_TYPE_COUNT = (size_t)ProtocolType::SECURITY_SENSOR + 1;
+
+// signature ranges are inclusive on both ends. a signature pinned to a single
+// frequency (min == max) is widened to its typical bandwidth so peaks from
+// the fft grid can actually land on it.
+static void signature_range(const ProtocolSignature& signature, double& begin, double& end) {
+    begin = signature.frequency_min;
+    end = signature.frequency_max;
+    if (end <= begin) {
+        begin -= signature.bandwidth_typical / 2;
+        end += signature.bandwidth_typical / 2;
+    }
+    end = std::nextafter(end, std::numeric_limits<double>::infinity());
+}
+
+SignatureIndex::SignatureIndex() : by_type(PROTOCOL_TYPE_COUNT, nullptr) {
+}
+
+bool SignatureIndex::build(std::vector<ProtocolSignature> new_signatures) {
+    if (!check_ids(new_signatures)) return false;
+    signatures = std::move(new_signatures);
+    rebuild();
+    return true;
+}
+
+bool SignatureIndex::add(const ProtocolSignature& signature) {
+    std::vector<ProtocolSignature> grown = signatures;
+    grown.push_back(signature);
+    return build(std::move(grown));
+}
+
+// device keys hold the id, two signatures sharing one would share devices
+bool SignatureIndex::check_ids(const std::vector<ProtocolSignature>& signatures) {
+    std::unordered_map<uint32_t, const std::string*> names;
+    for (const auto& signature : signatures) {
+        auto inserted = names.emplace(signature_id(signature.name), &signature.name);
+        if (!inserted.second) {
+            std::cerr << "Signatures " << *inserted.first->second << " and " << signature.name
+                      << " have the same id, rename one of them" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void SignatureIndex::rebuild() {
+    boundaries.clear();
+    segments.clear();
+    std::fill(by_type.begin(), by_type.end(), nullptr);
+    by_id.clear();
+    
+    for (const auto& signature : signatures) {
+        double begin, end;
+        signature_range(signature, begin, end);
+        boundaries.push_back(begin);
+        boundaries.push_back(end);
+        
+        size_t type = (size_t)signature.type;
+        if (type < by_type.size() && !by_type[type]) {
+            by_type[type] = &signature;
+        }
+        by_id[signature_id(signature.name)] = &signature;
+    }
+    
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+    if (boundaries.size() < 2) return;
+    
+    segments.resize(boundaries.size() - 1);
+    for (const auto& signature : signatures) {
+        double begin, end;
+        signature_range(signature, begin, end);
+        
+        size_t first = std::lower_bound(boundaries.begin(), boundaries.end(), begin) - boundaries.begin();
+        size_t last = std::lower_bound(boundaries.begin(), boundaries.end(), end) - boundaries.begin();
+        for (size_t i = first; i < last; i++) {
+            segments[i].push_back(&signature);
+        }
+    }
+}
+
+const std::vector<const ProtocolSignature*>& SignatureIndex::find_candidates(double frequency) const {
+    auto it = std::upper_bound(boundaries.begin(), boundaries.end(), frequency);
+    if (it == boundaries.begin() || it == boundaries.end()) return no_candidates;
+    return segments[(it - boundaries.begin()) - 1];
+}
+
+const ProtocolSignature* SignatureIndex::find_by_type(ProtocolType type) const {
+    size_t index = (size_t)type;
+    return index < by_type.size() ? by_type[index] : nullptr;
+}
+
+const ProtocolSignature* SignatureIndex::find_by_id(uint32_t id) const {
+    auto it = by_id.find(id);
+    return it != by_id.end() ? it->second : nullptr;
+}
@@ -0,0 +1,48 @@
+#ifndef SIGNATURE_INDEX_H
+#define SIGNATURE_INDEX_H
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <cstddef>
+#include "protocol_types.h"
+
+// protocol signatures compiled into an interval index over frequency. the
+// signature ranges split the spectrum into elementary segments, each of which
+// stores every signature covering it, so one binary search finds all
+// candidates. candidates keep the order the signatures were loaded in.
+class SignatureIndex {
+private:
+    std::vector<ProtocolSignature> signatures;
+    
+    // segment i covers [boundaries[i], boundaries[i + 1])
+    std::vector<double> boundaries;
+    std::vector<std::vector<const ProtocolSignature*>> segments;
+    
+    // first signature of each type, indexed by ProtocolType
+    std::vector<const ProtocolSignature*> by_type;
+    std::unordered_map<uint32_t, const ProtocolSignature*> by_id;
+    
+    void rebuild();
+    static bool check_ids(const std::vector<ProtocolSignature>& signatures);
+    
+public:
+    SignatureIndex();
+    
+    // replaces every signature, pointers handed out before are invalidated.
+    // false with a message, and nothing changed, if two signature ids collide.
+    bool build(std::vector<ProtocolSignature> new_signatures);
+    bool add(const ProtocolSignature& signature);
+    
+    // every signature whose range contains frequency, empty if none
+    const std::vector<const ProtocolSignature*>& find_candidates(double frequency) const;
+    const ProtocolSignature* find_by_type(ProtocolType type) const;
+    const ProtocolSignature* find_by_id(uint32_t id) const;
+    
+    const std::vector<ProtocolSignature>& get_signatures() const { return signatures; }
+    size_t size() const { return signatures.size(); }
+};
+
+typedef std::shared_ptr<const SignatureIndex> SignatureIndexPtr;
+
+#endif // SIGNATURE_INDEX_H
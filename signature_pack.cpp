@@ -0,0 +1,247 @@
+#include "signature_pack.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <dirent.h>
+
+static const struct {
+    const char* name;
+    ProtocolType type;
+} PROTOCOL_TYPE_NAMES[] = {
+    {"ISM_433_OOK", ProtocolType::ISM_433_OOK},
+    {"ISM_433_FSK", ProtocolType::ISM_433_FSK},
+    {"ISM_915_OOK", ProtocolType::ISM_915_OOK},
+    {"ISM_868_OOK", ProtocolType::ISM_868_OOK},
+    {"ZIGBEE_915", ProtocolType::ZIGBEE_915},
+    {"ZIGBEE_868", ProtocolType::ZIGBEE_868},
+    {"LORA_433", ProtocolType::LORA_433},
+    {"LORA_868", ProtocolType::LORA_868},
+    {"LORA_915", ProtocolType::LORA_915},
+    {"WIRELESS_MBUS", ProtocolType::WIRELESS_MBUS},
+    {"TPMS", ProtocolType::TPMS},
+    {"WEATHER_STATION", ProtocolType::WEATHER_STATION},
+    {"GARAGE_DOOR", ProtocolType::GARAGE_DOOR},
+    {"SECURITY_SENSOR", ProtocolType::SECURITY_SENSOR},
+};
+
+static std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return "";
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+static std::string lowercase(std::string text) {
+    for (auto& c : text) c = (char)tolower((unsigned char)c);
+    return text;
+}
+
+static bool parse_number(const std::string& text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return !text.empty() && end && *end == '\0';
+}
+
+static bool parse_type(const std::string& text, ProtocolType& type) {
+    for (const auto& entry : PROTOCOL_TYPE_NAMES) {
+        if (text == entry.name) {
+            type = entry.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_modulation(const std::string& text, Modulation& modulation) {
+    std::string name = lowercase(text);
+    if (name == "ook") modulation = Modulation::OOK;
+    else if (name == "fsk") modulation = Modulation::FSK;
+    else if (name == "lora") modulation = Modulation::LORA_CSS;
+    else if (name == "oqpsk") modulation = Modulation::OQPSK;
+    else if (name == "unknown") modulation = Modulation::UNKNOWN;
+    else return false;
+    return true;
+}
+
+static ProtocolSignature empty_signature() {
+    ProtocolSignature signature;
+    signature.type = ProtocolType::UNKNOWN;
+    signature.frequency_min = 0;
+    signature.frequency_max = 0;
+    signature.bandwidth_typical = 25000;
+    signature.modulation = Modulation::UNKNOWN;
+    signature.symbol_rate_min = 0;
+    signature.symbol_rate_max = 0;
+    signature.is_burst_mode = true;
+    return signature;
+}
+
+// every required field set and the range the right way round
+static bool check_signature(const std::string& path, int line, const ProtocolSignature& signature) {
+    const char* problem = nullptr;
+    if (signature.type == ProtocolType::UNKNOWN) problem = "has no type";
+    else if (signature.name.empty()) problem = "has no name";
+    else if (signature.frequency_min <= 0 || signature.frequency_max < signature.frequency_min) {
+        problem = "needs 0 < frequency_min <= frequency_max";
+    }
+    if (problem) {
+        std::cerr << "Signature pack " << path << ": signature ending at line " << line << " " << problem
+                  << "!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool load_signature_pack(const std::string& path, SignaturePack& pack) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open signature pack " << path << "!" << std::endl;
+        return false;
+    }
+    
+    bool in_signature = false;
+    ProtocolSignature signature = empty_signature();
+    std::string raw;
+    int line_number = 0;
+    while (std::getline(file, raw)) {
+        line_number++;
+        std::string line = trim(raw.substr(0, raw.find('#')));
+        if (line.empty()) continue;
+        
+        if (line == "[signature]") {
+            if (in_signature) {
+                if (!check_signature(path, line_number - 1, signature)) return false;
+                pack.signatures.push_back(signature);
+            }
+            in_signature = true;
+            signature = empty_signature();
+            continue;
+        }
+        
+        size_t eq = line.find('=');
+        std::string key = eq == std::string::npos ? line : trim(line.substr(0, eq));
+        std::string value = eq == std::string::npos ? "" : trim(line.substr(eq + 1));
+        double number = 0.0;
+        bool valid = true;
+        if (eq == std::string::npos) {
+            valid = false;
+        } else if (!in_signature) {
+            valid = key == "disable" && !value.empty();
+            if (valid) pack.disabled.push_back(value);
+        } else if (key == "type") {
+            valid = parse_type(value, signature.type);
+        } else if (key == "name") {
+            signature.name = value;
+        } else if (key == "description") {
+            signature.description = value;
+        } else if (key == "security_notes") {
+            signature.security_notes = value;
+        } else if (key == "security_flag") {
+            signature.security_flag = value;
+        } else if (key == "modulation") {
+            valid = parse_modulation(value, signature.modulation);
+        } else if (key == "burst") {
+            valid = value == "0" || value == "1";
+            signature.is_burst_mode = value == "1";
+        } else if (key == "devices") {
+            std::istringstream devices(value);
+            std::string device;
+            signature.common_devices.clear();
+            while (std::getline(devices, device, ',')) {
+                if (!trim(device).empty()) signature.common_devices.push_back(trim(device));
+            }
+        } else if (parse_number(value, number)) {
+            if (key == "frequency_min") signature.frequency_min = number;
+            else if (key == "frequency_max") signature.frequency_max = number;
+            else if (key == "bandwidth") signature.bandwidth_typical = number;
+            else if (key == "symbol_rate_min") signature.symbol_rate_min = number;
+            else if (key == "symbol_rate_max") signature.symbol_rate_max = number;
+            else valid = false;
+        } else {
+            valid = false;
+        }
+        
+        if (!valid) {
+            std::cerr << "Signature pack " << path << " line " << line_number << ": can't use \"" << line
+                      << "\"!" << std::endl;
+            return false;
+        }
+    }
+    if (in_signature) {
+        if (!check_signature(path, line_number, signature)) return false;
+        pack.signatures.push_back(signature);
+    }
+    return true;
+}
+
+bool list_signature_packs(const std::string& path, std::vector<std::string>& files) {
+    files.clear();
+    struct stat info;
+    if (stat(path.c_str(), &info) < 0) {
+        std::cerr << "Signature pack " << path << " does not exist!" << std::endl;
+        return false;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        files.push_back(path);
+        return true;
+    }
+    
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        std::cerr << "Failed to read signature pack directory " << path << "!" << std::endl;
+        return false;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".sig") == 0) {
+            files.push_back(path + "/" + name);
+        }
+    }
+    closedir(dir);
+    // later packs override earlier ones, keep that independent of the file system
+    std::sort(files.begin(), files.end());
+    return true;
+}
+
+uint64_t signature_packs_stamp(const std::vector<std::string>& files) {
+    // fnv-1a over every name, size and modification time
+    uint64_t stamp = 14695981039346656037ULL;
+    auto mix = [&stamp](uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            stamp = (stamp ^ ((value >> (i * 8)) & 0xff)) * 1099511628211ULL;
+        }
+    };
+    for (const auto& file : files) {
+        for (char c : file) mix((uint8_t)c);
+        struct stat info;
+        if (stat(file.c_str(), &info) < 0) {
+            mix(0);
+            continue;
+        }
+        mix((uint64_t)info.st_size);
+        mix((uint64_t)info.st_mtim.tv_sec);
+        mix((uint64_t)info.st_mtim.tv_nsec);
+    }
+    return stamp;
+}
+
+void merge_signature_pack(std::vector<ProtocolSignature>& signatures, const SignaturePack& pack) {
+    for (const auto& name : pack.disabled) {
+        signatures.erase(std::remove_if(signatures.begin(), signatures.end(),
+                                        [&name](const ProtocolSignature& s) { return s.name == name; }),
+                         signatures.end());
+    }
+    for (const auto& signature : pack.signatures) {
+        auto existing = std::find_if(signatures.begin(), signatures.end(),
+                                     [&signature](const ProtocolSignature& s) { return s.name == signature.name; });
+        if (existing != signatures.end()) {
+            *existing = signature;
+        } else {
+            signatures.push_back(signature);
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SIGNATURE_PACK_H
+#define SIGNATURE_PACK_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "protocol_types.h"
+
+// protocol signatures kept in text files, so regions can add and tune them
+// without a rebuild. one key=value per line, # starts a comment:
+//
+//   disable=LoRa 915MHz            drop a signature loaded before this pack
+//   [signature]                    starts a signature
+//   type=LORA_868                  ProtocolType name, required
+//   name=LoRa 868MHz               required, replaces a signature of that name.
+//                                  devices are keyed by it and keep it across reloads
+//   description=...
+//   frequency_min=863000000        hz, required
+//   frequency_max=870000000        hz, required
+//   bandwidth=125000               hz
+//   modulation=lora                ook, fsk, lora, oqpsk or unknown
+//   symbol_rate_min=250
+//   symbol_rate_max=5470
+//   burst=1
+//   devices=Gateways, Trackers     comma separated
+//   security_notes=...
+//   security_flag=WARNING: ...     alert raised for every device of it,
+//                                  CRITICAL:, WARNING: or INFO: first
+struct SignaturePack {
+    std::vector<ProtocolSignature> signatures;
+    std::vector<std::string> disabled;     // names
+};
+
+// false with a message on the first malformed line, pack is then incomplete
+bool load_signature_pack(const std::string& path, SignaturePack& pack);
+
+// path itself, or every .sig file in it if it is a directory, sorted by name
+bool list_signature_packs(const std::string& path, std::vector<std::string>& files);
+
+// changes whenever one of the files is modified, added or removed
+uint64_t signature_packs_stamp(const std::vector<std::string>& files);
+
+// a pack signature replaces the one with its name or is added at the end,
+// disabled names are dropped first
+void merge_signature_pack(std::vector<ProtocolSignature>& signatures, const SignaturePack& pack);
+
+#endif // SIGNATURE_PACK_H
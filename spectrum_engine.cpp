@@ -0,0 +1,153 @@
+#include "spectrum_engine.h"
+#include "fft_plan_cache.h"
+#include <cmath>
+#include <algorithm>
+
+SpectrumEngine::SpectrumEngine(int fft_size, WindowType window_type)
+    : fft_size(fft_size), hop_size(fft_size / 2), window_type(window_type),
+      fft_in(nullptr), fft_out(nullptr), fft_plan(nullptr), welch_accumulator(nullptr), window_gain(1.0f),
+      welch_kernel(&SpectrumEngine::welch_generic) {
+}
+
+SpectrumEngine::~SpectrumEngine() {
+    cleanup();
+}
+
+bool SpectrumEngine::initialize() {
+    if (fft_plan) return true;
+    
+    // fftwf_malloc gives simd-aligned buffers, allocated once and reused
+    fft_in = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * fft_size);
+    fft_out = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * fft_size);
+    welch_accumulator = (float*) fftwf_malloc(sizeof(float) * fft_size);
+    if (!fft_in || !fft_out || !welch_accumulator) {
+        cleanup();
+        return false;
+    }
+    
+    // shared with every other engine of this size, measured once per machine
+    fft_plan = FFTPlanCache::instance().get_plan(fft_size, FFTW_FORWARD, fft_in, fft_out);
+    if (!fft_plan) {
+        cleanup();
+        return false;
+    }
+    
+    // the sizes the analyzer and gui use run kernels compiled for them
+    switch (fft_size) {
+        case 1024: welch_kernel = fixed_kernel<1024>(window_type); break;
+        case 2048: welch_kernel = fixed_kernel<2048>(window_type); break;
+        default: welch_kernel = &SpectrumEngine::welch_generic; break;
+    }
+    
+    // window for the generic kernel, normalized so a full scale tone reads 0 dB
+    if (!is_specialized()) {
+        window.resize(fft_size);
+        double window_sum = 0.0;
+        for (int i = 0; i < fft_size; i++) {
+            window[i] = (float)window_coefficient(window_type, i, fft_size);
+            window_sum += window[i];
+        }
+        window_gain = (float)(window_sum * window_sum);
+    }
+    
+    return true;
+}
+
+template <int N>
+SpectrumEngine::WelchKernel SpectrumEngine::fixed_kernel(WindowType type) {
+    switch (type) {
+        case WindowType::BLACKMAN_HARRIS: return &SpectrumEngine::welch_fixed<WindowType::BLACKMAN_HARRIS, N>;
+        default: return &SpectrumEngine::welch_fixed<WindowType::HANN, N>;
+    }
+}
+
+void SpectrumEngine::cleanup() {
+    // the plan belongs to the plan cache
+    fft_plan = nullptr;
+    if (fft_in) {
+        fftwf_free(fft_in);
+        fft_in = nullptr;
+    }
+    if (fft_out) {
+        fftwf_free(fft_out);
+        fft_out = nullptr;
+    }
+    if (welch_accumulator) {
+        fftwf_free(welch_accumulator);
+        welch_accumulator = nullptr;
+    }
+}
+
+bool SpectrumEngine::compute(const std::vector<std::complex<float>>& iq_data, SpectrumFrame& frame) {
+    if (!fft_plan || iq_data.size() < (size_t)fft_size) {
+        frame.power_db.clear();
+        return false;
+    }
+    
+    frame.power_db.resize(fft_size);
+    (this->*welch_kernel)(iq_data, frame.power_db.data());
+    return true;
+}
+
+// Welch's method: average windowed periodograms over the whole block, then
+// convert to dB and swap halves so the spectrum runs from -fs/2 to +fs/2
+template <WindowType W, int N>
+void SpectrumEngine::welch_fixed(const std::vector<std::complex<float>>& iq_data, float* out) {
+    std::fill(welch_accumulator, welch_accumulator + N, 0.0f);
+    int segments = 0;
+    
+    for (size_t start = 0; start + N <= iq_data.size(); start += N / 2) {
+        window_segment<W, N>(&iq_data[start], fft_in);
+        fftwf_execute_dft(fft_plan, fft_in, fft_out);
+        accumulate_power<N>(fft_out, welch_accumulator);
+        segments++;
+    }
+    
+    power_to_db_shifted<N>(welch_accumulator, 1.0f / (segments * WINDOW_TABLE<W, N>.gain), out);
+}
+
+void SpectrumEngine::welch_generic(const std::vector<std::complex<float>>& iq_data, float* out) {
+    std::fill(welch_accumulator, welch_accumulator + fft_size, 0.0f);
+    int segments = 0;
+    
+    for (size_t start = 0; start + fft_size <= iq_data.size(); start += hop_size) {
+        window_segment(&iq_data[start], window.data(), fft_size, fft_in);
+        fftwf_execute_dft(fft_plan, fft_in, fft_out);
+        accumulate_power(fft_out, fft_size, welch_accumulator);
+        segments++;
+    }
+    
+    power_to_db_shifted(welch_accumulator, fft_size, 1.0f / (segments * window_gain), out);
+}
+
+void SpectrumEngine::publish(SpectrumFramePtr frame) {
+    std::lock_guard<std::mutex> lock(latest_mutex);
+    latest_frame = frame;
+}
+
+SpectrumFramePtr SpectrumEngine::get_latest() const {
+    std::lock_guard<std::mutex> lock(latest_mutex);
+    return latest_frame;
+}
+
+void SpectrumEngine::resample_bins(const std::vector<float>& bins, size_t out_bins, std::vector<float>& out) {
+    out.resize(out_bins);
+    if (bins.empty() || out_bins == 0) {
+        std::fill(out.begin(), out.end(), -200.0f);
+        return;
+    }
+    
+    if (bins.size() >= out_bins) {
+        // decimate, max-hold over each group of input bins
+        for (size_t i = 0; i < out_bins; i++) {
+            size_t first = i * bins.size() / out_bins;
+            size_t last = std::max(first + 1, (i + 1) * bins.size() / out_bins);
+            out[i] = *std::max_element(bins.begin() + first, bins.begin() + last);
+        }
+    } else {
+        // stretch, nearest input bin
+        for (size_t i = 0; i < out_bins; i++) {
+            out[i] = bins[i * bins.size() / out_bins];
+        }
+    }
+}
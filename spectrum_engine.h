@@ -0,0 +1,82 @@
+#ifndef SPECTRUM_ENGINE_H
+#define SPECTRUM_ENGINE_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fftw3.h>
+#include "spectrum_kernels.h"
+
+// one averaged power spectrum per capture block. bins are fft-shifted
+// (bin 0 = center - fs/2) and in dBFS, a full scale tone reads 0 dB.
+struct SpectrumFrame {
+    uint64_t sequence;
+    uint32_t center_freq;
+    uint32_t sample_rate;
+    std::chrono::steady_clock::time_point capture_time;
+    std::vector<float> power_db;
+    
+    double bin_to_frequency(size_t bin) const {
+        return center_freq + ((double)bin - power_db.size() / 2.0) * sample_rate / power_db.size();
+    }
+};
+
+typedef std::shared_ptr<const SpectrumFrame> SpectrumFramePtr;
+
+// computes the single fft per capture block that both the detector and the
+// gui consume, and keeps the newest frame around for readers on other threads
+class SpectrumEngine {
+private:
+    int fft_size;
+    int hop_size;              // welch segment hop, 50% overlap
+    WindowType window_type;
+    
+    fftwf_complex* fft_in;
+    fftwf_complex* fft_out;
+    fftwf_plan fft_plan;
+    float* welch_accumulator;
+    std::vector<float> window; // generic kernel only, the fixed ones have constexpr tables
+    float window_gain;         // (sum of window)^2
+    
+    // welch average of a block into fft_size db bins. fixed sizes get a
+    // kernel compiled for exactly that size and window, see initialize()
+    typedef void (SpectrumEngine::*WelchKernel)(const std::vector<std::complex<float>>& iq_data, float* out);
+    WelchKernel welch_kernel;
+    
+    template <WindowType W, int N>
+    void welch_fixed(const std::vector<std::complex<float>>& iq_data, float* out);
+    void welch_generic(const std::vector<std::complex<float>>& iq_data, float* out);
+    template <int N>
+    static WelchKernel fixed_kernel(WindowType type);
+    
+    mutable std::mutex latest_mutex;
+    SpectrumFramePtr latest_frame;
+    
+    void cleanup();
+    
+public:
+    explicit SpectrumEngine(int fft_size = 2048, WindowType window_type = WindowType::HANN);
+    ~SpectrumEngine();
+    
+    bool initialize();
+    int get_fft_size() const { return fft_size; }
+    // false when this size runs the generic kernel
+    bool is_specialized() const { return welch_kernel != &SpectrumEngine::welch_generic; }
+    
+    // welch average over the whole block into frame.power_db. reuses the
+    // engine's fft buffers, so only one thread may compute at a time.
+    bool compute(const std::vector<std::complex<float>>& iq_data, SpectrumFrame& frame);
+    
+    // hand a finished frame to readers, the frame must not change afterwards
+    void publish(SpectrumFramePtr frame);
+    SpectrumFramePtr get_latest() const;
+    
+    // squeeze or stretch bins to out_bins for display. decimating keeps the
+    // max of each group so narrow carriers don't disappear.
+    static void resample_bins(const std::vector<float>& bins, size_t out_bins, std::vector<float>& out);
+};
+
+#endif // SPECTRUM_ENGINE_H
@@ -0,0 +1,145 @@
+#ifndef SPECTRUM_KERNELS_H
+#define SPECTRUM_KERNELS_H
+
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <fftw3.h>
+
+// the per bin loops of the spectrum engine. the templated kernels have the
+// fft size and window baked in, so every loop has a fixed trip count and a
+// constexpr coefficient table the compiler unrolls and vectorizes. the
+// generic ones take both at runtime and serve every other size.
+
+enum class WindowType {
+    HANN,
+    BLACKMAN_HARRIS    // 92 dB sidelobes, for picking weak carriers next to strong ones
+};
+
+static constexpr double KERNEL_PI = 3.14159265358979323846;
+// 10 * log10(2), db from log2
+static constexpr float DB_PER_OCTAVE = 3.01029995663981f;
+// keeps empty bins finite, -200 dB
+static constexpr float POWER_FLOOR = 1e-20f;
+
+// std::cos isn't constexpr. taylor series after reducing to [-pi, pi],
+// accurate to double rounding, only ever run by the compiler.
+constexpr double constexpr_cos(double x) {
+    while (x > KERNEL_PI) x -= 2.0 * KERNEL_PI;
+    while (x < -KERNEL_PI) x += 2.0 * KERNEL_PI;
+    double term = 1.0;
+    double sum = 1.0;
+    for (int k = 1; k < 24; k++) {
+        term *= -x * x / ((2.0 * k - 1.0) * (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double window_coefficient(WindowType type, int index, int size) {
+    double phase = 2.0 * KERNEL_PI * index / size;
+    if (type == WindowType::BLACKMAN_HARRIS) {
+        return 0.35875 - 0.48829 * constexpr_cos(phase) + 0.14128 * constexpr_cos(2.0 * phase) -
+               0.01168 * constexpr_cos(3.0 * phase);
+    }
+    return 0.5 - 0.5 * constexpr_cos(phase);
+}
+
+// coefficients and the (sum of window)^2 that normalizes a full scale tone to 0 dB
+template <WindowType W, int N>
+struct WindowTable {
+    std::array<float, N> coefficients;
+    float gain;
+    
+    constexpr WindowTable() : coefficients(), gain(0.0f) {
+        double sum = 0.0;
+        for (int i = 0; i < N; i++) {
+            coefficients[i] = (float)window_coefficient(W, i, N);
+            sum += coefficients[i];
+        }
+        gain = (float)(sum * sum);
+    }
+};
+
+template <WindowType W, int N>
+inline constexpr WindowTable<W, N> WINDOW_TABLE{};
+
+// log2 from the float's exponent plus a polynomial on the mantissa,
+// |error| < 1.5e-5 (4e-5 dB). x must be positive and normal.
+inline float fast_log2(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    float exponent = (float)((int32_t)(bits >> 23) - 127);
+    bits = (bits & 0x007fffffu) | 0x3f800000u;
+    float mantissa;
+    std::memcpy(&mantissa, &bits, sizeof(mantissa));
+    
+    // log2(1 + t) = t * q(t) on [0, 1), least squares fit
+    float t = mantissa - 1.0f;
+    float q = 0.0463771826f;
+    q = q * t - 0.196249744f;
+    q = q * t + 0.417579087f;
+    q = q * t - 0.709657283f;
+    q = q * t + 1.44196504f;
+    return exponent + t * q;
+}
+
+inline float fast_power_db(float power) {
+    return DB_PER_OCTAVE * fast_log2(power + POWER_FLOOR);
+}
+
+// windowed copy of one welch segment into the fft input
+template <WindowType W, int N>
+inline void window_segment(const std::complex<float>* in, fftwf_complex* out) {
+    const std::array<float, N>& window = WINDOW_TABLE<W, N>.coefficients;
+    const float* src = reinterpret_cast<const float*>(in);
+    float* dst = &out[0][0];
+    for (int i = 0; i < N; i++) {
+        dst[2 * i] = src[2 * i] * window[i];
+        dst[2 * i + 1] = src[2 * i + 1] * window[i];
+    }
+}
+
+template <int N>
+inline void accumulate_power(const fftwf_complex* in, float* accumulator) {
+    const float* src = &in[0][0];
+    for (int i = 0; i < N; i++) {
+        accumulator[i] += src[2 * i] * src[2 * i] + src[2 * i + 1] * src[2 * i + 1];
+    }
+}
+
+// scaled accumulator to db with the fft shift folded in, out[0] is -fs/2
+template <int N>
+inline void power_to_db_shifted(const float* accumulator, float scale, float* out) {
+    const int half = N / 2;
+    for (int i = 0; i < half; i++) {
+        out[i] = fast_power_db(accumulator[i + half] * scale);
+    }
+    for (int i = 0; i < half; i++) {
+        out[i + half] = fast_power_db(accumulator[i] * scale);
+    }
+}
+
+// runtime sized versions of the above
+inline void window_segment(const std::complex<float>* in, const float* window, int size, fftwf_complex* out) {
+    for (int i = 0; i < size; i++) {
+        out[i][0] = in[i].real() * window[i];
+        out[i][1] = in[i].imag() * window[i];
+    }
+}
+
+inline void accumulate_power(const fftwf_complex* in, int size, float* accumulator) {
+    for (int i = 0; i < size; i++) {
+        accumulator[i] += in[i][0] * in[i][0] + in[i][1] * in[i][1];
+    }
+}
+
+inline void power_to_db_shifted(const float* accumulator, int size, float scale, float* out) {
+    const int half = size / 2;
+    for (int i = 0; i < size; i++) {
+        out[i] = fast_power_db(accumulator[(i + half) % size] * scale);
+    }
+}
+
+#endif // SPECTRUM_KERNELS_H
@@ -0,0 +1,126 @@
+#include "task_pool.h"
+#include <algorithm>
+
+static std::atomic<size_t> configured_threads(SIZE_MAX);
+
+void TaskPool::configure(size_t threads) {
+    configured_threads = threads;
+}
+
+TaskPool& TaskPool::instance() {
+    static TaskPool pool(configured_threads != SIZE_MAX ? configured_threads.load()
+                         : std::max<size_t>(1, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+TaskPool::TaskPool(size_t threads) : queued_tasks(0), next_deque(0), stopping(false) {
+    for (size_t i = 0; i < threads; i++) {
+        deques.emplace_back(new Deque());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&TaskPool::worker_loop, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+bool TaskPool::push(Deque& deque, const Task& task) {
+    {
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        if (deque.count == DEQUE_CAPACITY) return false;
+        deque.tasks[(deque.head + deque.count) % DEQUE_CAPACITY] = task;
+        deque.count++;
+        queued_tasks++;
+    }
+    // taking the sleep lock orders this against a worker about to wait
+    { std::lock_guard<std::mutex> lock(sleep_mutex); }
+    wake.notify_one();
+    return true;
+}
+
+bool TaskPool::pop_back(Deque& deque, Task& task) {
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    if (deque.count == 0) return false;
+    deque.count--;
+    task = deque.tasks[(deque.head + deque.count) % DEQUE_CAPACITY];
+    queued_tasks--;
+    return true;
+}
+
+bool TaskPool::steal(size_t first, Task& task) {
+    for (size_t i = 0; i < deques.size(); i++) {
+        Deque& deque = *deques[(first + i) % deques.size()];
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        if (deque.count == 0) continue;
+        task = deque.tasks[deque.head];
+        deque.head = (deque.head + 1) % DEQUE_CAPACITY;
+        deque.count--;
+        queued_tasks--;
+        return true;
+    }
+    return false;
+}
+
+void TaskPool::execute(Task task, Deque* own) {
+    // keep the lower half and offer the upper one to thieves, a full deque
+    // just means this thread does more of it itself
+    while (own && task.end - task.begin > 1) {
+        size_t middle = task.begin + (task.end - task.begin) / 2;
+        if (!push(*own, Task{task.job, middle, task.end})) break;
+        task.end = middle;
+    }
+    
+    Job* job = task.job;
+    for (size_t i = task.begin; i < task.end; i++) {
+        job->run(job->context, i);
+    }
+    // the job lives on the caller's stack, it may be gone right after this
+    job->remaining.fetch_sub(task.end - task.begin, std::memory_order_acq_rel);
+}
+
+void TaskPool::run_job(Job& job, size_t count) {
+    // one share per thread, the workers split theirs further as they go
+    size_t shares = std::min(count, workers.size() + 1);
+    size_t first = next_deque.fetch_add(1, std::memory_order_relaxed);
+    for (size_t s = 1; s < shares; s++) {
+        Task task{&job, count * s / shares, count * (s + 1) / shares};
+        if (!push(*deques[(first + s) % deques.size()], task)) {
+            execute(task, nullptr);
+        }
+    }
+    execute(Task{&job, 0, count / shares}, nullptr);
+    
+    // help with whatever is queued, ours or not, until our job is through
+    while (job.remaining.load(std::memory_order_acquire) > 0) {
+        Task task;
+        if (steal(first, task)) {
+            execute(task, nullptr);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void TaskPool::worker_loop(size_t index) {
+    Deque& own = *deques[index];
+    while (true) {
+        Task task;
+        if (pop_back(own, task) || steal(index + 1, task)) {
+            execute(task, &own);
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this] { return stopping || queued_tasks > 0; });
+        if (stopping && queued_tasks == 0) return;
+    }
+}
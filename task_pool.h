@@ -0,0 +1,92 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work stealing pool shared by every pipeline. parallel_for() deals an index
+// range out to the workers' deques, a worker runs its own tasks newest first
+// and halves big ones as it goes, an idle worker steals the oldest task of
+// another. the calling thread works on the range too and keeps helping
+// until all of it is done, so nested calls and calls from several pipelines
+// at once can't deadlock. tasks are plain structs in fixed size deques,
+// nothing is allocated per call.
+class TaskPool {
+private:
+    struct Job {
+        void (*run)(const void* context, size_t index);
+        const void* context;
+        std::atomic<size_t> remaining;
+    };
+    
+    struct Task {
+        Job* job;
+        size_t begin;
+        size_t end;
+    };
+    
+    static const size_t DEQUE_CAPACITY = 256;
+    
+    // oldest task at head, the owner takes from the back and thieves from the front
+    struct Deque {
+        std::mutex mutex;
+        Task tasks[DEQUE_CAPACITY];
+        size_t head;
+        size_t count;
+        Deque() : head(0), count(0) {}
+    };
+    
+    std::vector<std::unique_ptr<Deque>> deques;    // one per worker
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued_tasks;
+    std::atomic<size_t> next_deque;                // where the next job starts dealing
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping;
+    
+    bool push(Deque& deque, const Task& task);
+    bool pop_back(Deque& deque, Task& task);
+    bool steal(size_t first, Task& task);
+    // own is the deque split off halves go to, null on a calling thread
+    void execute(Task task, Deque* own);
+    void run_job(Job& job, size_t count);
+    void worker_loop(size_t index);
+    
+    explicit TaskPool(size_t threads);
+    ~TaskPool();
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+    
+public:
+    // threads besides the callers, set before the first instance() call.
+    // 0 runs everything on the calling threads. the default is one less than
+    // the cores, the pipeline threads that call in make up the rest.
+    static void configure(size_t threads);
+    static TaskPool& instance();
+    
+    size_t get_thread_count() const { return workers.size(); }
+    
+    // fn(index) for every index in [0, count), returns once all have run.
+    // indices run in any order on any thread, so write results by index and
+    // merge them afterwards for a deterministic order.
+    template <typename Fn>
+    void parallel_for(size_t count, const Fn& fn) {
+        if (count == 0) return;
+        if (count == 1 || workers.empty()) {
+            for (size_t i = 0; i < count; i++) fn(i);
+            return;
+        }
+        Job job;
+        job.run = [](const void* context, size_t index) { (*static_cast<const Fn*>(context))(index); };
+        job.context = &fn;
+        job.remaining.store(count, std::memory_order_relaxed);
+        run_job(job, count);
+    }
+};
+
+#endif // TASK_POOL_H
@@ -0,0 +1,70 @@
+#include "text_cache.h"
+
+TextCache::TextCache(SDL_Renderer* renderer, TTF_Font* font, size_t capacity)
+    : renderer(renderer), font(font), capacity(capacity), hits(0), misses(0) {
+}
+
+TextCache::~TextCache() {
+    clear();
+}
+
+std::string TextCache::make_key(const std::string& text, SDL_Color color) {
+    std::string key;
+    key.reserve(text.size() + 4);
+    key.push_back((char)color.r);
+    key.push_back((char)color.g);
+    key.push_back((char)color.b);
+    key.push_back((char)color.a);
+    key += text;
+    return key;
+}
+
+void TextCache::evict_oldest() {
+    Entry& oldest = entries.back();
+    SDL_DestroyTexture(oldest.texture);
+    index.erase(oldest.key);
+    entries.pop_back();
+}
+
+void TextCache::clear() {
+    for (auto& entry : entries) {
+        SDL_DestroyTexture(entry.texture);
+    }
+    entries.clear();
+    index.clear();
+}
+
+bool TextCache::draw(const std::string& text, int x, int y, SDL_Color color) {
+    if (!font || !renderer || text.empty()) return false;
+    
+    std::string key = make_key(text, color);
+    auto found = index.find(key);
+    
+    if (found != index.end()) {
+        // move to the front of the lru list
+        entries.splice(entries.begin(), entries, found->second);
+        hits++;
+    } else {
+        SDL_Surface* text_surface = TTF_RenderText_Solid(font, text.c_str(), color);
+        if (!text_surface) return false;
+        
+        SDL_Texture* text_texture = SDL_CreateTextureFromSurface(renderer, text_surface);
+        int width = text_surface->w;
+        int height = text_surface->h;
+        SDL_FreeSurface(text_surface);
+        if (!text_texture) return false;
+        
+        if (entries.size() >= capacity) {
+            evict_oldest();
+        }
+        
+        entries.push_front({key, text_texture, width, height});
+        index[key] = entries.begin();
+        misses++;
+    }
+    
+    const Entry& entry = entries.front();
+    SDL_Rect dest_rect = {x, y, entry.width, entry.height};
+    SDL_RenderCopy(renderer, entry.texture, nullptr, &dest_rect);
+    return true;
+}
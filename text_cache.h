@@ -0,0 +1,49 @@
+#ifndef TEXT_CACHE_H
+#define TEXT_CACHE_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <string>
+#include <list>
+#include <cstdint>
+#include <unordered_map>
+
+// lru cache of rendered text textures keyed by string + color. static labels
+// get rasterized once, changing values (frequency, counts) only when they
+// actually change, and the least recently drawn entries get evicted.
+class TextCache {
+private:
+    struct Entry {
+        std::string key;
+        SDL_Texture* texture;
+        int width;
+        int height;
+    };
+    
+    SDL_Renderer* renderer;
+    TTF_Font* font;
+    size_t capacity;
+    
+    std::list<Entry> entries;  // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    
+    uint64_t hits;
+    uint64_t misses;
+    
+    static std::string make_key(const std::string& text, SDL_Color color);
+    void evict_oldest();
+    
+public:
+    TextCache(SDL_Renderer* renderer, TTF_Font* font, size_t capacity = 128);
+    ~TextCache();
+    
+    // draw text with its top left corner at x, y
+    bool draw(const std::string& text, int x, int y, SDL_Color color);
+    void clear();
+    
+    size_t size() const { return entries.size(); }
+    uint64_t get_hits() const { return hits; }
+    uint64_t get_misses() const { return misses; }
+};
+
+#endif // TEXT_CACHE_H
@@ -0,0 +1,144 @@
+#include "tuner_set.h"
+#include "protocol_analyzer.h"
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+
+TunerSet::~TunerSet() {
+    stop();
+}
+
+bool TunerSet::open(const std::vector<std::string>& selectors) {
+    std::vector<std::string> devices = selectors;
+    if (devices.empty()) {
+        devices.push_back("0");
+    }
+    
+    for (const auto& selector : devices) {
+        int index = SimpleSDR::find_device(selector);
+        std::unique_ptr<Tuner> tuner(new Tuner());
+        if (index < 0 || !tuner->sdr.initialize(index)) {
+            std::cerr << "Failed to initialize SDR " << selector << "!" << std::endl;
+            return false;
+        }
+        tuners.push_back(std::move(tuner));
+    }
+    return true;
+}
+
+bool TunerSet::open_replay(const std::string& path, bool realtime) {
+    std::unique_ptr<Tuner> tuner(new Tuner());
+    if (!tuner->sdr.open_replay(path, realtime)) {
+        std::cerr << "Failed to open replay " << path << "!" << std::endl;
+        return false;
+    }
+    tuners.push_back(std::move(tuner));
+    return true;
+}
+
+void TunerSet::connect(ProtocolAnalyzer& analyzer) {
+    for (size_t i = 0; i < tuners.size(); i++) {
+        Tuner& tuner = *tuners[i];
+        size_t tuner_index = 0;
+        if (i == 0) {
+            analyzer.set_sdr_reference(&tuner.sdr);
+        } else {
+            tuner_index = analyzer.add_tuner(&tuner.sdr);
+        }
+        tuner.pipeline.set_sdr_reference(&tuner.sdr);
+        tuner.pipeline.set_protocol_analyzer_reference(&analyzer);
+        tuner.pipeline.set_scan_scheduler_reference(&tuner.scheduler);
+        tuner.scheduler.set_sdr_reference(&tuner.sdr);
+        tuner.scheduler.set_protocol_analyzer_reference(&analyzer);
+        tuner.scheduler.set_tuner_index(tuner_index);
+    }
+}
+
+bool TunerSet::set_history_seconds(double seconds) {
+    for (auto& tuner : tuners) {
+        if (!tuner->sdr.set_history_seconds(seconds)) return false;
+    }
+    return true;
+}
+
+bool TunerSet::start_event_capture(const ProtocolAnalyzer& analyzer, const std::string& directory,
+                                   uint32_t pre_ms, uint32_t post_ms) {
+    for (size_t i = 0; i < tuners.size(); i++) {
+        Tuner& tuner = *tuners[i];
+        if (!tuner.events.start(&tuner.sdr, &analyzer, directory, "t" + std::to_string(i), pre_ms, post_ms)) return false;
+        tuner.pipeline.set_event_capture_reference(&tuner.events);
+    }
+    return true;
+}
+
+bool TunerSet::start() {
+    for (auto& tuner : tuners) {
+        if (!tuner->pipeline.start()) {
+            std::cerr << "Failed to start processing pipeline!" << std::endl;
+            return false;
+        }
+        tuner->scheduler.start();
+    }
+    std::cout << "Running " << tuners.size() << " tuner(s)" << std::endl;
+    return true;
+}
+
+void TunerSet::stop() {
+    for (auto& tuner : tuners) {
+        tuner->scheduler.stop();
+        tuner->pipeline.stop();
+        tuner->events.stop();
+        tuner->sdr.stop();
+        tuner->sdr.stop_capture();
+    }
+}
+
+void TunerSet::request_stop() {
+    for (auto& tuner : tuners) {
+        tuner->sdr.stop();
+    }
+}
+
+void TunerSet::set_paused(bool paused) {
+    for (auto& tuner : tuners) {
+        tuner->scheduler.set_paused(paused);
+    }
+}
+
+void TunerSet::set_gain(int gain) {
+    for (auto& tuner : tuners) {
+        tuner->sdr.set_gain(gain);
+    }
+}
+
+bool TunerSet::set_range_dwell(const ProtocolAnalyzer& analyzer, const std::string& spec) {
+    size_t equals = spec.find('=');
+    char* mhz_end = nullptr;
+    char* ms_end = nullptr;
+    double mhz = std::strtod(spec.c_str(), &mhz_end);
+    long dwell_ms = equals == std::string::npos ? 0 : std::strtol(spec.c_str() + equals + 1, &ms_end, 10);
+    if (equals == std::string::npos || mhz_end != spec.c_str() + equals || mhz <= 0.0 ||
+        *ms_end != '\0' || dwell_ms <= 0) {
+        std::cerr << "Dwell must be <MHz>=<ms>, got " << spec << std::endl;
+        return false;
+    }
+    
+    // ranges overlap, 868.3 MHz is in both 868 MHz ranges
+    uint32_t frequency = (uint32_t)std::lround(mhz * 1e6);
+    const auto& ranges = analyzer.get_scan_ranges();
+    bool covered = false;
+    for (size_t range = 0; range < ranges.size(); range++) {
+        if (frequency < ranges[range].first || frequency > ranges[range].second) continue;
+        covered = true;
+        std::cout << "Dwell " << dwell_ms << " ms on " << ranges[range].first / 1e6 << "-"
+                  << ranges[range].second / 1e6 << " MHz" << std::endl;
+        for (auto& tuner : tuners) {
+            tuner->scheduler.set_range_dwell(range, (int)dwell_ms);
+        }
+    }
+    if (!covered) {
+        std::cerr << "No scan range covers " << mhz << " MHz" << std::endl;
+        return false;
+    }
+    return true;
+}
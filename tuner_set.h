@@ -0,0 +1,60 @@
+#ifndef TUNER_SET_H
+#define TUNER_SET_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include "sdr.h"
+#include "pipeline.h"
+#include "scan_scheduler.h"
+#include "event_capture.h"
+
+class ProtocolAnalyzer;
+
+// one capture chain per dongle, all of them feed the same analyzer and its
+// device database
+struct Tuner {
+    SimpleSDR sdr;
+    Pipeline pipeline;
+    ScanScheduler scheduler;
+    EventCapture events;       // idle unless start_event_capture() was called
+};
+
+// the dongles a frontend runs, the first one is the primary the gui shows
+// and tunes. shared by the gui and the headless frontends.
+class TunerSet {
+private:
+    std::vector<std::unique_ptr<Tuner>> tuners;
+    
+public:
+    ~TunerSet();
+    
+    // open one dongle per selector (index or serial), device 0 if empty
+    bool open(const std::vector<std::string>& selectors);
+    // a single tuner that plays an IQRecorder file instead
+    bool open_replay(const std::string& path, bool realtime);
+    // ring history of every tuner, before start()
+    bool set_history_seconds(double seconds);
+    // register every tuner with the analyzer and connect its chain
+    void connect(ProtocolAnalyzer& analyzer);
+    // dump the iq around alerts into directory, after connect() and before start()
+    bool start_event_capture(const ProtocolAnalyzer& analyzer, const std::string& directory,
+                             uint32_t pre_ms, uint32_t post_ms);
+    // capture thread, pipeline and scheduler of every tuner
+    bool start();
+    void stop();
+    // async signal safe, cancels the captures and lets the frontend exit
+    void request_stop();
+    
+    void set_paused(bool paused);
+    void set_gain(int gain);
+    // "<MHz>=<ms>", the dwell of every scan range that covers the frequency,
+    // on every tuner. false with a message for a bad spec or no such range.
+    bool set_range_dwell(const ProtocolAnalyzer& analyzer, const std::string& spec);
+    
+    size_t size() const { return tuners.size(); }
+    Tuner& primary() { return *tuners.front(); }
+    Tuner& operator[](size_t index) { return *tuners[index]; }
+};
+
+#endif // TUNER_SET_H